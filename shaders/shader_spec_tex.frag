@@ -1,9 +1,14 @@
 #version 410 core
 
 //uniform vec3 objectColor;
-uniform vec3 lightDir;
 //uniform vec3 lightPos;
-uniform vec3 cameraPos;
+// per-frame values, see Core::FrameData
+layout(std140) uniform FrameData
+{
+	mat4 viewProjection;
+	vec4 cameraPos;
+	vec4 lightDir;
+};
 uniform sampler2D color_texture;
 uniform sampler2D specular_texture;
 
@@ -18,12 +23,12 @@ void main()
 	vec3 color = texture(color_texture,uvCoord).rgb;
 	vec3 spec = texture(specular_texture,uvCoord).rgb;
 	//vec3 lightDir = normalize(lightPos-fragPos);
-	vec3 V = normalize(cameraPos-fragPos);
+	vec3 V = normalize(cameraPos.xyz-fragPos);
 	vec3 normal = normalize(interpNormal);
-	vec3 R = reflect(-normalize(lightDir),normal);
+	vec3 R = reflect(-normalize(lightDir.xyz),normal);
 	
 	float specular = pow(max(0,dot(R,V)),10);
-	float diffuse = max(0,dot(normal,normalize(lightDir)));
+	float diffuse = max(0,dot(normal,normalize(lightDir.xyz)));
 	gl_FragColor = vec4(mix(color,color*diffuse+spec*specular,0.7), 1.0);
 	//gl_FragColor = vec4(mix(vec3(0.1,0.1,0.1),mix(color,color*diffuse+spec*specular,0.7),min(1,1/falloff)), 1.0);
 }
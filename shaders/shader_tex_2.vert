@@ -4,16 +4,33 @@ layout(location = 0) in vec3 vertexPosition;
 layout(location = 1) in vec3 vertexNormal;
 layout(location = 2) in vec2 vertexTexCoord;
 
-uniform mat4 transformation;
+// per-frame values, see Core::FrameData
+layout(std140) uniform FrameData
+{
+	mat4 viewProjection;
+	vec4 cameraPos;
+	vec4 lightDir;
+};
 uniform mat4 modelMatrix;
+// true for quantized meshes: vertexNormal.xy holds an octahedral encoded normal
+uniform bool packedNormals;
 out vec3 interpNormal;
 out vec3 fragPos;
 out vec2 uvCoord;
 
+vec3 octahedralDecode(vec2 e)
+{
+	vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+	if (n.z < 0.0)
+		n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+	return normalize(n);
+}
+
 void main()
 {
+	vec3 normal = packedNormals ? octahedralDecode(vertexNormal.xy) : vertexNormal;
 	uvCoord = vertexTexCoord;
-	gl_Position = transformation * vec4(vertexPosition, 1.0);
-	interpNormal = (modelMatrix*vec4(vertexNormal,0)).xyz;
+	gl_Position = viewProjection * modelMatrix * vec4(vertexPosition, 1.0);
+	interpNormal = (modelMatrix*vec4(normal,0)).xyz;
 	fragPos = (modelMatrix*vec4(vertexPosition,1)).xyz;
 }
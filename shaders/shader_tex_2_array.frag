@@ -0,0 +1,42 @@
+#version 430 core
+
+// shader_tex_2.frag with the textures of all materials in texture arrays, see Core::MaterialTable
+// per-frame values, see Core::FrameData
+layout(std140) uniform FrameData
+{
+	mat4 viewProjection;
+	vec4 cameraPos;
+	vec4 lightDir;
+};
+uniform sampler2DArray color_textures;
+
+struct MaterialLayers
+{
+	int colorLayer;
+	int specularLayer;
+};
+
+layout(std430, binding = 1) readonly buffer MaterialBuffer
+{
+	MaterialLayers materials[];
+};
+
+in vec3 interpNormal;
+in vec3 fragPos;
+in vec2 uvCoord;
+flat in uint drawMaterial;
+
+void main()
+{
+	MaterialLayers material = materials[drawMaterial];
+	// a material without a texture samples black, like an unbound texture
+	vec3 color = material.colorLayer >= 0 ? texture(color_textures, vec3(uvCoord, material.colorLayer)).rgb : vec3(0);
+	vec3 spec = vec3(0.7);
+	vec3 V = normalize(cameraPos.xyz-fragPos);
+	vec3 normal = normalize(interpNormal);
+	vec3 R = reflect(-normalize(lightDir.xyz),normal);
+
+	float specular = pow(max(0,dot(R,V)),10);
+	float diffuse = max(0,dot(normal,normalize(lightDir.xyz)));
+	gl_FragColor = vec4(mix(color,color*diffuse+spec*specular,0.7), 1.0);
+}
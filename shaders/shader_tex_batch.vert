@@ -0,0 +1,22 @@
+#version 410 core
+
+layout(location = 0) in vec3 vertexPosition;
+layout(location = 1) in vec2 vertexTexCoord;
+layout(location = 2) in vec3 vertexNormal;
+// transformation of the instance, one matrix per instance
+layout(location = 6) in mat4 instanceMatrix;
+
+uniform mat4 viewProjectionMatrix;
+// transformation of the mesh relative to the instance, the same for every instance
+uniform mat4 modelMatrix;
+
+out vec3 interpNormal;
+out vec2 interpTexCoord;
+
+void main()
+{
+	mat4 worldMatrix = instanceMatrix * modelMatrix;
+	gl_Position = viewProjectionMatrix * worldMatrix * vec4(vertexPosition, 1.0);
+	interpNormal = (worldMatrix * vec4(vertexNormal, 0.0)).xyz;
+	interpTexCoord = vertexTexCoord;
+}
@@ -0,0 +1,40 @@
+#version 410 core
+
+layout(location = 0) in vec3 vertexPosition;
+layout(location = 1) in vec3 vertexNormal;
+layout(location = 2) in vec2 vertexTexCoord;
+// transformation of the instance, one matrix per instance
+layout(location = 6) in mat4 instanceMatrix;
+
+// per-frame values, see Core::FrameData
+layout(std140) uniform FrameData
+{
+	mat4 viewProjection;
+	vec4 cameraPos;
+	vec4 lightDir;
+};
+// transformation of the mesh relative to the instance
+uniform mat4 modelMatrix;
+// true for quantized meshes: vertexNormal.xy holds an octahedral encoded normal
+uniform bool packedNormals;
+out vec3 interpNormal;
+out vec3 fragPos;
+out vec2 uvCoord;
+
+vec3 octahedralDecode(vec2 e)
+{
+	vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+	if (n.z < 0.0)
+		n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+	return normalize(n);
+}
+
+void main()
+{
+	mat4 world = instanceMatrix * modelMatrix;
+	vec3 normal = packedNormals ? octahedralDecode(vertexNormal.xy) : vertexNormal;
+	uvCoord = vertexTexCoord;
+	fragPos = (world*vec4(vertexPosition,1)).xyz;
+	gl_Position = viewProjection * vec4(fragPos, 1.0);
+	interpNormal = (world*vec4(normal,0)).xyz;
+}
@@ -0,0 +1,51 @@
+#version 430 core
+
+layout(location = 0) in vec3 vertexPosition;
+layout(location = 1) in vec3 vertexNormal;
+layout(location = 2) in vec2 vertexTexCoord;
+// index of the draw, offset by the baseInstance of the indirect command
+layout(location = 5) in uint drawIndex;
+
+struct DrawData
+{
+	mat4 modelMatrix;
+	uint packedNormals;
+	uint materialIndex;
+};
+
+layout(std430, binding = 0) readonly buffer DrawDataBuffer
+{
+	DrawData draws[];
+};
+
+// per-frame values, see Core::FrameData
+layout(std140) uniform FrameData
+{
+	mat4 viewProjection;
+	vec4 cameraPos;
+	vec4 lightDir;
+};
+out vec3 interpNormal;
+out vec3 fragPos;
+out vec2 uvCoord;
+// entry of the material buffer, read by the *_array.frag shaders
+flat out uint drawMaterial;
+
+vec3 octahedralDecode(vec2 e)
+{
+	vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+	if (n.z < 0.0)
+		n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+	return normalize(n);
+}
+
+void main()
+{
+	mat4 modelMatrix = draws[drawIndex].modelMatrix;
+	vec3 normal = draws[drawIndex].packedNormals != 0u ? octahedralDecode(vertexNormal.xy) : vertexNormal;
+	uvCoord = vertexTexCoord;
+	drawMaterial = draws[drawIndex].materialIndex;
+	fragPos = (modelMatrix*vec4(vertexPosition,1)).xyz;
+	gl_Position = viewProjection * vec4(fragPos, 1.0);
+	interpNormal = (modelMatrix*vec4(normal,0)).xyz;
+}
@@ -0,0 +1,392 @@
+#include "Bvh.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+namespace
+{
+	const int BIN_COUNT = 16;
+	const int MIN_LEAF_ITEMS = 4;
+	const int MAX_LEAF_ITEMS = 8;
+	// cost of visiting an inner node relative to testing one box
+	const float TRAVERSAL_COST = 1.0f;
+
+	struct Bin {
+		glm::vec3 boundsMin = glm::vec3(FLT_MAX);
+		glm::vec3 boundsMax = glm::vec3(-FLT_MAX);
+		int count = 0;
+	};
+
+	float halfArea(const glm::vec3& boundsMin, const glm::vec3& boundsMax)
+	{
+		glm::vec3 size = boundsMax - boundsMin;
+		return size.x * size.y + size.y * size.z + size.z * size.x;
+	}
+
+	bool isEmpty(const Core::Bvh::Node& node)
+	{
+		return node.boundsMin.x > node.boundsMax.x;
+	}
+
+	// false if the box is outside one of the planes in the mask, clears the planes the box is completely inside
+	bool clipBox(const Core::Frustum& frustum, const glm::vec3& boundsMin, const glm::vec3& boundsMax, int& planes)
+	{
+		glm::vec3 center = (boundsMin + boundsMax) * 0.5f;
+		glm::vec3 extent = (boundsMax - boundsMin) * 0.5f;
+		for (int p = 0; p < 6; p++) {
+			if (!(planes & (1 << p)))
+				continue;
+			const glm::vec4& plane = frustum.planes[p];
+			float distance = plane.x * center.x + plane.y * center.y + plane.z * center.z + plane.w;
+			float radius = fabsf(plane.x) * extent.x + fabsf(plane.y) * extent.y + fabsf(plane.z) * extent.z;
+			if (distance + radius < 0.0f)
+				return false;
+			if (distance - radius >= 0.0f)
+				planes &= ~(1 << p);
+		}
+		return true;
+	}
+
+	// entry distance of the ray into the box, false if it misses
+	bool rayBox(const glm::vec3& origin, const glm::vec3& inverseDirection, const glm::vec3& boundsMin, const glm::vec3& boundsMax, float& distance)
+	{
+		glm::vec3 t1 = (boundsMin - origin) * inverseDirection;
+		glm::vec3 t2 = (boundsMax - origin) * inverseDirection;
+		glm::vec3 lower = glm::min(t1, t2), upper = glm::max(t1, t2);
+		float enter = std::max(std::max(lower.x, lower.y), std::max(lower.z, 0.0f));
+		float exit = std::min(std::min(upper.x, upper.y), upper.z);
+		distance = enter;
+		return enter <= exit;
+	}
+}
+
+void Core::Bvh::add(int id, const glm::vec3& boundsMin, const glm::vec3& boundsMax)
+{
+	if (id >= (int)locations.size()) {
+		locations.resize(id + 1, ABSENT);
+		boxMin.resize(id + 1);
+		boxMax.resize(id + 1);
+	}
+	boxMin[id] = boundsMin;
+	boxMax[id] = boundsMax;
+	locations[id] = PENDING;
+	pending.push_back(id);
+	itemCount++;
+}
+
+void Core::Bvh::remove(int id)
+{
+	if (!contains(id))
+		return;
+	int slot = locations[id];
+	if (slot == PENDING) {
+		auto found = std::find(pending.begin(), pending.end(), id);
+		*found = pending.back();
+		pending.pop_back();
+	}
+	else {
+		// the last item of the leaf takes the free slot, which stays empty in the ranges of the ancestors
+		int leaf = orderLeaf[slot];
+		int last = tree[leaf].first + tree[leaf].count - 1;
+		std::swap(order[slot], order[last]);
+		std::swap(orderMin[slot], orderMin[last]);
+		std::swap(orderMax[slot], orderMax[last]);
+		locations[order[slot]] = slot;
+		order[last] = ABSENT;
+		tree[leaf].count--;
+		setLeafBounds(leaf);
+		refit(parents[leaf]);
+		removedSinceBuild++;
+	}
+	locations[id] = ABSENT;
+	itemCount--;
+}
+
+void Core::Bvh::build()
+{
+	order.clear();
+	orderMin.clear();
+	orderMax.clear();
+	for (size_t id = 0; id < locations.size(); id++) {
+		if (locations[id] == ABSENT)
+			continue;
+		order.push_back(id);
+		orderMin.push_back(boxMin[id]);
+		orderMax.push_back(boxMax[id]);
+	}
+	orderLeaf.resize(order.size());
+	tree.clear();
+	parents.clear();
+	itemRanges.clear();
+	pending.clear();
+	removedSinceBuild = 0;
+	if (order.empty())
+		return;
+
+	// a binary tree with at least one item per leaf has fewer than 2n nodes
+	tree.reserve(order.size() * 2);
+	parents.reserve(order.size() * 2);
+	itemRanges.reserve(order.size() * 2);
+	buildNode(0, order.size(), -1);
+	for (size_t i = 0; i < order.size(); i++)
+		locations[order[i]] = i;
+}
+
+void Core::Bvh::refresh()
+{
+	int rebuildThreshold = std::max(32, itemCount / 8);
+	if ((int)pending.size() > rebuildThreshold || removedSinceBuild > std::max(rebuildThreshold, itemCount / 4))
+		build();
+}
+
+void Core::Bvh::clear()
+{
+	tree.clear();
+	parents.clear();
+	itemRanges.clear();
+	order.clear();
+	orderMin.clear();
+	orderMax.clear();
+	orderLeaf.clear();
+	locations.clear();
+	boxMin.clear();
+	boxMax.clear();
+	pending.clear();
+	itemCount = 0;
+	removedSinceBuild = 0;
+}
+
+int Core::Bvh::buildNode(int first, int count, int parent)
+{
+	int index = tree.size();
+	tree.push_back(Node());
+	parents.push_back(parent);
+	itemRanges.push_back(std::make_pair(first, first + count));
+
+	// centroids are kept doubled (min + max), only their relative positions matter
+	glm::vec3 boundsMin(FLT_MAX), boundsMax(-FLT_MAX), centroidMin(FLT_MAX), centroidMax(-FLT_MAX);
+	for (int i = first; i < first + count; i++) {
+		boundsMin = glm::min(boundsMin, orderMin[i]);
+		boundsMax = glm::max(boundsMax, orderMax[i]);
+		glm::vec3 centroid = orderMin[i] + orderMax[i];
+		centroidMin = glm::min(centroidMin, centroid);
+		centroidMax = glm::max(centroidMax, centroid);
+	}
+	tree[index].boundsMin = boundsMin;
+	tree[index].boundsMax = boundsMax;
+
+	int bestAxis = -1, bestBin = 0;
+	float bestCost = FLT_MAX;
+	if (count > 1) {
+		float parentArea = std::max(halfArea(boundsMin, boundsMax), FLT_MIN);
+		for (int axis = 0; axis < 3; axis++) {
+			float extent = centroidMax[axis] - centroidMin[axis];
+			if (extent <= 0.0f)
+				continue;
+			Bin bins[BIN_COUNT];
+			float scale = BIN_COUNT / extent;
+			for (int i = first; i < first + count; i++) {
+				float centroid = orderMin[i][axis] + orderMax[i][axis];
+				Bin& bin = bins[std::min(BIN_COUNT - 1, (int)((centroid - centroidMin[axis]) * scale))];
+				bin.boundsMin = glm::min(bin.boundsMin, orderMin[i]);
+				bin.boundsMax = glm::max(bin.boundsMax, orderMax[i]);
+				bin.count++;
+			}
+			// areas and counts left of every split plane, then a sweep from the right evaluates them
+			float leftArea[BIN_COUNT - 1];
+			int leftCount[BIN_COUNT - 1];
+			Bin sweep;
+			for (int b = 0; b < BIN_COUNT - 1; b++) {
+				sweep.boundsMin = glm::min(sweep.boundsMin, bins[b].boundsMin);
+				sweep.boundsMax = glm::max(sweep.boundsMax, bins[b].boundsMax);
+				sweep.count += bins[b].count;
+				leftArea[b] = sweep.count ? halfArea(sweep.boundsMin, sweep.boundsMax) : 0.0f;
+				leftCount[b] = sweep.count;
+			}
+			sweep = Bin();
+			for (int b = BIN_COUNT - 1; b > 0; b--) {
+				sweep.boundsMin = glm::min(sweep.boundsMin, bins[b].boundsMin);
+				sweep.boundsMax = glm::max(sweep.boundsMax, bins[b].boundsMax);
+				sweep.count += bins[b].count;
+				if (leftCount[b - 1] == 0 || sweep.count == 0)
+					continue;
+				float rightArea = halfArea(sweep.boundsMin, sweep.boundsMax);
+				float cost = TRAVERSAL_COST + (leftArea[b - 1] * leftCount[b - 1] + rightArea * sweep.count) / parentArea;
+				if (cost < bestCost) {
+					bestCost = cost;
+					bestAxis = axis;
+					bestBin = b;
+				}
+			}
+		}
+	}
+
+	// testing every box of a leaf costs count, small leaves are kept whole as culling visits them anyway
+	if (count <= MIN_LEAF_ITEMS || (count <= MAX_LEAF_ITEMS && bestCost >= count)) {
+		tree[index].first = first;
+		tree[index].count = count;
+		for (int i = first; i < first + count; i++)
+			orderLeaf[i] = index;
+		return index;
+	}
+
+	int middle = first + count / 2;
+	if (bestAxis >= 0) {
+		float scale = BIN_COUNT / (centroidMax[bestAxis] - centroidMin[bestAxis]);
+		int left = first, right = first + count - 1;
+		while (left <= right) {
+			float centroid = orderMin[left][bestAxis] + orderMax[left][bestAxis];
+			if (std::min(BIN_COUNT - 1, (int)((centroid - centroidMin[bestAxis]) * scale)) < bestBin) {
+				left++;
+			}
+			else {
+				std::swap(order[left], order[right]);
+				std::swap(orderMin[left], orderMin[right]);
+				std::swap(orderMax[left], orderMax[right]);
+				right--;
+			}
+		}
+		middle = left;
+	}
+	// all centroids equal: any split is as good as another
+
+	buildNode(first, middle - first, index);
+	int right = buildNode(middle, first + count - middle, index);
+	tree[index].first = right;
+	tree[index].count = -1;
+	return index;
+}
+
+void Core::Bvh::setLeafBounds(int node)
+{
+	Node& leaf = tree[node];
+	leaf.boundsMin = glm::vec3(FLT_MAX);
+	leaf.boundsMax = glm::vec3(-FLT_MAX);
+	for (int i = leaf.first; i < leaf.first + leaf.count; i++) {
+		leaf.boundsMin = glm::min(leaf.boundsMin, orderMin[i]);
+		leaf.boundsMax = glm::max(leaf.boundsMax, orderMax[i]);
+	}
+}
+
+void Core::Bvh::refit(int node)
+{
+	for (; node >= 0; node = parents[node]) {
+		const Node& left = tree[node + 1];
+		const Node& right = tree[tree[node].first];
+		glm::vec3 boundsMin = glm::min(left.boundsMin, right.boundsMin);
+		glm::vec3 boundsMax = glm::max(left.boundsMax, right.boundsMax);
+		// ancestors already contain unchanged bounds
+		if (boundsMin == tree[node].boundsMin && boundsMax == tree[node].boundsMax)
+			break;
+		tree[node].boundsMin = boundsMin;
+		tree[node].boundsMax = boundsMax;
+	}
+}
+
+int Core::Bvh::cull(const Frustum& frustum, std::vector<unsigned char>& visible) const
+{
+	visible.assign(locations.size(), 0);
+	int visibleCount = 0;
+
+	if (!tree.empty()) {
+		// node index and the planes its parent was not completely inside of
+		std::vector<std::pair<int, int> > stack;
+		stack.reserve(64);
+		stack.push_back(std::make_pair(0, 0x3f));
+		while (!stack.empty()) {
+			int index = stack.back().first;
+			int planes = stack.back().second;
+			stack.pop_back();
+			const Node& node = tree[index];
+			if (isEmpty(node) || !clipBox(frustum, node.boundsMin, node.boundsMax, planes))
+				continue;
+			if (planes == 0) {
+				// completely inside, every item of the subtree is visible
+				for (int i = itemRanges[index].first; i < itemRanges[index].second; i++) {
+					if (order[i] != ABSENT) {
+						visible[order[i]] = 1;
+						visibleCount++;
+					}
+				}
+				continue;
+			}
+			if (node.count < 0) {
+				stack.push_back(std::make_pair(node.first, planes));
+				stack.push_back(std::make_pair(index + 1, planes));
+				continue;
+			}
+			for (int i = node.first; i < node.first + node.count; i++) {
+				int itemPlanes = planes;
+				if (clipBox(frustum, orderMin[i], orderMax[i], itemPlanes)) {
+					visible[order[i]] = 1;
+					visibleCount++;
+				}
+			}
+		}
+	}
+
+	for (int id : pending) {
+		if (frustum.intersects((boxMin[id] + boxMax[id]) * 0.5f, (boxMax[id] - boxMin[id]) * 0.5f)) {
+			visible[id] = 1;
+			visibleCount++;
+		}
+	}
+	return visibleCount;
+}
+
+int Core::Bvh::raycast(const glm::vec3& origin, const glm::vec3& direction, float& distance) const
+{
+	glm::vec3 inverseDirection = glm::vec3(1.0f) / direction;
+	float nearest = FLT_MAX;
+	int nearestId = -1;
+	float entry;
+
+	if (!tree.empty()) {
+		// node index and the distance at which the ray enters it
+		std::vector<std::pair<int, float> > stack;
+		stack.reserve(64);
+		if (!isEmpty(tree[0]) && rayBox(origin, inverseDirection, tree[0].boundsMin, tree[0].boundsMax, entry))
+			stack.push_back(std::make_pair(0, entry));
+		while (!stack.empty()) {
+			int index = stack.back().first;
+			// a nearer hit may have been found since the node was pushed
+			bool farther = stack.back().second >= nearest;
+			stack.pop_back();
+			if (farther)
+				continue;
+			const Node& node = tree[index];
+			if (node.count >= 0) {
+				for (int i = node.first; i < node.first + node.count; i++) {
+					if (rayBox(origin, inverseDirection, orderMin[i], orderMax[i], entry) && entry < nearest) {
+						nearest = entry;
+						nearestId = order[i];
+					}
+				}
+				continue;
+			}
+			// the nearer child is pushed last so it is visited first
+			int children[2] = { index + 1, node.first };
+			float entries[2];
+			bool hits[2];
+			for (int c = 0; c < 2; c++) {
+				const Node& child = tree[children[c]];
+				hits[c] = !isEmpty(child) && rayBox(origin, inverseDirection, child.boundsMin, child.boundsMax, entries[c]) && entries[c] < nearest;
+			}
+			int nearer = hits[0] && hits[1] && entries[1] < entries[0] ? 1 : 0;
+			if (hits[1 - nearer])
+				stack.push_back(std::make_pair(children[1 - nearer], entries[1 - nearer]));
+			if (hits[nearer])
+				stack.push_back(std::make_pair(children[nearer], entries[nearer]));
+		}
+	}
+
+	for (int id : pending) {
+		if (rayBox(origin, inverseDirection, boxMin[id], boxMax[id], entry) && entry < nearest) {
+			nearest = entry;
+			nearestId = id;
+		}
+	}
+	distance = nearest;
+	return nearestId;
+}
@@ -0,0 +1,67 @@
+#pragma once
+#include "glm.hpp"
+#include "Frustum.h"
+#include <vector>
+
+namespace Core
+{
+	// Bounding volume hierarchy over static axis aligned boxes identified by small integer ids.
+	// build() splits the boxes with a binned surface area heuristic and stores the tree depth-first
+	// in one array (the left child directly follows its parent), so traversals walk memory forward.
+	// add() and remove() are incremental: a removed box is taken out of its leaf and the ancestors
+	// are refitted, a new box waits in a small list that the queries test linearly until refresh()
+	// decides that enough has changed to rebuild.
+	class Bvh
+	{
+	public:
+		struct Node {
+			glm::vec3 boundsMin;
+			int first;		// first item of a leaf, index of the right child of an inner node
+			glm::vec3 boundsMax;
+			int count;		// items in a leaf, -1 for inner nodes
+		};
+
+		// id must not be in the tree yet
+		void add(int id, const glm::vec3& boundsMin, const glm::vec3& boundsMax);
+		void remove(int id);
+		bool contains(int id) const { return id >= 0 && id < (int)locations.size() && locations[id] != ABSENT; }
+
+		// rebuilds the tree from all boxes
+		void build();
+		// rebuilds when the pending boxes or the removals since the last build make the tree worth redoing
+		void refresh();
+		void clear();
+
+		// visible[id] is set to 1 for boxes intersecting the frustum (sized to the largest id + 1),
+		// subtrees completely inside are accepted without testing their boxes; returns the visible count
+		int cull(const Frustum& frustum, std::vector<unsigned char>& visible) const;
+		// id of the nearest box hit by the ray or -1, distance is measured in direction lengths
+		int raycast(const glm::vec3& origin, const glm::vec3& direction, float& distance) const;
+
+		int size() const { return itemCount; }
+		int pendingCount() const { return pending.size(); }
+		const std::vector<Node>& nodes() const { return tree; }
+
+	private:
+		enum { ABSENT = -1, PENDING = -2 };
+
+		int buildNode(int first, int count, int parent);
+		void refit(int node);
+		void setLeafBounds(int node);
+
+		std::vector<Node> tree;
+		std::vector<int> parents;
+		// slots of the leaf order below every node, removed items leave ABSENT behind
+		std::vector<std::pair<int, int> > itemRanges;
+		// item ids and boxes in leaf order
+		std::vector<int> order;
+		std::vector<glm::vec3> orderMin, orderMax;
+		std::vector<int> orderLeaf;
+		// per id: slot in the leaf order, ABSENT or PENDING, and the box for rebuilds
+		std::vector<int> locations;
+		std::vector<glm::vec3> boxMin, boxMax;
+		std::vector<int> pending;
+		int itemCount = 0;
+		int removedSinceBuild = 0;
+	};
+}
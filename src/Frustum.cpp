@@ -0,0 +1,117 @@
+#include "Frustum.h"
+
+#include <cmath>
+
+#ifdef CORE_FRUSTUM_SSE
+#include <xmmintrin.h>
+#endif
+
+Core::Frustum Core::Frustum::fromMatrix(const glm::mat4& viewProjection)
+{
+	// rows of the matrix (glm stores columns)
+	glm::vec4 rows[4];
+	for (int i = 0; i < 4; i++)
+		rows[i] = glm::vec4(viewProjection[0][i], viewProjection[1][i], viewProjection[2][i], viewProjection[3][i]);
+
+	Frustum frustum;
+	frustum.planes[0] = rows[3] + rows[0];
+	frustum.planes[1] = rows[3] - rows[0];
+	frustum.planes[2] = rows[3] + rows[1];
+	frustum.planes[3] = rows[3] - rows[1];
+	frustum.planes[4] = rows[3] + rows[2];
+	frustum.planes[5] = rows[3] - rows[2];
+	return frustum;
+}
+
+bool Core::Frustum::intersects(const glm::vec3& center, const glm::vec3& extent) const
+{
+	for (int i = 0; i < 6; i++) {
+		const glm::vec4& plane = planes[i];
+		float distance = plane.x * center.x + plane.y * center.y + plane.z * center.z + plane.w;
+		float radius = fabsf(plane.x) * extent.x + fabsf(plane.y) * extent.y + fabsf(plane.z) * extent.z;
+		if (distance + radius < 0.0f)
+			return false;
+	}
+	return true;
+}
+
+void Core::BoundsArray::resize(int count)
+{
+	centerX.resize(count);
+	centerY.resize(count);
+	centerZ.resize(count);
+	extentX.resize(count);
+	extentY.resize(count);
+	extentZ.resize(count);
+}
+
+void Core::BoundsArray::set(int index, const glm::vec3& center, const glm::vec3& extent)
+{
+	centerX[index] = center.x;
+	centerY[index] = center.y;
+	centerZ[index] = center.z;
+	extentX[index] = extent.x;
+	extentY[index] = extent.y;
+	extentZ[index] = extent.z;
+}
+
+void Core::transformBounds(const glm::mat4& matrix, const glm::vec3& boundsMin, const glm::vec3& boundsMax, glm::vec3& center, glm::vec3& extent)
+{
+	glm::vec3 localCenter = (boundsMin + boundsMax) * 0.5f;
+	glm::vec3 localExtent = (boundsMax - boundsMin) * 0.5f;
+	center = glm::vec3(matrix * glm::vec4(localCenter, 1.0f));
+	// each world axis gets the extent projected through the absolute rotation/scale part
+	glm::mat3 absolute(glm::abs(glm::vec3(matrix[0])), glm::abs(glm::vec3(matrix[1])), glm::abs(glm::vec3(matrix[2])));
+	extent = absolute * localExtent;
+}
+
+int Core::cullBounds(const Frustum& frustum, const BoundsArray& bounds, std::vector<unsigned char>& visible)
+{
+	int count = bounds.size();
+	visible.resize(count);
+	int visibleCount = 0;
+	int i = 0;
+
+#ifdef CORE_FRUSTUM_SSE
+	__m128 planeX[6], planeY[6], planeZ[6], planeW[6], absX[6], absY[6], absZ[6];
+	for (int p = 0; p < 6; p++) {
+		const glm::vec4& plane = frustum.planes[p];
+		planeX[p] = _mm_set1_ps(plane.x);
+		planeY[p] = _mm_set1_ps(plane.y);
+		planeZ[p] = _mm_set1_ps(plane.z);
+		planeW[p] = _mm_set1_ps(plane.w);
+		absX[p] = _mm_set1_ps(fabsf(plane.x));
+		absY[p] = _mm_set1_ps(fabsf(plane.y));
+		absZ[p] = _mm_set1_ps(fabsf(plane.z));
+	}
+	const __m128 zero = _mm_setzero_ps();
+
+	for (; i + 4 <= count; i += 4) {
+		__m128 cx = _mm_loadu_ps(&bounds.centerX[i]);
+		__m128 cy = _mm_loadu_ps(&bounds.centerY[i]);
+		__m128 cz = _mm_loadu_ps(&bounds.centerZ[i]);
+		__m128 ex = _mm_loadu_ps(&bounds.extentX[i]);
+		__m128 ey = _mm_loadu_ps(&bounds.extentY[i]);
+		__m128 ez = _mm_loadu_ps(&bounds.extentZ[i]);
+
+		__m128 outside = zero;
+		for (int p = 0; p < 6; p++) {
+			__m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(cx, planeX[p]), _mm_mul_ps(cy, planeY[p])), _mm_add_ps(_mm_mul_ps(cz, planeZ[p]), planeW[p]));
+			__m128 radius = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ex, absX[p]), _mm_mul_ps(ey, absY[p])), _mm_mul_ps(ez, absZ[p]));
+			outside = _mm_or_ps(outside, _mm_cmplt_ps(_mm_add_ps(distance, radius), zero));
+		}
+
+		int mask = _mm_movemask_ps(outside);
+		for (int k = 0; k < 4; k++) {
+			visible[i + k] = (mask >> k & 1) ? 0 : 1;
+			visibleCount += visible[i + k];
+		}
+	}
+#endif
+
+	for (; i < count; i++) {
+		visible[i] = frustum.intersects(bounds.center(i), bounds.extent(i)) ? 1 : 0;
+		visibleCount += visible[i];
+	}
+	return visibleCount;
+}
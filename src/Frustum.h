@@ -0,0 +1,41 @@
+#pragma once
+#include "glm.hpp"
+#include <vector>
+
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1) || defined(__SSE__)
+#define CORE_FRUSTUM_SSE 1
+#endif
+
+namespace Core
+{
+	// The six clip planes of a view-projection matrix, normals pointing inwards.
+	struct Frustum
+	{
+		glm::vec4 planes[6];
+
+		static Frustum fromMatrix(const glm::mat4& viewProjection);
+
+		// true unless the box is completely outside one of the planes
+		bool intersects(const glm::vec3& center, const glm::vec3& extent) const;
+	};
+
+	// Axis aligned boxes stored as center/half-extent arrays, the layout the SIMD test reads.
+	struct BoundsArray
+	{
+		std::vector<float> centerX, centerY, centerZ;
+		std::vector<float> extentX, extentY, extentZ;
+
+		int size() const { return centerX.size(); }
+		void resize(int count);
+		void set(int index, const glm::vec3& center, const glm::vec3& extent);
+		glm::vec3 center(int index) const { return glm::vec3(centerX[index], centerY[index], centerZ[index]); }
+		glm::vec3 extent(int index) const { return glm::vec3(extentX[index], extentY[index], extentZ[index]); }
+	};
+
+	// box of the transformed corners of (boundsMin, boundsMax), as center and half extent
+	void transformBounds(const glm::mat4& matrix, const glm::vec3& boundsMin, const glm::vec3& boundsMax, glm::vec3& center, glm::vec3& extent);
+
+	// Tests all boxes against the frustum, four at a time with SSE where available.
+	// visible[i] is set to 1 for boxes that may be on screen; returns their number.
+	int cullBounds(const Frustum& frustum, const BoundsArray& bounds, std::vector<unsigned char>& visible);
+}
@@ -0,0 +1,171 @@
+#include "Geometry_Pool.h"
+
+#include <algorithm>
+
+namespace
+{
+	// every level aims at half of the triangles of the previous one, up to this error relative
+	// to the diameter of the mesh
+	const float LOD_MAX_ERRORS[Core::MAX_LOD_LEVELS] = { 0.0f, 0.005f, 0.02f, 0.06f };
+	// a level that removes less than this part of the previous one is not worth its memory
+	const float LOD_MIN_REDUCTION = 0.1f;
+}
+
+void Core::GeometryPool::init(VertexFormat format, size_t verticesPerPage, size_t indicesPerPage)
+{
+	destroy();
+	vertexFormat = format == VertexFormat::Planar ? VertexFormat::Interleaved : format;
+	pageVertices = verticesPerPage;
+	pageIndices = indicesPerPage;
+}
+
+void Core::GeometryPool::setOptimizeMeshes(bool optimize)
+{
+	optimizeMeshes = optimize;
+}
+
+void Core::GeometryPool::setLodLevels(int levels)
+{
+	lodLevels = std::min(std::max(levels, 1), MAX_LOD_LEVELS);
+}
+
+Core::GeometryPool::Page& Core::GeometryPool::pageFor(size_t vertexCount, size_t indexCount)
+{
+	if (!pagesVector.empty()) {
+		Page& last = pagesVector.back();
+		if (last.vertexCount + vertexCount <= last.vertexCapacity && last.indexCount + indexCount <= last.indexCapacity)
+			return last;
+	}
+
+	// meshes larger than a page get a page of their own
+	Page page;
+	page.vertexCapacity = std::max(pageVertices, vertexCount);
+	page.indexCapacity = std::max(pageIndices, indexCount);
+
+	glGenVertexArrays(1, &page.vertexArray);
+	glBindVertexArray(page.vertexArray);
+
+	glGenBuffers(1, &page.indexBuffer);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, page.indexBuffer);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(unsigned int) * page.indexCapacity, NULL, GL_STATIC_DRAW);
+
+	glGenBuffers(1, &page.vertexBuffer);
+	glBindBuffer(GL_ARRAY_BUFFER, page.vertexBuffer);
+	glBufferData(GL_ARRAY_BUFFER, vertexStride(vertexFormat) * page.vertexCapacity, NULL, GL_STATIC_DRAW);
+	setVertexAttributes(vertexFormat);
+
+	glBindVertexArray(0);
+	pagesVector.push_back(page);
+	return pagesVector.back();
+}
+
+void Core::GeometryPool::add(aiMesh* mesh, RenderContext& context)
+{
+	PackedVertices packed;
+	packVertices(mesh, vertexFormat, packed);
+
+	std::vector<unsigned int> indices;
+	for (unsigned int i = 0; i < mesh->mNumFaces; i++)
+		indices.insert(indices.end(), mesh->mFaces[i].mIndices, mesh->mFaces[i].mIndices + mesh->mFaces[i].mNumIndices);
+
+	bool triangleMesh = mesh->mPrimitiveTypes == aiPrimitiveType_TRIANGLE;
+	bool optimize = optimizeMeshes && triangleMesh;
+	if (optimize) {
+		cacheBefore.add(analyzeVertexCache(indices.data(), indices.size(), mesh->mNumVertices));
+		optimizeVertexCache(indices.data(), indices.size(), mesh->mNumVertices);
+		optimizeOverdraw(indices.data(), indices.size(), &mesh->mVertices[0].x, 3, mesh->mNumVertices);
+	}
+
+	// the simplified levels are appended to indices, lods[i].firstIndex is relative to the mesh until the upload
+	size_t fullSize = indices.size();
+	context.lodCount = 1;
+	if (lodLevels > 1 && triangleMesh) {
+		std::vector<glm::vec3> positions(mesh->mNumVertices);
+		for (unsigned int i = 0; i < mesh->mNumVertices; i++)
+			positions[i] = glm::vec3(mesh->mVertices[i].x, mesh->mVertices[i].y, mesh->mVertices[i].z);
+		float diameter = glm::length(packed.boundsMax - packed.boundsMin);
+
+		std::vector<unsigned int> previous(indices), simplified;
+		float error = 0.0f;
+		for (int level = 1; level < lodLevels; level++) {
+			size_t target = previous.size() / 6 * 3;
+			error = std::max(error, simplifyMesh(positions, previous, target, diameter * LOD_MAX_ERRORS[level], simplified));
+			if (simplified.empty() || simplified.size() > previous.size() * (1.0f - LOD_MIN_REDUCTION))
+				break;
+			if (optimize)
+				optimizeVertexCache(simplified.data(), simplified.size(), mesh->mNumVertices);
+			RenderContext::LodRange& range = context.lods[level];
+			range.firstIndex = indices.size();
+			range.size = simplified.size();
+			range.error = error;
+			indices.insert(indices.end(), simplified.begin(), simplified.end());
+			lodTriangles += simplified.size() / 3;
+			context.lodCount = level + 1;
+			previous.swap(simplified);
+		}
+	}
+	triangles += fullSize / 3;
+
+	// vertices in the order the full mesh and then the levels use them, unused ones are dropped
+	size_t vertexCount = mesh->mNumVertices;
+	if (optimize) {
+		std::vector<unsigned int> remap;
+		vertexCount = optimizeVertexFetch(indices.data(), indices.size(), mesh->mNumVertices, remap);
+		std::vector<char> data(vertexCount * packed.stride);
+		for (unsigned int i = 0; i < mesh->mNumVertices; i++)
+			if (remap[i] != ~0u)
+				std::copy(&packed.data[i * packed.stride], &packed.data[(i + 1) * packed.stride], &data[remap[i] * packed.stride]);
+		packed.data.swap(data);
+		cacheAfter.add(analyzeVertexCache(indices.data(), fullSize, vertexCount));
+	}
+
+	Page& page = pageFor(vertexCount, indices.size());
+
+	// upload through the copy target so that no vertex array state is touched
+	glBindBuffer(GL_COPY_WRITE_BUFFER, page.vertexBuffer);
+	glBufferSubData(GL_COPY_WRITE_BUFFER, page.vertexCount * packed.stride, packed.data.size(), packed.data.data());
+	glBindBuffer(GL_COPY_WRITE_BUFFER, page.indexBuffer);
+	glBufferSubData(GL_COPY_WRITE_BUFFER, page.indexCount * sizeof(unsigned int), indices.size() * sizeof(unsigned int), indices.data());
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+	context.vertexArray = page.vertexArray;
+	context.vertexBuffer = page.vertexBuffer;
+	context.vertexIndexBuffer = page.indexBuffer;
+	context.vertexFormat = vertexFormat;
+	context.positionDequantization = packed.positionDequantization;
+	context.boundsMin = packed.boundsMin;
+	context.boundsMax = packed.boundsMax;
+	context.indexType = GL_UNSIGNED_INT;
+	context.firstIndex = page.indexCount;
+	context.baseVertex = page.vertexCount;
+	context.size = fullSize;
+	for (int level = 1; level < context.lodCount; level++)
+		context.lods[level].firstIndex += page.indexCount;
+
+	page.vertexCount += vertexCount;
+	page.indexCount += indices.size();
+	meshes++;
+}
+
+size_t Core::GeometryPool::usedBytes() const
+{
+	size_t bytes = 0;
+	for (auto& page : pagesVector)
+		bytes += page.vertexCount * vertexStride(vertexFormat) + page.indexCount * sizeof(unsigned int);
+	return bytes;
+}
+
+void Core::GeometryPool::destroy()
+{
+	for (auto& page : pagesVector) {
+		glDeleteVertexArrays(1, &page.vertexArray);
+		glDeleteBuffers(1, &page.vertexBuffer);
+		glDeleteBuffers(1, &page.indexBuffer);
+	}
+	pagesVector.clear();
+	meshes = 0;
+	triangles = 0;
+	lodTriangles = 0;
+	cacheBefore = VertexCacheStats();
+	cacheAfter = VertexCacheStats();
+}
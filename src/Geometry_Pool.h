@@ -0,0 +1,69 @@
+#pragma once
+#include "Render_Utils.h"
+#include "Mesh_Optimize.h"
+#include <vector>
+
+namespace Core
+{
+	// Suballocates meshes into a few large vertex/index buffers that share one vertex format
+	// and one vertex array per page. A mesh added to the pool becomes a RenderContext that is
+	// only a (baseVertex, firstIndex, size) range inside its page, so consecutive draws from the
+	// same page need no glBindVertexArray and can be batched with multi-draw calls.
+	class GeometryPool
+	{
+	public:
+		struct Page {
+			GLuint vertexArray = 0;
+			GLuint vertexBuffer = 0;
+			GLuint indexBuffer = 0;
+			size_t vertexCapacity = 0;
+			size_t indexCapacity = 0;
+			size_t vertexCount = 0;
+			size_t indexCount = 0;
+		};
+
+		// Planar is not supported by the pool, it falls back to Interleaved.
+		// A new page is opened whenever a mesh does not fit into the current one.
+		void init(VertexFormat format, size_t verticesPerPage = 1 << 20, size_t indicesPerPage = 1 << 22);
+
+		// Meshes added later get their triangles reordered for the vertex cache and for overdraw
+		// and their vertices for fetch locality (see Mesh_Optimize.h). Off by default.
+		void setOptimizeMeshes(bool optimize);
+
+		// Meshes added later get up to levels - 1 simplified versions (see simplifyMesh), stored after
+		// the full index list in the same page. 1 (the default) keeps only the full mesh.
+		void setLodLevels(int levels);
+
+		// packs the mesh into the pool and fills context with its range and levels of detail
+		void add(aiMesh* mesh, RenderContext& context);
+
+		void destroy();
+
+		VertexFormat format() const { return vertexFormat; }
+		const std::vector<Page>& pages() const { return pagesVector; }
+		int meshCount() const { return meshes; }
+		// triangles of all meshes at full detail and of all their simplified levels
+		size_t triangleCount() const { return triangles; }
+		size_t lodTriangleCount() const { return lodTriangles; }
+		// vertex cache efficiency of the full detail meshes added with setOptimizeMeshes(true), in file order and optimized
+		const VertexCacheStats& vertexCacheBefore() const { return cacheBefore; }
+		const VertexCacheStats& vertexCacheAfter() const { return cacheAfter; }
+		// bytes of vertex and index data in use, without the unused page capacity
+		size_t usedBytes() const;
+
+	private:
+		Page& pageFor(size_t vertexCount, size_t indexCount);
+
+		VertexFormat vertexFormat = VertexFormat::Interleaved;
+		size_t pageVertices = 0;
+		size_t pageIndices = 0;
+		int meshes = 0;
+		int lodLevels = 1;
+		bool optimizeMeshes = false;
+		VertexCacheStats cacheBefore;
+		VertexCacheStats cacheAfter;
+		size_t triangles = 0;
+		size_t lodTriangles = 0;
+		std::vector<Page> pagesVector;
+	};
+}
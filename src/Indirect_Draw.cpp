@@ -0,0 +1,186 @@
+#include "Indirect_Draw.h"
+#include "Frustum.h"
+#include "Material_Table.h"
+
+#include <algorithm>
+#include <set>
+#include <tuple>
+
+bool Core::IndirectDrawList::isSupported()
+{
+	return GLEW_VERSION_4_3 != 0;
+}
+
+int Core::IndirectDrawList::add(const RenderContext& context)
+{
+	contexts.push_back(context);
+	return contexts.size() - 1;
+}
+
+void Core::IndirectDrawList::build(const MaterialTable* materials)
+{
+	// program, then the material group or (outside the table) the material, then the vertex array
+	auto batchKey = [materials](const RenderContext& context) {
+		GLuint program = context.material ? context.material->program : 0;
+		bool grouped = materials && context.material && materials->contains(context.material);
+		uintptr_t material = grouped ? (uintptr_t)materials->group(context.material) : (uintptr_t)context.material;
+		return std::make_tuple(program, grouped, material, context.vertexArray);
+	};
+
+	std::vector<int> order(contexts.size());
+	for (size_t i = 0; i < order.size(); i++)
+		order[i] = i;
+	std::stable_sort(order.begin(), order.end(), [this, &batchKey](int a, int b) {
+		return batchKey(contexts[a]) < batchKey(contexts[b]);
+	});
+
+	slots.assign(contexts.size(), 0);
+	commands.resize(contexts.size());
+	drawData.resize(contexts.size());
+	bounds.resize(contexts.size());
+	batches.clear();
+	for (size_t i = 0; i < order.size(); i++) {
+		const RenderContext& context = contexts[order[i]];
+		slots[order[i]] = i;
+
+		DrawElementsIndirectCommand& command = commands[i];
+		command.count = context.size;
+		command.instanceCount = 1;
+		command.firstIndex = context.firstIndex;
+		command.baseVertex = context.baseVertex;
+		command.baseInstance = i;
+
+		IndirectDrawData& data = drawData[i];
+		data.modelMatrix = context.positionDequantization;
+		data.packedNormals = context.vertexFormat == VertexFormat::Quantized;
+		data.materialIndex = materials && context.material && materials->contains(context.material) ? materials->index(context.material) : 0;
+		bounds[i].center = glm::vec4((context.boundsMin + context.boundsMax) * 0.5f, 1.0f);
+		bounds[i].extent = glm::vec4((context.boundsMax - context.boundsMin) * 0.5f, 0.0f);
+
+		if (batches.empty() || batchKey(contexts[order[i - 1]]) != batchKey(context))
+			batches.push_back(Batch{ context.material, context.vertexArray, (int)i, 0 });
+		batches.back().commandCount++;
+	}
+
+	// drawIndex = baseInstance + instance, so a buffer of 0, 1, 2, ... yields the index of the draw
+	std::vector<GLuint> drawIndices(contexts.size());
+	for (size_t i = 0; i < drawIndices.size(); i++)
+		drawIndices[i] = i;
+	glGenBuffers(1, &drawIndexBuffer);
+	glBindBuffer(GL_ARRAY_BUFFER, drawIndexBuffer);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(GLuint) * drawIndices.size(), drawIndices.data(), GL_STATIC_DRAW);
+
+	std::set<GLuint> vertexArrays;
+	for (auto& batch : batches)
+		vertexArrays.insert(batch.vertexArray);
+	for (GLuint vertexArray : vertexArrays) {
+		glBindVertexArray(vertexArray);
+		glEnableVertexAttribArray(5);
+		glVertexAttribIPointer(5, 1, GL_UNSIGNED_INT, 0, (void*)0);
+		glVertexAttribDivisor(5, 1);
+	}
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	glGenBuffers(1, &commandBuffer);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+	glBufferData(GL_DRAW_INDIRECT_BUFFER, sizeof(DrawElementsIndirectCommand) * commands.size(), NULL, GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+	glGenBuffers(1, &drawDataBuffer);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, drawDataBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(IndirectDrawData) * drawData.size(), NULL, GL_DYNAMIC_DRAW);
+
+	glGenBuffers(1, &boundsBuffer);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, boundsBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(IndirectDrawBounds) * bounds.size(), NULL, GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+void Core::IndirectDrawList::setModelMatrix(int draw, const glm::mat4& modelMatrix)
+{
+	const RenderContext& context = contexts[draw];
+	int slot = slots[draw];
+	drawData[slot].modelMatrix = modelMatrix * context.positionDequantization;
+	glm::vec3 center, extent;
+	transformBounds(modelMatrix, context.boundsMin, context.boundsMax, center, extent);
+	bounds[slot].center = glm::vec4(center, 1.0f);
+	bounds[slot].extent = glm::vec4(extent, 0.0f);
+}
+
+void Core::IndirectDrawList::setVisible(int draw, bool visible)
+{
+	commands[slots[draw]].instanceCount = visible ? 1 : 0;
+}
+
+void Core::IndirectDrawList::setLod(int draw, int level)
+{
+	const RenderContext& context = contexts[draw];
+	DrawElementsIndirectCommand& command = commands[slots[draw]];
+	command.firstIndex = context.lodFirstIndex(level);
+	command.count = context.lodSize(level);
+}
+
+void Core::IndirectDrawList::draw(const std::function<void(Material*)>& useMaterial)
+{
+	upload();
+	drawBatches(useMaterial, commandBuffer);
+}
+
+void Core::IndirectDrawList::upload()
+{
+	if (commands.empty())
+		return;
+
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+	glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, sizeof(DrawElementsIndirectCommand) * commands.size(), commands.data());
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, boundsBuffer);
+	glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(IndirectDrawBounds) * bounds.size(), bounds.data());
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, drawDataBuffer);
+	glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(IndirectDrawData) * drawData.size(), drawData.data());
+}
+
+void Core::IndirectDrawList::drawBatches(const std::function<void(Material*)>& useMaterial, GLuint commandSource, GLuint countSource)
+{
+	if (commands.empty())
+		return;
+
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandSource);
+	if (countSource)
+		glBindBuffer(GL_PARAMETER_BUFFER_ARB, countSource);
+	GLuint boundVertexArray = 0;
+	for (auto& batch : batches) {
+		if (!batch.material)
+			continue;
+		useMaterial(batch.material);
+		if (batch.vertexArray != boundVertexArray) {
+			glBindVertexArray(batch.vertexArray);
+			boundVertexArray = batch.vertexArray;
+		}
+		void* firstCommand = (void*)(batch.firstCommand * sizeof(DrawElementsIndirectCommand));
+		if (countSource)
+			glMultiDrawElementsIndirectCountARB(GL_TRIANGLES, GL_UNSIGNED_INT, firstCommand, (GLintptr)((&batch - batches.data()) * sizeof(GLuint)), batch.commandCount, 0);
+		else
+			glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, firstCommand, batch.commandCount, 0);
+	}
+	glBindVertexArray(0);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+	if (countSource)
+		glBindBuffer(GL_PARAMETER_BUFFER_ARB, 0);
+}
+
+void Core::IndirectDrawList::destroy()
+{
+	glDeleteBuffers(1, &commandBuffer);
+	glDeleteBuffers(1, &drawDataBuffer);
+	glDeleteBuffers(1, &drawIndexBuffer);
+	glDeleteBuffers(1, &boundsBuffer);
+	commandBuffer = drawDataBuffer = drawIndexBuffer = boundsBuffer = 0;
+	contexts.clear();
+	slots.clear();
+	commands.clear();
+	drawData.clear();
+	bounds.clear();
+	batches.clear();
+}
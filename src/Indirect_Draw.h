@@ -0,0 +1,102 @@
+#pragma once
+#include "Render_Utils.h"
+#include <functional>
+#include <vector>
+
+namespace Core
+{
+	class MaterialTable;
+
+	// layout defined by glMultiDrawElementsIndirect
+	struct DrawElementsIndirectCommand {
+		GLuint count;
+		GLuint instanceCount;
+		GLuint firstIndex;
+		GLint baseVertex;
+		GLuint baseInstance;
+	};
+
+	// per-draw data read by the *_mdi.vert shaders (std430, binding 0)
+	struct IndirectDrawData {
+		glm::mat4 modelMatrix;
+		GLuint packedNormals;
+		// entry of the material buffer, see Material_Table.h
+		GLuint materialIndex;
+		GLuint padding[2];
+	};
+
+	// world space box of a draw read by occlusion_cull.comp (std430, binding 2)
+	struct IndirectDrawBounds {
+		glm::vec4 center;
+		glm::vec4 extent;
+	};
+
+	// Draw list for pooled RenderContexts (see Geometry_Pool.h) submitted with glMultiDrawElementsIndirect.
+	// Draws are grouped into batches of the same material and vertex array, each batch is one multi-draw.
+	// Materials of a MaterialTable are grouped by their texture arrays instead, so one batch spans
+	// all materials of a group and useMaterial gets the first of them.
+	// The shaders find their IndirectDrawData through the drawIndex attribute (location 5), an
+	// instanced attribute that the command's baseInstance offsets to the index of the draw.
+	// Requires OpenGL 4.3 (multi-draw indirect and shader storage buffers), see isSupported().
+	class IndirectDrawList
+	{
+	public:
+		// draws [firstCommand, firstCommand + commandCount) of the command list share a material (or
+		// material group) and vertex array
+		struct Batch {
+			Material* material;
+			GLuint vertexArray;
+			int firstCommand;
+			int commandCount;
+		};
+
+		static bool isSupported();
+
+		// adds a draw before build(), returns a handle for setModelMatrix/setVisible/setLod
+		int add(const RenderContext& context);
+
+		// sorts the draws into batches and creates the GL buffers; materials must be built already
+		void build(const MaterialTable* materials = nullptr);
+
+		// also moves the world space bounds of the draw
+		void setModelMatrix(int draw, const glm::mat4& modelMatrix);
+		void setVisible(int draw, bool visible);
+		// draws the given level of detail of the context (see RenderContext::lods)
+		void setLod(int draw, int level);
+
+		// upload() and drawBatches() with the uploaded commands
+		void draw(const std::function<void(Material*)>& useMaterial);
+
+		// uploads commands, draw data and bounds, binds the draw data to binding 0
+		void upload();
+		// issues one multi-draw per batch from commandSource (laid out like the command list) after
+		// calling useMaterial, which binds the program and the textures of the batch. With a
+		// countSource (ARB_indirect_parameters) batch b draws only as many commands as its b-th GLuint says.
+		void drawBatches(const std::function<void(Material*)>& useMaterial, GLuint commandSource, GLuint countSource = 0);
+
+		void destroy();
+
+		int drawCount() const { return contexts.size(); }
+		// glMultiDrawElementsIndirect calls issued by draw()
+		int batchCount() const { return batches.size(); }
+		const Batch& batch(int index) const { return batches[index]; }
+
+		// buffers holding the command list and the bounds (indexed like the commands) after upload()
+		GLuint commandBufferId() const { return commandBuffer; }
+		GLuint boundsBufferId() const { return boundsBuffer; }
+
+	private:
+		std::vector<RenderContext> contexts;
+		// handle -> position in commands/drawData
+		std::vector<int> slots;
+		std::vector<DrawElementsIndirectCommand> commands;
+		std::vector<IndirectDrawData> drawData;
+		std::vector<IndirectDrawBounds> bounds;
+		std::vector<Batch> batches;
+
+		GLuint commandBuffer = 0;
+		GLuint drawDataBuffer = 0;
+		GLuint drawIndexBuffer = 0;
+		GLuint boundsBuffer = 0;
+	};
+}
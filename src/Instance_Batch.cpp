@@ -0,0 +1,72 @@
+#include "Instance_Batch.h"
+#include "Vertex_Format.h"
+
+void Core::InstanceBatch::init(int capacity)
+{
+	matrices.clear();
+	matrices.reserve(capacity);
+	ids.clear();
+	ids.reserve(capacity);
+	position.assign(capacity, -1);
+	uploadCount = 0;
+
+	glGenBuffers(1, &buffer);
+	glBindBuffer(GL_ARRAY_BUFFER, buffer);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(glm::mat4) * capacity, NULL, GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void Core::InstanceBatch::destroy()
+{
+	glDeleteBuffers(1, &buffer);
+	buffer = 0;
+	matrices.clear();
+	ids.clear();
+	position.clear();
+}
+
+void Core::InstanceBatch::add(int id, const glm::mat4& matrix)
+{
+	int index = position[id];
+	if (index < 0) {
+		index = matrices.size();
+		position[id] = index;
+		ids.push_back(id);
+		matrices.push_back(matrix);
+	} else {
+		matrices[index] = matrix;
+	}
+	write(index);
+}
+
+void Core::InstanceBatch::remove(int id)
+{
+	int index = position[id];
+	if (index < 0)
+		return;
+	int last = matrices.size() - 1;
+	if (index != last) {
+		matrices[index] = matrices[last];
+		ids[index] = ids[last];
+		position[ids[index]] = index;
+		write(index);
+	}
+	matrices.pop_back();
+	ids.pop_back();
+	position[id] = -1;
+}
+
+void Core::InstanceBatch::bindAttribute(int location) const
+{
+	glBindBuffer(GL_ARRAY_BUFFER, buffer);
+	setInstanceMatrixAttribute(location);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void Core::InstanceBatch::write(int index)
+{
+	glBindBuffer(GL_ARRAY_BUFFER, buffer);
+	glBufferSubData(GL_ARRAY_BUFFER, sizeof(glm::mat4) * index, sizeof(glm::mat4), &matrices[index]);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	uploadCount++;
+}
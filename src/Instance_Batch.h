@@ -0,0 +1,44 @@
+#pragma once
+#include "glew.h"
+#include "glm.hpp"
+#include <vector>
+
+namespace Core
+{
+	// Model matrices of instances that stay where they are for many frames (e.g. sleeping rigid
+	// bodies), kept in a GPU buffer between frames. add() and remove() write single matrices with
+	// glBufferSubData (remove moves the last instance into the hole), so the uploads follow the
+	// changes, not the number of instances. Draw the first size() instances with the buffer as an
+	// instanced mat4 attribute, see bindAttribute().
+	class InstanceBatch
+	{
+	public:
+		// ids are 0 ... capacity - 1
+		void init(int capacity);
+		void destroy();
+
+		// replaces the matrix of an instance already in the batch
+		void add(int id, const glm::mat4& matrix);
+		void remove(int id);
+		bool contains(int id) const { return id >= 0 && id < (int)position.size() && position[id] >= 0; }
+		int size() const { return ids.size(); }
+
+		// points the instanced mat4 attribute at location (and the next three) of the bound vertex
+		// array to the batch
+		void bindAttribute(int location) const;
+
+		// matrices written to the buffer since the last resetUploads()
+		int uploads() const { return uploadCount; }
+		void resetUploads() { uploadCount = 0; }
+
+	private:
+		void write(int index);
+
+		GLuint buffer = 0;
+		std::vector<glm::mat4> matrices;
+		// id of the instance at each index, and index of each id (-1 outside the batch)
+		std::vector<int> ids;
+		std::vector<int> position;
+		int uploadCount = 0;
+	};
+}
@@ -0,0 +1,141 @@
+#include "Job_System.h"
+
+#include <algorithm>
+#ifdef _WIN32
+#include <windows.h>
+#elif defined(__linux__)
+#include <pthread.h>
+#endif
+
+namespace
+{
+	// the pool and worker index of the current thread, so that jobs submitted by jobs stay local
+	thread_local const Core::JobSystem* currentSystem = nullptr;
+	thread_local int currentWorker = -1;
+
+	void setAffinity(std::thread& thread, uint64_t mask)
+	{
+		if (!mask)
+			return;
+#ifdef _WIN32
+		SetThreadAffinityMask(thread.native_handle(), (DWORD_PTR)mask);
+#elif defined(__linux__)
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		for (int cpu = 0; cpu < 64 && cpu < CPU_SETSIZE; cpu++) {
+			if (mask >> cpu & 1)
+				CPU_SET(cpu, &set);
+		}
+		pthread_setaffinity_np(thread.native_handle(), sizeof(set), &set);
+#endif
+	}
+}
+
+Core::JobSystem::JobSystem(int threadCount, const std::vector<uint64_t>& affinityMasks)
+{
+	if (threadCount <= 0)
+		threadCount = std::max(1, (int)std::thread::hardware_concurrency() - 1);
+	for (int i = 0; i < threadCount; i++)
+		workers.push_back(std::unique_ptr<Worker>(new Worker()));
+	// all deques exist before the first worker may steal
+	for (int i = 0; i < threadCount; i++) {
+		workers[i]->thread = std::thread(&JobSystem::work, this, i);
+		if (i < (int)affinityMasks.size())
+			setAffinity(workers[i]->thread, affinityMasks[i]);
+	}
+}
+
+Core::JobSystem::~JobSystem()
+{
+	wait();
+	{
+		std::lock_guard<std::mutex> lock(sleepMutex);
+		stopping = true;
+	}
+	wake.notify_all();
+	for (auto& worker : workers)
+		worker->thread.join();
+}
+
+void Core::JobSystem::submit(Job job)
+{
+	int index = currentSystem == this ? currentWorker : (int)(nextWorker++ % workers.size());
+	// counted before it is queued: another worker may take and finish it right away, and active
+	// must not reach 0 (and wake wait()) while the job submitting this one still runs
+	active++;
+	{
+		std::lock_guard<std::mutex> lock(workers[index]->mutex);
+		workers[index]->jobs.push_back(std::move(job));
+	}
+	queued++;
+	// a worker going to sleep counts itself before it checks queued, so either it sees this job
+	// or this sees it; the lock keeps the notify from landing between its check and its wait
+	if (sleepers > 0) {
+		std::lock_guard<std::mutex> lock(sleepMutex);
+		wake.notify_one();
+	}
+}
+
+void Core::JobSystem::wait()
+{
+	std::unique_lock<std::mutex> lock(sleepMutex);
+	idle.wait(lock, [this] { return active == 0; });
+}
+
+Core::JobSystem::Stats Core::JobSystem::stats() const
+{
+	Stats result;
+	result.executed = executed;
+	result.stolen = stolen;
+	return result;
+}
+
+bool Core::JobSystem::take(int index, Job& job)
+{
+	{
+		Worker& own = *workers[index];
+		std::lock_guard<std::mutex> lock(own.mutex);
+		if (!own.jobs.empty()) {
+			job = std::move(own.jobs.back());
+			own.jobs.pop_back();
+			return true;
+		}
+	}
+	for (size_t offset = 1; offset < workers.size(); offset++) {
+		Worker& victim = *workers[(index + offset) % workers.size()];
+		std::lock_guard<std::mutex> lock(victim.mutex);
+		if (!victim.jobs.empty()) {
+			job = std::move(victim.jobs.front());
+			victim.jobs.pop_front();
+			stolen++;
+			return true;
+		}
+	}
+	return false;
+}
+
+void Core::JobSystem::work(int index)
+{
+	currentSystem = this;
+	currentWorker = index;
+	for (;;) {
+		Job job;
+		if (take(index, job)) {
+			queued--;
+			job();
+			executed++;
+			if (--active == 0) {
+				std::lock_guard<std::mutex> lock(sleepMutex);
+				idle.notify_all();
+			}
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(sleepMutex);
+		sleepers++;
+		wake.wait(lock, [this] { return stopping || queued > 0; });
+		sleepers--;
+		if (stopping && queued <= 0)
+			return;
+	}
+}
@@ -0,0 +1,76 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace Core
+{
+	// Work-stealing thread pool. Every worker owns a deque of jobs: it pushes the jobs it submits
+	// and pops its next one at the back (the most recent, likely still in its cache), and when its
+	// deque is empty it steals from the front of the others'. Jobs submitted from other threads
+	// are dealt to the workers in turn.
+	class JobSystem
+	{
+	public:
+		typedef std::function<void()> Job;
+
+		struct Stats {
+			long long executed = 0;
+			// jobs run by another worker than the one they were queued on
+			long long stolen = 0;
+		};
+
+		// threadCount 0 - one thread per core but the one running the main thread; affinityMasks -
+		// optional CPU mask per worker (bit n - logical processor n), 0 leaves a worker unpinned
+		explicit JobSystem(int threadCount = 0, const std::vector<uint64_t>& affinityMasks = std::vector<uint64_t>());
+		// finishes the queued jobs first
+		~JobSystem();
+
+		JobSystem(const JobSystem&) = delete;
+		JobSystem& operator=(const JobSystem&) = delete;
+
+		int threadCount() const { return workers.size(); }
+
+		void submit(Job job);
+		// returns once no job is queued or running; not from inside a job
+		void wait();
+
+		Stats stats() const;
+
+	private:
+		struct Worker {
+			std::thread thread;
+			std::mutex mutex;
+			std::deque<Job> jobs;
+		};
+
+		void work(int index);
+		// the worker's own newest job, or one stolen from the oldest of another worker
+		bool take(int index, Job& job);
+
+		std::vector<std::unique_ptr<Worker>> workers;
+		std::atomic<unsigned> nextWorker{ 0 };
+
+		// queued counts the jobs in the deques, active also those running. Both are lock-free;
+		// sleepMutex is only taken to sleep and to wake sleepers or wait(). A job enters active
+		// before its deque and queued after it, so active never drops below the jobs still to run
+		// and queued may briefly go negative, which only sends a worker back to sleep
+		std::mutex sleepMutex;
+		std::condition_variable wake;
+		std::condition_variable idle;
+		std::atomic<int> queued{ 0 };
+		std::atomic<int> active{ 0 };
+		// workers waiting on wake; submit() skips the lock and the notify while there are none
+		std::atomic<int> sleepers{ 0 };
+		bool stopping = false;
+
+		std::atomic<long long> executed{ 0 };
+		std::atomic<long long> stolen{ 0 };
+	};
+}
@@ -0,0 +1,153 @@
+#include "Material_Table.h"
+#include "Shader_Loader.h"
+
+#include <iostream>
+
+bool Core::MaterialTable::isSupported()
+{
+	return GLEW_VERSION_4_3 != 0;
+}
+
+void Core::MaterialTable::add(Material* material)
+{
+	if (dynamic_cast<DiffuseMaterial*>(material) || dynamic_cast<DiffuseSpecularMaterial*>(material))
+		materials.push_back(material);
+}
+
+int Core::MaterialTable::addLayer(GLuint texture, int& arrayIndex)
+{
+	arrayIndex = -1;
+	auto found = textureLayers.find(texture);
+	if (found != textureLayers.end()) {
+		arrayIndex = found->second.first;
+		return found->second.second;
+	}
+
+	ImageInfo info;
+	TextureCache& cache = TextureCache::instance();
+	if (!texture || cache.state(texture) == TextureCache::State::Missing || !cache.imageInfo(texture, info))
+		return -1;
+	auto key = std::make_tuple(info.width, info.height, info.levels, info.internalFormat);
+	auto array = arrayIndices.find(key);
+	if (array == arrayIndices.end()) {
+		array = arrayIndices.insert(std::make_pair(key, (int)arrays.size())).first;
+		arrays.push_back(TextureArray{ info, 0, 0 });
+	}
+	arrayIndex = array->second;
+	int layer = arrays[arrayIndex].layers++;
+	textureLayers[texture] = std::make_pair(arrayIndex, layer);
+	pendingCopies.push_back(Copy{ texture, arrayIndex, layer });
+	return layer;
+}
+
+void Core::MaterialTable::build()
+{
+	std::map<std::pair<int, int>, int> groupIndices;
+	for (Material* material : materials) {
+		if (slots.count(material))
+			continue;
+		GLuint color = 0, specular = 0;
+		if (auto diffuse = dynamic_cast<DiffuseMaterial*>(material)) {
+			color = diffuse->texture;
+		}
+		else {
+			auto diffuseSpecular = static_cast<DiffuseSpecularMaterial*>(material);
+			color = diffuseSpecular->texture;
+			specular = diffuseSpecular->textureSpecular;
+		}
+
+		// a missing texture samples black, as texture 0 does on the other paths
+		MaterialLayers entry;
+		int colorArray, specularArray;
+		entry.colorLayer = addLayer(color, colorArray);
+		entry.specularLayer = addLayer(specular, specularArray);
+
+		auto groupKey = std::make_pair(colorArray, specularArray);
+		auto group = groupIndices.find(groupKey);
+		if (group == groupIndices.end()) {
+			group = groupIndices.insert(std::make_pair(groupKey, (int)groups.size())).first;
+			groups.push_back(groupKey);
+		}
+		slots[material] = Slot{ (int)layers.size(), group->second };
+		layers.push_back(entry);
+	}
+
+	bool clear = GLEW_VERSION_4_4 || GLEW_ARB_clear_texture;
+	for (auto& array : arrays) {
+		glGenTextures(1, &array.texture);
+		glBindTexture(GL_TEXTURE_2D_ARRAY, array.texture);
+		glTexStorage3D(GL_TEXTURE_2D_ARRAY, array.info.levels, array.info.internalFormat, array.info.width, array.info.height, array.layers);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		// mid grey like the placeholders until the layers are copied, compressed arrays cannot be cleared
+		static const unsigned char grey[4] = { 128, 128, 128, 255 };
+		if (clear && array.info.internalFormat == PixelUploader::internalFormat(4)) {
+			for (int level = 0; level < array.info.levels; level++)
+				glClearTexImage(array.texture, level, GL_RGBA, GL_UNSIGNED_BYTE, grey);
+		}
+	}
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+	glGenBuffers(1, &materialBuffer);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, materialBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(MaterialLayers) * std::max<size_t>(1, layers.size()), layers.data(), GL_STATIC_DRAW);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	update();
+}
+
+void Core::MaterialTable::update()
+{
+	TextureCache& cache = TextureCache::instance();
+	for (size_t i = 0; i < pendingCopies.size();) {
+		const Copy& copy = pendingCopies[i];
+		TextureCache::State state = cache.state(copy.source);
+		if (state == TextureCache::State::Pending) {
+			i++;
+			continue;
+		}
+		if (state == TextureCache::State::Loaded) {
+			const ImageInfo& info = arrays[copy.array].info;
+			for (int level = 0; level < info.levels; level++) {
+				glCopyImageSubData(copy.source, GL_TEXTURE_2D, level, 0, 0, 0,
+					arrays[copy.array].texture, GL_TEXTURE_2D_ARRAY, level, 0, 0, copy.layer,
+					std::max(1, info.width >> level), std::max(1, info.height >> level), 1);
+			}
+		}
+		else {
+			std::cout << "material table: texture " << copy.source << " failed to load, its layer stays empty" << std::endl;
+		}
+		pendingCopies[i] = pendingCopies.back();
+		pendingCopies.pop_back();
+	}
+}
+
+void Core::MaterialTable::bind(const Material* material, GLuint program)
+{
+	const std::pair<int, int>& group = groups[slots.at(material).group];
+	SetSamplerUnit(program, "color_textures", 0);
+	SetSamplerUnit(program, "specular_textures", 1);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, group.first >= 0 ? arrays[group.first].texture : 0);
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, group.second >= 0 ? arrays[group.second].texture : 0);
+	glActiveTexture(GL_TEXTURE0);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, MATERIAL_BINDING, materialBuffer);
+}
+
+void Core::MaterialTable::destroy()
+{
+	for (auto& array : arrays)
+		glDeleteTextures(1, &array.texture);
+	glDeleteBuffers(1, &materialBuffer);
+	materialBuffer = 0;
+	materials.clear();
+	slots.clear();
+	layers.clear();
+	groups.clear();
+	arrays.clear();
+	arrayIndices.clear();
+	textureLayers.clear();
+	pendingCopies.clear();
+}
@@ -0,0 +1,87 @@
+#pragma once
+#include "Render_Utils.h"
+#include <map>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+
+namespace Core
+{
+	// entry of the material buffer read by the *_array.frag shaders (std430, binding MATERIAL_BINDING)
+	struct MaterialLayers {
+		GLint colorLayer;
+		GLint specularLayer;
+	};
+	const GLuint MATERIAL_BINDING = 1;
+
+	// Copies the textures of DiffuseMaterials and DiffuseSpecularMaterials into GL_TEXTURE_2D_ARRAY
+	// layers, one array per size and format, and uploads the layers of every material into a
+	// shader storage buffer indexed by IndirectDrawData::materialIndex. Materials whose textures
+	// are in the same arrays form a group: binding the arrays of a group once serves all its
+	// materials, so a multi-draw no longer ends where the material changes.
+	// The arrays are allocated from the image sizes in build(); the textures are copied into
+	// their layers by update() once the TextureCache has uploaded them. The 2D textures stay,
+	// the other render paths still sample them.
+	// Requires OpenGL 4.3 (glCopyImageSubData, shader storage buffers), see isSupported().
+	class MaterialTable
+	{
+	public:
+		static bool isSupported();
+
+		// before build(); materials of other types and without loaded textures stay outside the table
+		void add(Material* material);
+		void build();
+		// copies the textures that finished loading since the last call, call once per frame
+		void update();
+
+		bool contains(const Material* material) const { return slots.count(material) != 0; }
+		// index of the material in the material buffer
+		int index(const Material* material) const { return slots.at(material).index; }
+		// materials of a group bind the same arrays
+		int group(const Material* material) const { return slots.at(material).group; }
+
+		// binds the arrays of the group to units 0 (color_textures) and 1 (specular_textures) of
+		// the current program and the material buffer to MATERIAL_BINDING
+		void bind(const Material* material, GLuint program);
+
+		int materialCount() const { return layers.size(); }
+		int groupCount() const { return groups.size(); }
+		int arrayCount() const { return arrays.size(); }
+		// layers still waiting for their texture
+		int pendingLayers() const { return pendingCopies.size(); }
+
+		void destroy();
+
+	private:
+		struct TextureArray {
+			ImageInfo info;
+			GLuint texture;
+			int layers;
+		};
+		struct Slot {
+			int index;
+			int group;
+		};
+		struct Copy {
+			GLuint source;
+			int array;
+			int layer;
+		};
+
+		// layer of texture in the array of its size and format, -1 for textures without an image
+		int addLayer(GLuint texture, int& arrayIndex);
+
+		std::vector<Material*> materials;
+		std::unordered_map<const Material*, Slot> slots;
+		std::vector<MaterialLayers> layers;
+		// color array and specular array (-1 if none) of each group
+		std::vector<std::pair<int, int>> groups;
+		std::vector<TextureArray> arrays;
+		// (width, height, levels, format) -> index in arrays
+		std::map<std::tuple<int, int, int, GLenum>, int> arrayIndices;
+		// texture -> its layer, a texture shared by several materials is copied once
+		std::unordered_map<GLuint, std::pair<int, int>> textureLayers;
+		std::vector<Copy> pendingCopies;
+		GLuint materialBuffer = 0;
+	};
+}
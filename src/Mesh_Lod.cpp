@@ -0,0 +1,270 @@
+#include "Mesh_Lod.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+namespace
+{
+	// Sum of squared distances to a set of planes, error(p) = p'Ap + 2b'p + c. Every plane is
+	// weighted by the area of its triangle and the weights are summed, so error / weight is the
+	// mean squared distance. Doubles because the terms cancel out for points near the planes.
+	struct Quadric
+	{
+		double a00 = 0, a01 = 0, a02 = 0, a11 = 0, a12 = 0, a22 = 0;
+		double b0 = 0, b1 = 0, b2 = 0;
+		double c = 0;
+		double weight = 0;
+
+		// unit normal n and distance d of the plane n.p + d = 0
+		void addPlane(double nx, double ny, double nz, double d, double w)
+		{
+			a00 += w * nx * nx; a01 += w * nx * ny; a02 += w * nx * nz;
+			a11 += w * ny * ny; a12 += w * ny * nz; a22 += w * nz * nz;
+			b0 += w * nx * d; b1 += w * ny * d; b2 += w * nz * d;
+			c += w * d * d;
+			weight += w;
+		}
+
+		void add(const Quadric& q)
+		{
+			a00 += q.a00; a01 += q.a01; a02 += q.a02; a11 += q.a11; a12 += q.a12; a22 += q.a22;
+			b0 += q.b0; b1 += q.b1; b2 += q.b2;
+			c += q.c;
+			weight += q.weight;
+		}
+
+		// root mean square distance of p to the planes
+		float distance(const glm::vec3& p) const
+		{
+			double x = p.x, y = p.y, z = p.z;
+			double e = a00 * x * x + a11 * y * y + a22 * z * z + 2 * (a01 * x * y + a02 * x * z + a12 * y * z)
+				+ 2 * (b0 * x + b1 * y + b2 * z) + c;
+			return weight > 0 && e > 0 ? (float)sqrt(e / weight) : 0.0f;
+		}
+	};
+
+	struct Collapse
+	{
+		float cost;
+		// position groups, see simplifyMesh
+		unsigned int from;
+		unsigned int to;
+
+		bool operator<(const Collapse& other) const { return cost < other.cost; }
+	};
+
+	glm::vec3 triangleNormal(const glm::vec3& a, const glm::vec3& b, const glm::vec3& c)
+	{
+		return glm::cross(b - a, c - a);
+	}
+}
+
+// Half-edge collapses in passes: every pass sorts the possible collapses of all edges by their
+// quadric error and does the cheapest ones that do not touch each other's neighbourhood.
+// Collapses work on position groups (the vertices welded by position) and move every vertex of
+// the removed group onto a vertex of the kept group it shares a triangle with (the same side of
+// an attribute seam), which is why only the index list changes.
+float Core::simplifyMesh(const std::vector<glm::vec3>& positions, const std::vector<unsigned int>& indices,
+	size_t targetIndexCount, float maxError, std::vector<unsigned int>& result)
+{
+	size_t vertexCount = positions.size();
+
+	// weld by position
+	std::vector<unsigned int> order(vertexCount);
+	for (size_t i = 0; i < vertexCount; i++)
+		order[i] = (unsigned int)i;
+	std::sort(order.begin(), order.end(), [&](unsigned int a, unsigned int b) {
+		const glm::vec3& pa = positions[a];
+		const glm::vec3& pb = positions[b];
+		return pa.x != pb.x ? pa.x < pb.x : pa.y != pb.y ? pa.y < pb.y : pa.z < pb.z;
+	});
+	std::vector<unsigned int> vertexGroup(vertexCount);
+	std::vector<unsigned int> groupOffsets;
+	for (size_t i = 0; i < vertexCount; i++) {
+		if (i == 0 || positions[order[i]] != positions[order[i - 1]])
+			groupOffsets.push_back((unsigned int)i);
+		vertexGroup[order[i]] = (unsigned int)groupOffsets.size() - 1;
+	}
+	size_t groupCount = groupOffsets.size();
+	groupOffsets.push_back((unsigned int)vertexCount);
+	// members of group g are order[groupOffsets[g]] .. order[groupOffsets[g + 1] - 1]
+	auto groupPosition = [&](unsigned int group) -> const glm::vec3& { return positions[order[groupOffsets[group]]]; };
+
+	// triangles that are already degenerate after welding are dropped
+	result.clear();
+	result.reserve(indices.size());
+	for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+		unsigned int g0 = vertexGroup[indices[i]], g1 = vertexGroup[indices[i + 1]], g2 = vertexGroup[indices[i + 2]];
+		if (g0 != g1 && g1 != g2 && g0 != g2)
+			result.insert(result.end(), indices.begin() + i, indices.begin() + i + 3);
+	}
+
+	// quadrics of the original faces, and open (or non-manifold) edges whose vertices are locked
+	std::vector<Quadric> quadrics(groupCount);
+	std::vector<uint64_t> edges;
+	edges.reserve(result.size());
+	for (size_t i = 0; i < result.size(); i += 3) {
+		unsigned int g[3] = { vertexGroup[result[i]], vertexGroup[result[i + 1]], vertexGroup[result[i + 2]] };
+		glm::vec3 normal = triangleNormal(groupPosition(g[0]), groupPosition(g[1]), groupPosition(g[2]));
+		float length = glm::length(normal);
+		if (length > 0.0f) {
+			normal /= length;
+			double d = -glm::dot(normal, groupPosition(g[0]));
+			for (int k = 0; k < 3; k++)
+				quadrics[g[k]].addPlane(normal.x, normal.y, normal.z, d, length * 0.5);
+		}
+		for (int k = 0; k < 3; k++) {
+			uint64_t a = g[k], b = g[(k + 1) % 3];
+			edges.push_back(a < b ? a << 32 | b : b << 32 | a);
+		}
+	}
+	std::sort(edges.begin(), edges.end());
+	std::vector<unsigned char> locked(groupCount, 0);
+	for (size_t i = 0; i < edges.size();) {
+		size_t j = i + 1;
+		while (j < edges.size() && edges[j] == edges[i])
+			j++;
+		if (j - i != 2) {
+			locked[edges[i] >> 32] = 1;
+			locked[edges[i] & 0xffffffff] = 1;
+		}
+		i = j;
+	}
+
+	float reachedError = 0.0f;
+	size_t triangleCount = result.size() / 3;
+	size_t targetTriangles = targetIndexCount / 3;
+
+	std::vector<unsigned int> triangleOffsets(groupCount + 1);
+	std::vector<unsigned int> groupTriangles;
+	std::vector<Collapse> collapses;
+	std::vector<unsigned char> touched(groupCount);
+	std::vector<unsigned int> vertexRemap(vertexCount);
+	std::vector<unsigned int> targets;
+
+	while (triangleCount > targetTriangles) {
+		// triangles around every group
+		std::fill(triangleOffsets.begin(), triangleOffsets.end(), 0);
+		for (size_t i = 0; i < result.size(); i++)
+			triangleOffsets[vertexGroup[result[i]] + 1]++;
+		for (size_t g = 0; g < groupCount; g++)
+			triangleOffsets[g + 1] += triangleOffsets[g];
+		groupTriangles.resize(result.size());
+		{
+			std::vector<unsigned int> fill(triangleOffsets.begin(), triangleOffsets.end() - 1);
+			for (size_t i = 0; i < result.size(); i++)
+				groupTriangles[fill[vertexGroup[result[i]]]++] = (unsigned int)(i / 3);
+		}
+
+		collapses.clear();
+		for (size_t i = 0; i < result.size(); i += 3) {
+			for (int k = 0; k < 3; k++) {
+				unsigned int a = vertexGroup[result[i + k]];
+				unsigned int b = vertexGroup[result[i + (k + 1) % 3]];
+				if (!locked[a])
+					collapses.push_back({ quadrics[a].distance(groupPosition(b)), a, b });
+				if (!locked[b])
+					collapses.push_back({ quadrics[b].distance(groupPosition(a)), b, a });
+			}
+		}
+		std::sort(collapses.begin(), collapses.end());
+
+		std::fill(touched.begin(), touched.end(), 0);
+		for (size_t i = 0; i < vertexCount; i++)
+			vertexRemap[i] = (unsigned int)i;
+
+		size_t collapsed = 0;
+		for (const Collapse& collapse : collapses) {
+			if (collapse.cost > maxError || triangleCount <= targetTriangles)
+				break;
+			unsigned int from = collapse.from, to = collapse.to;
+			if (touched[from] || touched[to])
+				continue;
+
+			unsigned int firstMember = groupOffsets[from], lastMember = groupOffsets[from + 1];
+			targets.assign(lastMember - firstMember, ~0u);
+			bool valid = true;
+			size_t removed = 0;
+			const glm::vec3& target = groupPosition(to);
+			for (unsigned int t = triangleOffsets[from]; t < triangleOffsets[from + 1] && valid; t++) {
+				const unsigned int* triangle = &result[groupTriangles[t] * 3];
+				int corner = vertexGroup[triangle[0]] == from ? 0 : vertexGroup[triangle[1]] == from ? 1 : 2;
+				int shared = -1;
+				for (int k = 0; k < 3; k++)
+					if (vertexGroup[triangle[k]] == to)
+						shared = k;
+
+				if (shared >= 0) {
+					// the triangle disappears, its other vertex of the kept group is where this wedge goes
+					removed++;
+					unsigned int member = (unsigned int)(std::find(order.begin() + firstMember, order.begin() + lastMember, triangle[corner]) - order.begin());
+					targets[member - firstMember] = triangle[shared];
+				}
+				else {
+					// the triangle stays, it must not flip or become a sliver
+					glm::vec3 p[3] = { groupPosition(vertexGroup[triangle[0]]), groupPosition(vertexGroup[triangle[1]]), groupPosition(vertexGroup[triangle[2]]) };
+					glm::vec3 before = triangleNormal(p[0], p[1], p[2]);
+					p[corner] = target;
+					glm::vec3 after = triangleNormal(p[0], p[1], p[2]);
+					valid = glm::dot(before, after) > 0.25f * glm::length(before) * glm::length(after);
+				}
+			}
+			// every wedge in use needs a wedge of the kept group on the same side of a seam
+			for (unsigned int t = triangleOffsets[from]; t < triangleOffsets[from + 1] && valid; t++) {
+				const unsigned int* triangle = &result[groupTriangles[t] * 3];
+				for (int k = 0; k < 3; k++)
+					if (vertexGroup[triangle[k]] == from) {
+						unsigned int member = (unsigned int)(std::find(order.begin() + firstMember, order.begin() + lastMember, triangle[k]) - order.begin());
+						valid = valid && targets[member - firstMember] != ~0u;
+					}
+			}
+			if (!valid || removed == 0)
+				continue;
+
+			for (unsigned int m = firstMember; m < lastMember; m++)
+				if (targets[m - firstMember] != ~0u)
+					vertexRemap[order[m]] = targets[m - firstMember];
+			for (unsigned int t = triangleOffsets[from]; t < triangleOffsets[from + 1]; t++) {
+				const unsigned int* triangle = &result[groupTriangles[t] * 3];
+				for (int k = 0; k < 3; k++)
+					touched[vertexGroup[triangle[k]]] = 1;
+			}
+			quadrics[to].add(quadrics[from]);
+			triangleCount -= removed;
+			reachedError = std::max(reachedError, collapse.cost);
+			collapsed++;
+		}
+		if (collapsed == 0)
+			break;
+
+		size_t write = 0;
+		for (size_t i = 0; i < result.size(); i += 3) {
+			unsigned int a = vertexRemap[result[i]], b = vertexRemap[result[i + 1]], c = vertexRemap[result[i + 2]];
+			if (vertexGroup[a] == vertexGroup[b] || vertexGroup[b] == vertexGroup[c] || vertexGroup[a] == vertexGroup[c])
+				continue;
+			result[write++] = a;
+			result[write++] = b;
+			result[write++] = c;
+		}
+		result.resize(write);
+		triangleCount = write / 3;
+	}
+	return reachedError;
+}
+
+float Core::projectedSize(const glm::vec3& center, float radius, const glm::vec3& cameraPos, float projectionScale)
+{
+	float distance = std::max(glm::length(center - cameraPos) - radius, 0.1f);
+	return 2.0f * radius * projectionScale / distance;
+}
+
+int Core::selectLod(const float* relativeErrors, int levelCount, float screenSize, int currentLevel, float maxPixelError, float hysteresis)
+{
+	int level = std::min(std::max(currentLevel, 0), levelCount - 1);
+	while (level > 0 && relativeErrors[level] * screenSize > maxPixelError)
+		level--;
+	while (level + 1 < levelCount && relativeErrors[level + 1] * screenSize < maxPixelError * (1.0f - hysteresis))
+		level++;
+	return level;
+}
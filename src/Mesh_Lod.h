@@ -0,0 +1,29 @@
+#pragma once
+#include "glm.hpp"
+#include <vector>
+
+namespace Core
+{
+	// levels of detail kept per mesh, level 0 is the full mesh
+	const int MAX_LOD_LEVELS = 4;
+
+	// Simplifies an indexed triangle list with quadric error metrics (Garland and Heckbert) into
+	// result, collapsing edges until at most targetIndexCount indices remain or the next collapse
+	// would move the surface more than maxError. Vertices that only differ in normals or texture
+	// coordinates are collapsed together, so attribute seams stay closed; open borders are kept.
+	// Only the index list changes, result refers to the same vertices as indices.
+	// Returns the largest error of the collapses made, in the units of positions.
+	float simplifyMesh(const std::vector<glm::vec3>& positions, const std::vector<unsigned int>& indices,
+		size_t targetIndexCount, float maxError, std::vector<unsigned int>& result);
+
+	// diameter in pixels of a sphere on the screen,
+	// projectionScale - element [1][1] of the projection matrix times half of the viewport height
+	float projectedSize(const glm::vec3& center, float radius, const glm::vec3& cameraPos, float projectionScale);
+
+	// Picks the coarsest level whose error covers at most maxPixelError pixels on an object
+	// screenSize pixels across. relativeErrors[level] is the error of the level divided by the
+	// size of the object (0 for level 0). Switching to a coarser level needs the error to stay
+	// below (1 - hysteresis) of the limit, so objects near a threshold do not pop every frame.
+	int selectLod(const float* relativeErrors, int levelCount, float screenSize, int currentLevel,
+		float maxPixelError = 1.0f, float hysteresis = 0.25f);
+}
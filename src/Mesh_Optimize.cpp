@@ -0,0 +1,238 @@
+#include "Mesh_Optimize.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+	// FIFO cache of the last cacheSize transformed vertices, a vertex is in the cache while
+	// fewer than cacheSize misses happened since it was loaded
+	struct VertexCache
+	{
+		std::vector<size_t> loadedAt;
+		size_t misses;
+		size_t size;
+
+		VertexCache(size_t vertexCount, int cacheSize) : loadedAt(vertexCount, 0), misses(cacheSize + 1), size(cacheSize) {}
+
+		// returns true on a miss
+		bool use(unsigned int vertex)
+		{
+			if (misses - loadedAt[vertex] <= size)
+				return false;
+			loadedAt[vertex] = misses++;
+			return true;
+		}
+	};
+
+	// triangles around every vertex
+	struct Adjacency
+	{
+		std::vector<unsigned int> offsets;
+		std::vector<unsigned int> triangles;
+
+		Adjacency(const unsigned int* indices, size_t indexCount, size_t vertexCount) : offsets(vertexCount + 1, 0), triangles(indexCount)
+		{
+			for (size_t i = 0; i < indexCount; i++)
+				offsets[indices[i] + 1]++;
+			for (size_t v = 0; v < vertexCount; v++)
+				offsets[v + 1] += offsets[v];
+			std::vector<unsigned int> fill(offsets.begin(), offsets.end() - 1);
+			for (size_t i = 0; i < indexCount; i++)
+				triangles[fill[indices[i]]++] = (unsigned int)(i / 3);
+		}
+	};
+}
+
+void Core::VertexCacheStats::add(const VertexCacheStats& other)
+{
+	triangles += other.triangles;
+	transformed += other.transformed;
+	vertices += other.vertices;
+}
+
+Core::VertexCacheStats Core::analyzeVertexCache(const unsigned int* indices, size_t indexCount, size_t vertexCount, int cacheSize)
+{
+	VertexCacheStats stats;
+	VertexCache cache(vertexCount, cacheSize);
+	std::vector<unsigned char> used(vertexCount, 0);
+	for (size_t i = 0; i < indexCount; i++) {
+		stats.transformed += cache.use(indices[i]);
+		stats.vertices += !used[indices[i]];
+		used[indices[i]] = 1;
+	}
+	stats.triangles = indexCount / 3;
+	return stats;
+}
+
+// Tipsify: emits all triangles around a fanning vertex, then continues with the vertex that was
+// just used and is most likely to stay in the cache while its remaining triangles are emitted.
+// When no such vertex is left it goes back to recently used vertices (dead-end stack) and
+// finally to the next vertex in input order.
+void Core::optimizeVertexCache(unsigned int* indices, size_t indexCount, size_t vertexCount, int cacheSize)
+{
+	size_t triangleCount = indexCount / 3;
+	if (triangleCount == 0)
+		return;
+	Adjacency adjacency(indices, indexCount, vertexCount);
+	std::vector<unsigned int> liveTriangles(vertexCount);
+	for (size_t v = 0; v < vertexCount; v++)
+		liveTriangles[v] = adjacency.offsets[v + 1] - adjacency.offsets[v];
+
+	std::vector<unsigned char> emitted(triangleCount, 0);
+	std::vector<unsigned int> result;
+	result.reserve(triangleCount * 3);
+	std::vector<unsigned int> deadEnd;
+	std::vector<unsigned int> candidates;
+	VertexCache cache(vertexCount, cacheSize);
+
+	size_t cursor = 0;
+	long long fanning = indices[0];
+	while (fanning >= 0) {
+		candidates.clear();
+		for (unsigned int t = adjacency.offsets[fanning]; t < adjacency.offsets[fanning + 1]; t++) {
+			unsigned int triangle = adjacency.triangles[t];
+			if (emitted[triangle])
+				continue;
+			emitted[triangle] = 1;
+			for (int k = 0; k < 3; k++) {
+				unsigned int v = indices[triangle * 3 + k];
+				result.push_back(v);
+				deadEnd.push_back(v);
+				candidates.push_back(v);
+				liveTriangles[v]--;
+				cache.use(v);
+			}
+		}
+
+		// the candidate that was loaded longest ago but stays in the cache through its remaining triangles
+		fanning = -1;
+		size_t bestPriority = 0;
+		for (unsigned int v : candidates) {
+			if (liveTriangles[v] == 0)
+				continue;
+			size_t age = cache.misses - cache.loadedAt[v];
+			size_t priority = age + 2 * liveTriangles[v] <= cache.size ? age : 0;
+			if (fanning < 0 || priority > bestPriority) {
+				fanning = v;
+				bestPriority = priority;
+			}
+		}
+		while (fanning < 0 && !deadEnd.empty()) {
+			unsigned int v = deadEnd.back();
+			deadEnd.pop_back();
+			if (liveTriangles[v] > 0)
+				fanning = v;
+		}
+		for (; fanning < 0 && cursor < vertexCount; cursor++)
+			if (liveTriangles[cursor] > 0)
+				fanning = cursor;
+	}
+	std::copy(result.begin(), result.end(), indices);
+}
+
+// Linear-speed overdraw ordering from the same paper as Tipsify.
+void Core::optimizeOverdraw(unsigned int* indices, size_t indexCount, const float* positions, size_t positionStride,
+	size_t vertexCount, float threshold, int cacheSize)
+{
+	size_t triangleCount = indexCount / 3;
+	if (triangleCount < 2)
+		return;
+
+	// hard boundaries: triangles that miss the cache with all three vertices start a new cluster
+	std::vector<size_t> clusters;
+	VertexCache cache(vertexCount, cacheSize);
+	for (size_t t = 0; t < triangleCount; t++) {
+		int misses = cache.use(indices[t * 3]) + cache.use(indices[t * 3 + 1]) + cache.use(indices[t * 3 + 2]);
+		if (t == 0 || misses == 3)
+			clusters.push_back(t);
+	}
+
+	// soft boundaries: a cluster is split as soon as its first part, drawn with an empty cache,
+	// misses at most threshold times as often as the whole cluster
+	std::vector<size_t> splitClusters;
+	for (size_t c = 0; c < clusters.size(); c++) {
+		size_t begin = clusters[c], end = c + 1 < clusters.size() ? clusters[c + 1] : triangleCount;
+		cache.misses += cache.size + 1;
+		size_t clusterMisses = 0;
+		for (size_t i = begin * 3; i < end * 3; i++)
+			clusterMisses += cache.use(indices[i]);
+		float limit = threshold * clusterMisses / (end - begin);
+
+		splitClusters.push_back(begin);
+		cache.misses += cache.size + 1;
+		size_t start = begin, misses = 0;
+		for (size_t t = begin; t + 1 < end; t++) {
+			misses += cache.use(indices[t * 3]) + cache.use(indices[t * 3 + 1]) + cache.use(indices[t * 3 + 2]);
+			if (float(misses) / (t + 1 - start) <= limit) {
+				splitClusters.push_back(t + 1);
+				cache.misses += cache.size + 1;
+				start = t + 1;
+				misses = 0;
+			}
+		}
+	}
+
+	// area weighted centroid and normal of every cluster and of the whole mesh
+	struct Cluster { size_t begin, end; float sortKey; };
+	std::vector<Cluster> sorted(splitClusters.size());
+	std::vector<float> centroids(splitClusters.size() * 3), normals(splitClusters.size() * 3);
+	float meshCentroid[3] = {}, meshArea = 0.0f;
+	for (size_t c = 0; c < splitClusters.size(); c++) {
+		sorted[c].begin = splitClusters[c];
+		sorted[c].end = c + 1 < splitClusters.size() ? splitClusters[c + 1] : triangleCount;
+		float area = 0.0f;
+		float* centroid = &centroids[c * 3];
+		float* normal = &normals[c * 3];
+		for (size_t t = sorted[c].begin; t < sorted[c].end; t++) {
+			const float* p0 = positions + indices[t * 3] * positionStride;
+			const float* p1 = positions + indices[t * 3 + 1] * positionStride;
+			const float* p2 = positions + indices[t * 3 + 2] * positionStride;
+			float e1[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+			float e2[3] = { p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2] };
+			float n[3] = { e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0] };
+			float triangleArea = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]) * 0.5f;
+			for (int k = 0; k < 3; k++) {
+				centroid[k] += (p0[k] + p1[k] + p2[k]) / 3.0f * triangleArea;
+				normal[k] += n[k];
+			}
+			area += triangleArea;
+		}
+		for (int k = 0; k < 3; k++) {
+			meshCentroid[k] += centroid[k];
+			centroid[k] = area > 0.0f ? centroid[k] / area : 0.0f;
+		}
+		meshArea += area;
+	}
+	for (int k = 0; k < 3; k++)
+		meshCentroid[k] = meshArea > 0.0f ? meshCentroid[k] / meshArea : 0.0f;
+
+	for (size_t c = 0; c < sorted.size(); c++) {
+		const float* centroid = &centroids[c * 3];
+		const float* normal = &normals[c * 3];
+		float length = sqrtf(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+		float key = 0.0f;
+		for (int k = 0; k < 3; k++)
+			key += (centroid[k] - meshCentroid[k]) * normal[k];
+		sorted[c].sortKey = length > 0.0f ? key / length : 0.0f;
+	}
+	std::stable_sort(sorted.begin(), sorted.end(), [](const Cluster& a, const Cluster& b) { return a.sortKey > b.sortKey; });
+
+	std::vector<unsigned int> result;
+	result.reserve(indexCount);
+	for (const Cluster& cluster : sorted)
+		result.insert(result.end(), indices + cluster.begin * 3, indices + cluster.end * 3);
+	std::copy(result.begin(), result.end(), indices);
+}
+
+size_t Core::optimizeVertexFetch(unsigned int* indices, size_t indexCount, size_t vertexCount, std::vector<unsigned int>& remap)
+{
+	remap.assign(vertexCount, ~0u);
+	unsigned int next = 0;
+	for (size_t i = 0; i < indexCount; i++) {
+		if (remap[indices[i]] == ~0u)
+			remap[indices[i]] = next++;
+		indices[i] = remap[indices[i]];
+	}
+	return next;
+}
@@ -0,0 +1,41 @@
+#pragma once
+#include <cstddef>
+#include <vector>
+
+namespace Core
+{
+	// size of the FIFO used to model the post-transform vertex cache, small enough for every GPU we run on
+	const int VERTEX_CACHE_SIZE = 16;
+
+	// Efficiency of an index order on a FIFO vertex cache: ACMR is the number of vertex shader runs
+	// per triangle (0.5 is ideal for large regular meshes, 3 is no reuse at all), ATVR the same per
+	// referenced vertex (1 is ideal). Statistics of several meshes can be summed with add().
+	struct VertexCacheStats
+	{
+		size_t triangles = 0;
+		size_t transformed = 0;
+		size_t vertices = 0;
+
+		float acmr() const { return triangles ? float(transformed) / triangles : 0.0f; }
+		float atvr() const { return vertices ? float(transformed) / vertices : 0.0f; }
+		void add(const VertexCacheStats& other);
+	};
+
+	VertexCacheStats analyzeVertexCache(const unsigned int* indices, size_t indexCount, size_t vertexCount, int cacheSize = VERTEX_CACHE_SIZE);
+
+	// Reorders triangles for the post-transform vertex cache (Tipsify, Sander et al. 2007).
+	void optimizeVertexCache(unsigned int* indices, size_t indexCount, size_t vertexCount, int cacheSize = VERTEX_CACHE_SIZE);
+
+	// Reorders clusters of triangles so that the ones facing away from the middle of the mesh, which
+	// tend to hide the rest, are drawn first. Run it after optimizeVertexCache: clusters start where
+	// that order restarts the cache and are split further as long as the cache miss rate stays
+	// within threshold of the cluster's, so the ACMR grows by at most about threshold.
+	// positions - positionStride floats per vertex, the first three are the position
+	void optimizeOverdraw(unsigned int* indices, size_t indexCount, const float* positions, size_t positionStride,
+		size_t vertexCount, float threshold = 1.05f, int cacheSize = VERTEX_CACHE_SIZE);
+
+	// Renumbers vertices in the order the indices first use them, so the vertex fetch reads the
+	// buffer almost sequentially. Rewrites indices and fills remap (old vertex -> new vertex, ~0u for
+	// vertices no index uses). Returns the number of used vertices, move the vertex data with remap.
+	size_t optimizeVertexFetch(unsigned int* indices, size_t indexCount, size_t vertexCount, std::vector<unsigned int>& remap);
+}
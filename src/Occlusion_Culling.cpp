@@ -0,0 +1,226 @@
+#include "Occlusion_Culling.h"
+
+#include <algorithm>
+#include <vector>
+
+bool Core::OcclusionCuller::isSupported()
+{
+	return GLEW_VERSION_4_3 != 0;
+}
+
+void Core::OcclusionCuller::init(const IndirectDrawList& draws, Shader_Loader& shaderLoader)
+{
+	cullProgram = shaderLoader.CreateComputeProgram("shaders/occlusion_cull.comp");
+	pyramidProgram = shaderLoader.CreateComputeProgram("shaders/depth_pyramid.comp");
+	resolveProgram = shaderLoader.CreateComputeProgram("shaders/depth_resolve.comp");
+	phaseUniform = GetUniform<int>(cullProgram, "phase");
+	drawCountUniform = GetUniform<int>(cullProgram, "drawCount");
+	sourceLevelUniform = GetUniform<int>(pyramidProgram, "sourceLevel");
+	sampleCountUniform = GetUniform<int>(resolveProgram, "sampleCount");
+	gpuDrawCounts = GLEW_ARB_indirect_parameters != 0;
+
+	drawCount = draws.drawCount();
+	batchCount = draws.batchCount();
+	std::vector<GLuint> drawBatches(drawCount * 2);
+	for (int b = 0; b < batchCount; b++) {
+		const IndirectDrawList::Batch& batch = draws.batch(b);
+		for (int i = batch.firstCommand; i < batch.firstCommand + batch.commandCount; i++) {
+			drawBatches[i * 2] = b;
+			drawBatches[i * 2 + 1] = batch.firstCommand;
+		}
+	}
+	glGenBuffers(1, &drawBatchBuffer);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, drawBatchBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(GLuint) * drawBatches.size(), drawBatches.data(), GL_STATIC_DRAW);
+
+	// everything counts as visible in the first frame
+	std::vector<GLuint> visibility(drawCount, 1);
+	glGenBuffers(1, &visibilityBuffer);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, visibilityBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(GLuint) * visibility.size(), visibility.data(), GL_DYNAMIC_COPY);
+
+	glGenBuffers(2, commandBuffers);
+	glGenBuffers(2, countBuffers);
+	for (int phase = 0; phase < 2; phase++) {
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, commandBuffers[phase]);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(DrawElementsIndirectCommand) * drawCount, NULL, GL_DYNAMIC_COPY);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, countBuffers[phase]);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(GLuint) * batchCount, NULL, GL_DYNAMIC_COPY);
+	}
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	GLint depthBits = 0, stencilBits = 0;
+	glGetFramebufferAttachmentParameteriv(GL_FRAMEBUFFER, GL_DEPTH, GL_FRAMEBUFFER_ATTACHMENT_DEPTH_SIZE, &depthBits);
+	glGetFramebufferAttachmentParameteriv(GL_FRAMEBUFFER, GL_STENCIL, GL_FRAMEBUFFER_ATTACHMENT_STENCIL_SIZE, &stencilBits);
+	glGetIntegerv(GL_SAMPLES, &samples);
+	if (stencilBits > 0)
+		depthFormat = depthBits == 32 ? GL_DEPTH32F_STENCIL8 : GL_DEPTH24_STENCIL8;
+	else
+		depthFormat = depthBits == 32 ? GL_DEPTH_COMPONENT32F : depthBits == 16 ? GL_DEPTH_COMPONENT16 : GL_DEPTH_COMPONENT24;
+
+	std::cout << "occlusion culling: " << drawCount << " draws, " << (gpuDrawCounts ? "GPU draw counts" : "zeroed commands")
+		<< ", depth buffer " << depthBits << "/" << stencilBits << " bits, " << std::max(samples, 1) << " samples" << std::endl;
+}
+
+void Core::OcclusionCuller::resize(int newWidth, int newHeight)
+{
+	glDeleteFramebuffers(1, &depthFramebuffer);
+	glDeleteTextures(1, &depthTexture);
+	glDeleteTextures(1, &resolvedTexture);
+	glDeleteTextures(1, &pyramidTexture);
+	resolvedTexture = 0;
+	width = newWidth;
+	height = newHeight;
+
+	GLenum depthTarget = samples > 1 ? GL_TEXTURE_2D_MULTISAMPLE : GL_TEXTURE_2D;
+	glGenTextures(1, &depthTexture);
+	glBindTexture(depthTarget, depthTexture);
+	if (samples > 1) {
+		glTexStorage2DMultisample(GL_TEXTURE_2D_MULTISAMPLE, samples, depthFormat, width, height, GL_TRUE);
+		glBindTexture(GL_TEXTURE_2D_MULTISAMPLE, 0);
+
+		glGenTextures(1, &resolvedTexture);
+		glBindTexture(GL_TEXTURE_2D, resolvedTexture);
+		glTexStorage2D(GL_TEXTURE_2D, 1, GL_R32F, width, height);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	}
+	else {
+		glTexStorage2D(GL_TEXTURE_2D, 1, depthFormat, width, height);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE, GL_NONE);
+	}
+
+	glGenFramebuffers(1, &depthFramebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, depthFramebuffer);
+	GLenum attachment = depthFormat == GL_DEPTH24_STENCIL8 || depthFormat == GL_DEPTH32F_STENCIL8 ? GL_DEPTH_STENCIL_ATTACHMENT : GL_DEPTH_ATTACHMENT;
+	glFramebufferTexture2D(GL_FRAMEBUFFER, attachment, depthTarget, depthTexture, 0);
+	glDrawBuffer(GL_NONE);
+	glReadBuffer(GL_NONE);
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+		std::cout << "occlusion culling: incomplete depth framebuffer" << std::endl;
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	// level 0 is half the framebuffer, down to 1x1
+	int pyramidWidth = std::max(1, (width + 1) / 2), pyramidHeight = std::max(1, (height + 1) / 2);
+	pyramidLevels = 1;
+	while ((std::max(pyramidWidth, pyramidHeight) >> pyramidLevels) > 0)
+		pyramidLevels++;
+	glGenTextures(1, &pyramidTexture);
+	glBindTexture(GL_TEXTURE_2D, pyramidTexture);
+	glTexStorage2D(GL_TEXTURE_2D, pyramidLevels, GL_R32F, pyramidWidth, pyramidHeight);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+void Core::OcclusionCuller::cull(const IndirectDrawList& draws, int phase)
+{
+	GLuint zero = 0;
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, countBuffers[phase]);
+	glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+	if (!gpuDrawCounts) {
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, commandBuffers[phase]);
+		glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+	}
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	glUseProgram(cullProgram);
+	phaseUniform.set(phase);
+	drawCountUniform.set(drawCount);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, draws.boundsBufferId());
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, draws.commandBufferId());
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, drawBatchBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, visibilityBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 6, commandBuffers[phase]);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 7, countBuffers[phase]);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, pyramidTexture);
+	glDispatchCompute((drawCount + 63) / 64, 1, 1);
+	glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
+}
+
+void Core::OcclusionCuller::buildDepthPyramid()
+{
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, depthFramebuffer);
+	glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	glActiveTexture(GL_TEXTURE0);
+	if (samples > 1) {
+		glUseProgram(resolveProgram);
+		sampleCountUniform.set(samples);
+		glBindTexture(GL_TEXTURE_2D_MULTISAMPLE, depthTexture);
+		glBindImageTexture(0, resolvedTexture, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+		glDispatchCompute((width + 7) / 8, (height + 7) / 8, 1);
+		glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+		glBindTexture(GL_TEXTURE_2D_MULTISAMPLE, 0);
+	}
+
+	glUseProgram(pyramidProgram);
+	for (int level = 0; level < pyramidLevels; level++) {
+		glBindTexture(GL_TEXTURE_2D, level > 0 ? pyramidTexture : samples > 1 ? resolvedTexture : depthTexture);
+		sourceLevelUniform.set(level == 0 ? 0 : level - 1);
+		glBindImageTexture(0, pyramidTexture, level, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+		int levelWidth = std::max(1, ((width + 1) / 2) >> level), levelHeight = std::max(1, ((height + 1) / 2) >> level);
+		glDispatchCompute((levelWidth + 7) / 8, (levelHeight + 7) / 8, 1);
+		glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+	}
+	glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+void Core::OcclusionCuller::draw(IndirectDrawList& draws, int newWidth, int newHeight, const std::function<void(Material*)>& useMaterial)
+{
+	if (drawCount == 0 || newWidth <= 0 || newHeight <= 0)
+		return;
+	if (newWidth != width || newHeight != height)
+		resize(newWidth, newHeight);
+
+	draws.upload();
+	for (int phase = 0; phase < 2; phase++) {
+		if (phase == 1)
+			buildDepthPyramid();
+		cull(draws, phase);
+		draws.drawBatches(useMaterial, commandBuffers[phase], gpuDrawCounts ? countBuffers[phase] : 0);
+	}
+}
+
+void Core::OcclusionCuller::readStats(int& phase0Draws, int& phase1Draws)
+{
+	int* results[2] = { &phase0Draws, &phase1Draws };
+	std::vector<GLuint> counts(batchCount);
+	for (int phase = 0; phase < 2; phase++) {
+		*results[phase] = 0;
+		if (counts.empty())
+			continue;
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, countBuffers[phase]);
+		glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(GLuint) * counts.size(), counts.data());
+		for (GLuint count : counts)
+			*results[phase] += count;
+	}
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+void Core::OcclusionCuller::destroy()
+{
+	glDeleteProgram(cullProgram);
+	glDeleteProgram(pyramidProgram);
+	glDeleteProgram(resolveProgram);
+	glDeleteBuffers(1, &drawBatchBuffer);
+	glDeleteBuffers(1, &visibilityBuffer);
+	glDeleteBuffers(2, commandBuffers);
+	glDeleteBuffers(2, countBuffers);
+	glDeleteFramebuffers(1, &depthFramebuffer);
+	glDeleteTextures(1, &depthTexture);
+	glDeleteTextures(1, &resolvedTexture);
+	glDeleteTextures(1, &pyramidTexture);
+	cullProgram = pyramidProgram = resolveProgram = drawBatchBuffer = visibilityBuffer = 0;
+	commandBuffers[0] = commandBuffers[1] = countBuffers[0] = countBuffers[1] = 0;
+	depthFramebuffer = depthTexture = resolvedTexture = pyramidTexture = 0;
+	width = height = pyramidLevels = 0;
+	drawCount = batchCount = 0;
+}
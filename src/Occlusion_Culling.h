@@ -0,0 +1,69 @@
+#pragma once
+#include "Indirect_Draw.h"
+#include "Shader_Loader.h"
+#include <functional>
+
+namespace Core
+{
+	// Two-phase GPU occlusion culling for an IndirectDrawList, drawn into the default framebuffer.
+	// Phase 0 draws what passed the occlusion test last frame (and is in the frustum). Its depth is
+	// copied into a max-depth mip pyramid, then every draw is tested against the frustum and the
+	// pyramid and phase 1 draws the visible ones that phase 0 skipped. Both phases run
+	// occlusion_cull.comp, which writes the survivors compacted per batch into an indirect command
+	// buffer. With ARB_indirect_parameters the batch draw counts come from the GPU, otherwise the
+	// buffer is cleared first so the unused commands draw zero instances.
+	// A multisampled depth buffer is copied as is and resolved by depth_resolve.comp to the
+	// farthest sample of every pixel: a blit resolve keeps an unspecified sample, which may be
+	// nearer and hide meshes that are partly visible at silhouettes.
+	// Requires OpenGL 4.3 (compute shaders, image load/store), see isSupported().
+	class OcclusionCuller
+	{
+	public:
+		static bool isSupported();
+
+		// after draws.build(); loads shaders/depth_pyramid.comp, shaders/depth_resolve.comp and
+		// shaders/occlusion_cull.comp
+		void init(const IndirectDrawList& draws, Shader_Loader& shaderLoader);
+
+		// width, height - size of the default framebuffer; FrameData must be up to date
+		void draw(IndirectDrawList& draws, int width, int height, const std::function<void(Material*)>& useMaterial);
+
+		// draws written by each phase of the last frame, waits for the GPU (meant for statistics)
+		void readStats(int& phase0Draws, int& phase1Draws);
+
+		void destroy();
+
+	private:
+		void resize(int width, int height);
+		void cull(const IndirectDrawList& draws, int phase);
+		void buildDepthPyramid();
+
+		GLuint cullProgram = 0;
+		GLuint pyramidProgram = 0;
+		GLuint resolveProgram = 0;
+		Uniform<int> phaseUniform;
+		Uniform<int> drawCountUniform;
+		Uniform<int> sourceLevelUniform;
+		Uniform<int> sampleCountUniform;
+
+		int drawCount = 0;
+		int batchCount = 0;
+		bool gpuDrawCounts = false;
+		GLuint drawBatchBuffer = 0;
+		GLuint visibilityBuffer = 0;
+		GLuint commandBuffers[2] = {};
+		GLuint countBuffers[2] = {};
+
+		// depth copy (in the format and sample count of the default framebuffer, as blitting
+		// requires), its resolve when multisampled and the pyramid
+		int width = 0;
+		int height = 0;
+		int pyramidLevels = 0;
+		int samples = 0;
+		GLenum depthFormat = GL_DEPTH_COMPONENT24;
+		GLuint depthTexture = 0;
+		GLuint depthFramebuffer = 0;
+		GLuint resolvedTexture = 0;
+		GLuint pyramidTexture = 0;
+	};
+}
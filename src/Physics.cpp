@@ -1,25 +1,104 @@
 #include "Physics.h"
 
+#include <algorithm>
+#include <thread>
+
 #define PX_RELEASE(x)	if(x)	{ x->release(); x = NULL; }
 
+void JobDispatcher::submitTask(PxBaseTask& task)
+{
+    // what PxDefaultCpuDispatcher does with a task: run it, then let it notify its continuation
+    jobs.submit([&task] {
+        task.run();
+        task.release();
+    });
+}
+
+// the default filtering, with continuous collision detection for every colliding pair; it only
+// happens for pairs with a body that has PxRigidBodyFlag::eENABLE_CCD
+static PxFilterFlags ccdFilterShader(PxFilterObjectAttributes attributes0, PxFilterData filterData0,
+    PxFilterObjectAttributes attributes1, PxFilterData filterData1,
+    PxPairFlags& pairFlags, const void* constantBlock, PxU32 constantBlockSize)
+{
+    PxFilterFlags flags = PxDefaultSimulationFilterShader(attributes0, filterData0, attributes1, filterData1, pairFlags, constantBlock, constantBlockSize);
+    if (!PxFilterObjectIsTrigger(attributes0) && !PxFilterObjectIsTrigger(attributes1))
+        pairFlags |= PxPairFlag::eDETECT_CCD_CONTACT;
+    return flags;
+}
+
+static PhysicsConfig configWithGravity(float gravity)
+{
+    PhysicsConfig config;
+    config.gravity = gravity;
+    return config;
+}
+
 Physics::Physics(float gravity)
+    : Physics(configWithGravity(gravity))
+{
+}
+
+Physics::Physics(const PhysicsConfig& config)
 {
     foundation = PxCreateFoundation(PX_PHYSICS_VERSION, allocator, errorCallback);
 
     physics = PxCreatePhysics(PX_PHYSICS_VERSION, *foundation, PxTolerancesScale(), true);
+    // joints (e.g. the one of Grabber) live in the extensions library
+    PxInitExtensions(*physics, NULL);
+
+    PxU32 threadCount = config.threadCount > 0 ? config.threadCount : (PxU32)std::max(1, (int)std::thread::hardware_concurrency() - 1);
+    if (config.useJobSystem) {
+        std::vector<uint64_t> masks(config.affinityMasks.begin(), config.affinityMasks.end());
+        jobSystem = new Core::JobSystem(threadCount, masks);
+        jobDispatcher = new JobDispatcher(*jobSystem);
+        dispatcher = jobDispatcher;
+    }
+    else {
+        std::vector<PxU32> masks = config.affinityMasks;
+        masks.resize(threadCount, 0);
+        defaultDispatcher = PxDefaultCpuDispatcherCreate(threadCount, config.affinityMasks.empty() ? NULL : masks.data());
+        dispatcher = defaultDispatcher;
+    }
 
     PxSceneDesc sceneDesc(physics->getTolerancesScale());
-    sceneDesc.gravity = PxVec3(0.0f, -gravity, 0.0f);
-    dispatcher = PxDefaultCpuDispatcherCreate(2);
+    sceneDesc.gravity = PxVec3(0.0f, -config.gravity, 0.0f);
     sceneDesc.cpuDispatcher = dispatcher;
-    sceneDesc.filterShader = PxDefaultSimulationFilterShader;
+    sceneDesc.filterShader = config.enableCcd ? ccdFilterShader : PxDefaultSimulationFilterShader;
+    sceneDesc.solverType = config.solverType;
+    sceneDesc.broadPhaseType = config.broadPhaseType;
+    if (config.enhancedDeterminism)
+        sceneDesc.flags |= PxSceneFlag::eENABLE_ENHANCED_DETERMINISM;
+    if (config.enableCcd) {
+        sceneDesc.flags |= PxSceneFlag::eENABLE_CCD;
+        sceneDesc.ccdMaxPasses = config.ccdMaxPasses;
+    }
     scene = physics->createScene(sceneDesc);
+
+    // without regions the multi box pruning broadphase loses every object
+    if (config.broadPhaseType == PxBroadPhaseType::eMBP) {
+        PxBounds3 regions[256];
+        PxU32 subdivisions = std::min<PxU32>(config.worldSubdivisions, 16);
+        PxU32 regionCount = PxBroadPhaseExt::createRegionsFromWorldBounds(regions, config.worldBounds, subdivisions);
+        for (PxU32 i = 0; i < regionCount; i++) {
+            PxBroadPhaseRegion region;
+            region.bounds = regions[i];
+            region.userData = NULL;
+            scene->addBroadPhaseRegion(region);
+        }
+    }
 }
 
 Physics::~Physics()
 {
     PX_RELEASE(scene);
-    PX_RELEASE(dispatcher);
+    PX_RELEASE(defaultDispatcher);
+    // the scene has no tasks left once fetchResults returned
+    delete jobSystem;
+    delete jobDispatcher;
+    jobSystem = NULL;
+    jobDispatcher = NULL;
+    dispatcher = NULL;
+    PxCloseExtensions();
     PX_RELEASE(physics);
     PX_RELEASE(foundation);
 }
@@ -28,4 +107,13 @@ void Physics::step(float dt)
 {
     scene->simulate(dt);
     scene->fetchResults(true);
-}
\ No newline at end of file
+}
+
+void Physics::step(float dt, int substeps)
+{
+    substeps = std::max(1, substeps);
+    for (int i = 0; i < substeps; i++) {
+        scene->simulate(dt / substeps);
+        scene->fetchResults(true);
+    }
+}
@@ -1,21 +1,71 @@
 #pragma once
 
 #include "PxPhysicsAPI.h"
+#include "Job_System.h"
+#include <vector>
 using namespace physx;
 
+// Scene and threading options of Physics. The scene options default to those of PxSceneDesc.
+struct PhysicsConfig
+{
+    float gravity = 9.8f;
+    // worker threads of the dispatcher, 0 - one per core but one (the thread calling step)
+    PxU32 threadCount = 0;
+    // optional CPU mask per worker thread (bit n - logical processor n), 0 leaves a worker unpinned
+    std::vector<PxU32> affinityMasks;
+    // eTGS converges faster for stacks and joints, ePGS is cheaper per iteration
+    PxSolverType::Enum solverType = PxSolverType::ePGS;
+    // eMBP gets regions covering worldBounds, see PxBroadPhaseExt::createRegionsFromWorldBounds
+    PxBroadPhaseType::Enum broadPhaseType = PxBroadPhaseType::eABP;
+    PxBounds3 worldBounds = PxBounds3(PxVec3(-1000.0f), PxVec3(1000.0f));
+    PxU32 worldSubdivisions = 4;
+    // the same results for the same inputs regardless of the order actors were added, at some cost
+    bool enhancedDeterminism = false;
+    // runs the PhysX tasks on a Core::JobSystem instead of a PxDefaultCpuDispatcher; threadCount
+    // and affinityMasks then only apply to that job system
+    bool useJobSystem = false;
+    // sweeps bodies with PxRigidBodyFlag::eENABLE_CCD along their motion, so that fast small ones
+    // do not tunnel through thin ones (eENABLE_CCD on the scene, eDETECT_CCD_CONTACT on the pairs)
+    bool enableCcd = false;
+    // CCD passes per step, more let a body bounce off more than one surface within a step
+    PxU32 ccdMaxPasses = 1;
+};
+
+// PxCpuDispatcher running the tasks of the simulation as jobs of a Core::JobSystem, so that
+// PhysX shares the worker threads (and their work stealing) with the rest of the program.
+class JobDispatcher : public PxCpuDispatcher
+{
+public:
+    explicit JobDispatcher(Core::JobSystem& jobs) : jobs(jobs) {}
+
+    void submitTask(PxBaseTask& task) override;
+    PxU32 getWorkerCount() const override { return jobs.threadCount(); }
+
+private:
+    Core::JobSystem& jobs;
+};
+
 class Physics
 {
 public:
     Physics(float gravity);
+    Physics(const PhysicsConfig& config);
     virtual ~Physics();
     PxPhysics*              physics = nullptr;
     PxScene*				scene = nullptr;
 
     void step(float dt);
+    // splits dt into that many equal simulate() calls
+    void step(float dt, int substeps);
+
+    PxU32 workerCount() const { return dispatcher->getWorkerCount(); }
 
 private:
     PxDefaultAllocator		allocator;
     PxDefaultErrorCallback	errorCallback;
     PxFoundation*			foundation = nullptr;
-    PxDefaultCpuDispatcher*	dispatcher = nullptr;
-};
\ No newline at end of file
+    PxCpuDispatcher*		dispatcher = nullptr;
+    PxDefaultCpuDispatcher*	defaultDispatcher = nullptr;
+    Core::JobSystem*		jobSystem = nullptr;
+    JobDispatcher*			jobDispatcher = nullptr;
+};
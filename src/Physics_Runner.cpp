@@ -0,0 +1,382 @@
+#include "Physics_Runner.h"
+
+#include <algorithm>
+#include <cmath>
+
+void LatencyHistogram::add(double ms)
+{
+    int bucket = 0;
+    while (bucket < BUCKETS - 1 && ms >= double(1 << bucket))
+        bucket++;
+    buckets[bucket]++;
+    samples++;
+    total += ms;
+    largest = std::max(largest, ms);
+}
+
+void LatencyHistogram::reset()
+{
+    std::fill(buckets, buckets + BUCKETS, 0);
+    samples = 0;
+    total = 0.0;
+    largest = 0.0;
+}
+
+double LatencyHistogram::percentile(double fraction) const
+{
+    long long wanted = (long long)std::ceil(fraction * samples), seen = 0;
+    for (int bucket = 0; bucket < BUCKETS - 1; bucket++) {
+        seen += buckets[bucket];
+        if (seen >= wanted)
+            return double(1 << bucket);
+    }
+    return largest;
+}
+
+void LatencyHistogram::print(std::ostream& out) const
+{
+    out << "avg " << average() << " ms, p50 < " << percentile(0.5) << " ms, p99 < " << percentile(0.99) << " ms, max " << largest << " ms |";
+    for (int bucket = 0; bucket < BUCKETS; bucket++) {
+        if (bucket < BUCKETS - 1)
+            out << " <" << (1 << bucket) << ": " << buckets[bucket];
+        else
+            out << " more: " << buckets[bucket];
+    }
+}
+
+namespace {
+
+glm::mat4 toMatrix(const PxTransform& pose)
+{
+    PxMat44 transform(pose);
+    auto& c0 = transform.column0;
+    auto& c1 = transform.column1;
+    auto& c2 = transform.column2;
+    auto& c3 = transform.column3;
+    return glm::mat4(
+        c0.x, c0.y, c0.z, c0.w,
+        c1.x, c1.y, c1.z, c1.w,
+        c2.x, c2.y, c2.z, c2.w,
+        c3.x, c3.y, c3.z, c3.w);
+}
+
+PxTransform interpolate(const PxTransform& from, const PxTransform& to, float alpha)
+{
+    // normalized linear blend of the rotations, the shorter way around; close to a slerp for
+    // the small rotations of one step
+    PxQuat target = from.q.dot(to.q) < 0.0f ? -to.q : to.q;
+    PxQuat rotation = (from.q * (1.0f - alpha) + target * alpha).getNormalized();
+    PxVec3 position = from.p * (1.0f - alpha) + to.p * alpha;
+    return PxTransform(position, rotation);
+}
+
+}
+
+PhysicsRunner::PhysicsRunner(Physics& physics, double stepTime)
+    : physics(physics), stepTime(stepTime)
+{
+}
+
+PhysicsRunner::~PhysicsRunner()
+{
+    stop();
+}
+
+int PhysicsRunner::track(PxRigidActor* actor)
+{
+    actors.push_back(actor);
+    actor->userData = (void*)(intptr_t)actors.size();
+    actor->setActorFlag(PxActorFlag::eSEND_SLEEP_NOTIFIES, true);
+    return actors.size() - 1;
+}
+
+int PhysicsRunner::trackedSlot(const PxActor* actor) const
+{
+    int slot = slotOf(actor);
+    return slot >= 0 && slot < (int)actors.size() && actors[slot] == actor ? slot : -1;
+}
+
+void PhysicsRunner::start()
+{
+    if (running())
+        return;
+    physics.scene->setFlag(PxSceneFlag::eENABLE_ACTIVE_ACTORS, true);
+    physics.scene->setSimulationEventCallback(this);
+
+    // the state before the first step, so that the matrices are valid right away
+    poses.resize(actors.size());
+    asleep.resize(actors.size());
+    disabled.resize(actors.size());
+    for (size_t i = 0; i < actors.size(); i++) {
+        poses[i] = actors[i]->getGlobalPose();
+        // isSleeping() is not allowed on actors outside the simulation
+        disabled[i] = actors[i]->getActorFlags().isSet(PxActorFlag::eDISABLE_SIMULATION);
+        PxRigidDynamic* body = actors[i]->is<PxRigidDynamic>();
+        asleep[i] = !body || disabled[i] || body->isSleeping();
+    }
+    pendingSlots.clear();
+    changeLog.clear();
+    logHead = 0;
+    logStart = 0;
+    listed.assign(actors.size(), -1);
+    // buffers left from an earlier run are older than the log and get copied in full
+    for (int i = 0; i < 3; i++) {
+        states.buffer(i).step = -1;
+        states.buffer(i).changed.clear();
+    }
+    fetchedStep = 0;
+
+    previous = poses;
+    current = poses;
+    previousTime = currentTime = 0.0;
+    currentStep = 0;
+    currentPublished = Clock::now();
+    moving.clear();
+    isMoving.assign(actors.size(), 0);
+    matrices.resize(actors.size());
+    for (size_t i = 0; i < actors.size(); i++)
+        matrices[i] = toMatrix(poses[i]);
+    restingSlots = asleep;
+    disabledSlots = disabled;
+    stateChanged.clear();
+
+    stopping = false;
+    startTime = Clock::now();
+    thread = std::thread(&PhysicsRunner::run, this);
+}
+
+void PhysicsRunner::stop()
+{
+    if (!running())
+        return;
+    stopping = true;
+    thread.join();
+    physics.scene->setSimulationEventCallback(nullptr);
+}
+
+void PhysicsRunner::enqueue(std::function<void(PxScene&)> command)
+{
+    std::lock_guard<std::mutex> lock(commandMutex);
+    commands.push_back(std::move(command));
+}
+
+void PhysicsRunner::run()
+{
+    long long step = 0;
+    std::vector<std::function<void(PxScene&)>> pending;
+    while (!stopping) {
+        Clock::time_point due = startTime + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>((step + 1) * stepTime));
+        Clock::time_point now = Clock::now();
+        if (now < due) {
+            // short sleeps, so that stop() does not wait for a whole step
+            std::this_thread::sleep_until(std::min(due, now + std::chrono::milliseconds(2)));
+            continue;
+        }
+        // more than a second behind (a breakpoint, a long hitch): skip the backlog instead of
+        // simulating it at full speed
+        double behind = std::chrono::duration<double>(now - due).count();
+        if (behind > 1.0) {
+            long long skipped = (long long)(behind / stepTime);
+            step += skipped;
+            droppedCount += skipped;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(commandMutex);
+            pending.swap(commands);
+        }
+        for (auto& command : pending)
+            command(*physics.scene);
+        pending.clear();
+
+        int substeps = substepPolicy ? std::max(1, substepPolicy(stepTime)) : 1;
+        physics.step((float)stepTime, substeps);
+        substepCount = substeps;
+        step++;
+        stepCount++;
+
+        // the actors that moved in this step; sleeping bodies and statics are not in the list
+        PxU32 activeCount = 0;
+        PxActor** active = physics.scene->getActiveActors(activeCount);
+        int moved = 0;
+        for (PxU32 i = 0; i < activeCount; i++) {
+            int slot = trackedSlot(active[i]);
+            if (slot < 0)
+                continue;
+            poses[slot] = actors[slot]->getGlobalPose();
+            // an active actor is awake, even if it woke without an onWake (e.g. from a command)
+            asleep[slot] = 0;
+            changeLog.push_back({ step, slot });
+            moved++;
+        }
+        movedCount = moved;
+        // may touch actors (e.g. take them out of the simulation), logged with this step
+        if (afterStepHook)
+            afterStepHook(stepTime);
+        // a body put to sleep is logged with its final pose, touched actors with their new one
+        for (int slot : pendingSlots) {
+            poses[slot] = actors[slot]->getGlobalPose();
+            changeLog.push_back({ step, slot });
+        }
+        pendingSlots.clear();
+
+        long long fetched = fetchedStep.load(std::memory_order_acquire);
+        State& state = states.back();
+        fill(state, step, fetched);
+        state.time = step * stepTime;
+        state.published = Clock::now();
+        states.publish();
+        trimLog(step, fetched);
+    }
+}
+
+void PhysicsRunner::fill(State& state, long long step, long long fetched)
+{
+    if (state.step < logStart) {
+        state.poses = poses;
+        state.asleep = asleep;
+        state.disabled = disabled;
+    } else {
+        // the log is ordered by step, the changes the buffer misses are at its end
+        for (size_t i = changeLog.size(); i > logHead && changeLog[i - 1].step > state.step; i--) {
+            int slot = changeLog[i - 1].slot;
+            state.poses[slot] = poses[slot];
+            state.asleep[slot] = asleep[slot];
+            state.disabled[slot] = disabled[slot];
+        }
+    }
+
+    state.changed.clear();
+    if (fetched < logStart) {
+        for (int slot = 0; slot < (int)actors.size(); slot++)
+            state.changed.push_back(slot);
+    } else {
+        for (size_t i = changeLog.size(); i > logHead && changeLog[i - 1].step > fetched; i--) {
+            int slot = changeLog[i - 1].slot;
+            if (listed[slot] != step) {
+                listed[slot] = step;
+                state.changed.push_back(slot);
+            }
+        }
+    }
+    state.step = step;
+}
+
+void PhysicsRunner::trimLog(long long step, long long fetched)
+{
+    // a render thread that stopped fetching would let the log grow without end; past that
+    // point everything is copied in full once instead
+    if (changeLog.size() - logHead > 4 * actors.size() + 1024) {
+        changeLog.clear();
+        logHead = 0;
+        logStart = step;
+        return;
+    }
+
+    // the changes every buffer and the render thread already have
+    long long oldest = fetched;
+    for (int i = 0; i < 3; i++)
+        oldest = std::min(oldest, states.buffer(i).step);
+    while (logHead < changeLog.size() && changeLog[logHead].step <= oldest)
+        logHead++;
+    logStart = std::max(logStart, oldest);
+    if (logHead > changeLog.size() / 2) {
+        changeLog.erase(changeLog.begin(), changeLog.begin() + logHead);
+        logHead = 0;
+    }
+}
+
+void PhysicsRunner::touched(PxRigidActor* actor)
+{
+    int slot = trackedSlot(actor);
+    if (slot < 0)
+        return;
+    disabled[slot] = actor->getActorFlags().isSet(PxActorFlag::eDISABLE_SIMULATION);
+    if (disabled[slot])
+        asleep[slot] = 1;
+    pendingSlots.push_back(slot);
+}
+
+void PhysicsRunner::onWake(PxActor** wokenActors, PxU32 count)
+{
+    for (PxU32 i = 0; i < count; i++) {
+        int slot = trackedSlot(wokenActors[i]);
+        if (slot >= 0) {
+            asleep[slot] = 0;
+            pendingSlots.push_back(slot);
+        }
+    }
+}
+
+void PhysicsRunner::onSleep(PxActor** sleepingActors, PxU32 count)
+{
+    for (PxU32 i = 0; i < count; i++) {
+        int slot = trackedSlot(sleepingActors[i]);
+        if (slot >= 0) {
+            asleep[slot] = 1;
+            pendingSlots.push_back(slot);
+        }
+    }
+}
+
+void PhysicsRunner::update()
+{
+    stateChanged.clear();
+    if (states.fetch()) {
+        const State& newest = states.front();
+        // the actors interpolated so far come to rest on their pose unless they moved again
+        settling.swap(moving);
+        moving.clear();
+        for (int slot : settling) {
+            previous[slot] = current[slot];
+            isMoving[slot] = 0;
+        }
+        for (int slot : newest.changed) {
+            previous[slot] = current[slot];
+            current[slot] = newest.poses[slot];
+            char rest = newest.asleep[slot];
+            char off = newest.disabled[slot];
+            if (rest != restingSlots[slot] || off != disabledSlots[slot]) {
+                // enabled or disabled actors were placed by a command, they jump instead of moving
+                if (off != disabledSlots[slot])
+                    previous[slot] = current[slot];
+                restingSlots[slot] = rest;
+                disabledSlots[slot] = off;
+                stateChanged.push_back(slot);
+            }
+            // a body at rest shows its final pose right away instead of blending into it
+            if (rest) {
+                previous[slot] = current[slot];
+                matrices[slot] = toMatrix(current[slot]);
+                continue;
+            }
+            if (!isMoving[slot]) {
+                isMoving[slot] = 1;
+                moving.push_back(slot);
+            }
+        }
+        for (int slot : settling) {
+            if (!isMoving[slot])
+                matrices[slot] = toMatrix(current[slot]);
+        }
+        previousTime = currentTime;
+        currentTime = newest.time;
+        currentStep = newest.step;
+        currentPublished = newest.published;
+        fetchedStep.store(newest.step, std::memory_order_release);
+    }
+
+    // the frame shows the simulation one step in the past, which lies between the two states
+    // as long as the physics thread keeps up
+    double renderTime = std::chrono::duration<double>(Clock::now() - startTime).count() - stepTime;
+    double span = currentTime - previousTime;
+    float alpha = span > 0.0 ? (float)std::min(1.0, std::max(0.0, (renderTime - previousTime) / span)) : 1.0f;
+    for (int slot : moving)
+        matrices[slot] = toMatrix(interpolate(previous[slot], current[slot], alpha));
+}
+
+void PhysicsRunner::framePresented()
+{
+    if (currentStep > 0)
+        displayLatency.add(std::chrono::duration<double, std::milli>(Clock::now() - currentPublished).count());
+}
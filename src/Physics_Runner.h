@@ -0,0 +1,228 @@
+#pragma once
+
+#include "Physics.h"
+#include "glm.hpp"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Hands the newest value from one producer thread to one consumer thread without locks. The
+// producer fills back() and publishes it, the consumer fetches the newest published value into
+// front(). With three buffers neither side ever waits for the other; values published between
+// two fetches are skipped.
+template <typename T>
+class TripleBuffer
+{
+public:
+    // producer
+    T& back() { return buffers[backIndex]; }
+    void publish() { backIndex = middle.exchange(backIndex | FRESH, std::memory_order_acq_rel) & INDEX; }
+
+    // consumer, false when nothing was published since the last fetch
+    bool fetch()
+    {
+        if (!(middle.load(std::memory_order_acquire) & FRESH))
+            return false;
+        frontIndex = middle.exchange(frontIndex, std::memory_order_acq_rel) & INDEX;
+        return true;
+    }
+    const T& front() const { return buffers[frontIndex]; }
+
+    // any of the three buffers: read only fields the other side never writes, write only while
+    // neither side uses them
+    const T& buffer(int index) const { return buffers[index]; }
+    T& buffer(int index) { return buffers[index]; }
+
+private:
+    static const unsigned INDEX = 3;
+    static const unsigned FRESH = 4;
+
+    T buffers[3];
+    // index of the buffer between the two sides, with FRESH while the consumer has not taken it
+    std::atomic<unsigned> middle{ 1 };
+    unsigned backIndex = 0;
+    unsigned frontIndex = 2;
+};
+
+// Latencies counted in power-of-two millisecond buckets: [0, 1), [1, 2), [2, 4), ..., [512, inf).
+class LatencyHistogram
+{
+public:
+    static const int BUCKETS = 11;
+
+    void add(double ms);
+    void reset();
+
+    long long count() const { return samples; }
+    double average() const { return samples ? total / samples : 0.0; }
+    double max() const { return largest; }
+    // upper bound of the bucket holding that fraction of the samples, 0.5 for the median
+    double percentile(double fraction) const;
+
+    void print(std::ostream& out) const;
+
+private:
+    long long buckets[BUCKETS] = {};
+    long long samples = 0;
+    double total = 0.0;
+    double largest = 0.0;
+};
+
+// Simulates a Physics scene with a fixed step on its own thread, so a slow step no longer stalls
+// rendering. After every step the poses of the tracked actors are published through a
+// TripleBuffer, and the render thread interpolates between the last two states it received,
+// one step behind the simulation.
+// Only the actors PhysX reports as active (PxSceneFlag::eENABLE_ACTIVE_ACTORS) are synced: a
+// change log of the slots that moved keeps every buffer and the model matrices up to date, so
+// the cost of a step and of a frame grows with the moving bodies, not with all of them. Resting
+// bodies and statics cost nothing once their pose was written.
+// The onWake/onSleep notifications of the scene tell which tracked actors are at rest, so that
+// the renderer can keep their matrices on the GPU between frames (see stateChanges()).
+// Actors with PxActorFlag::eDISABLE_SIMULATION (e.g. pooled ones waiting to be used) are
+// reported as disabled, for the renderer to skip them.
+// Once started the scene belongs to the physics thread: other threads change it only through
+// enqueue(), whose commands run between two steps.
+class PhysicsRunner : private PxSimulationEventCallback
+{
+public:
+    typedef std::chrono::steady_clock Clock;
+
+    PhysicsRunner(Physics& physics, double stepTime = 1.0 / 60.0);
+    ~PhysicsRunner();
+
+    // before start(), returns the slot of the actor in modelMatrices(); the runner keeps the
+    // slot in the userData of the actor and turns on its sleep notifications
+    int track(PxRigidActor* actor);
+    // slot of a tracked actor, -1 for the others
+    static int slotOf(const PxActor* actor) { return (int)(intptr_t)actor->userData - 1; }
+
+    void start();
+    void stop();
+    bool running() const { return thread.joinable(); }
+
+    // runs command on the physics thread before the next step
+    void enqueue(std::function<void(PxScene&)> command);
+    // physics thread: publishes the pose and eDISABLE_SIMULATION flag of an actor a command
+    // changed, for actors that will not be active in the next step (disabled or sleeping ones)
+    void touched(PxRigidActor* actor);
+
+    // before start(), called on the physics thread before every step with the step time, returns
+    // the substeps to split the step into (see Physics::step); one substep without it
+    void setSubsteps(std::function<int(double)> substeps) { substepPolicy = std::move(substeps); }
+    // before start(), called on the physics thread after every step with the step time, before
+    // its state is published; the actors it calls touched() for are published with that step
+    void setAfterStep(std::function<void(double)> afterStep) { afterStepHook = std::move(afterStep); }
+
+    // render thread: takes the newest published state and interpolates the moving actors, call
+    // once per frame before reading the matrices
+    void update();
+    // model matrices of the tracked actors for the current frame, indexed by slot
+    const std::vector<glm::mat4>& modelMatrices() const { return matrices; }
+    const glm::mat4& pose(int slot) const { return matrices[slot]; }
+    // statics and sleeping bodies, their pose stays as it is until they wake up
+    bool resting(int slot) const { return restingSlots[slot] != 0; }
+    // false for actors with PxActorFlag::eDISABLE_SIMULATION
+    bool enabled(int slot) const { return !disabledSlots[slot]; }
+    // slots that came to rest, woke up, were enabled or disabled in the last update()
+    const std::vector<int>& stateChanges() const { return stateChanged; }
+    // after the frame drawn with the poses was presented, records how old the newest state it showed was
+    void framePresented();
+
+    // simulate-to-display latency of the frames presented since the last reset
+    LatencyHistogram& latency() { return displayLatency; }
+    long long steps() const { return stepCount; }
+    // steps skipped after the simulation fell more than a second behind
+    long long droppedSteps() const { return droppedCount; }
+    // actors moved by the last step, and matrices interpolated by the last update()
+    int movedActors() const { return movedCount; }
+    int interpolatedActors() const { return (int)moving.size(); }
+    // substeps of the last step
+    int substeps() const { return substepCount; }
+
+private:
+    struct State {
+        std::vector<PxTransform> poses;
+        std::vector<char> asleep;
+        std::vector<char> disabled;
+        // slots that moved since the step the render thread had fetched when this was filled
+        std::vector<int> changed;
+        // seconds of simulated time since start()
+        double time = 0.0;
+        long long step = -1;
+        Clock::time_point published;
+    };
+    struct Change {
+        long long step;
+        int slot;
+    };
+
+    void run();
+    // slot of an actor, -1 for those not tracked whatever their userData holds
+    int trackedSlot(const PxActor* actor) const;
+
+    // PxSimulationEventCallback, called by fetchResults on the physics thread
+    void onWake(PxActor** wokenActors, PxU32 count) override;
+    void onSleep(PxActor** sleepingActors, PxU32 count) override;
+    void onConstraintBreak(PxConstraintInfo*, PxU32) override {}
+    void onContact(const PxContactPairHeader&, const PxContactPair*, PxU32) override {}
+    void onTrigger(PxTriggerPair*, PxU32) override {}
+    void onAdvance(const PxRigidBody* const*, const PxTransform*, const PxU32) override {}
+    // brings the back buffer from its step to the newest one
+    void fill(State& state, long long step, long long fetched);
+    void trimLog(long long step, long long fetched);
+
+    Physics& physics;
+    const double stepTime;
+    std::vector<PxRigidActor*> actors;
+
+    // physics thread: the newest poses, and the slots that moved in the steps after logStart
+    std::vector<PxTransform> poses;
+    std::vector<char> asleep;
+    std::vector<char> disabled;
+    // slots that woke up, fell asleep or were touched since the last step
+    std::vector<int> pendingSlots;
+    std::function<int(double)> substepPolicy;
+    std::function<void(double)> afterStepHook;
+    // entries before logHead are trimmed, the vector is compacted in place so it keeps its capacity
+    std::vector<Change> changeLog;
+    size_t logHead = 0;
+    long long logStart = 0;
+    // step of the last change of each slot added to State::changed, to add it once
+    std::vector<long long> listed;
+
+    TripleBuffer<State> states;
+    // step of the state the render thread fetched last, the oldest one it may still need changes since
+    std::atomic<long long> fetchedStep{ 0 };
+
+    // render thread: the poses of the last two fetched states, the slots between them and the matrices
+    std::vector<PxTransform> previous;
+    std::vector<PxTransform> current;
+    double previousTime = 0.0;
+    double currentTime = 0.0;
+    long long currentStep = 0;
+    Clock::time_point currentPublished;
+    std::vector<int> moving;
+    std::vector<int> settling;
+    std::vector<char> isMoving;
+    std::vector<glm::mat4> matrices;
+    std::vector<char> restingSlots;
+    std::vector<char> disabledSlots;
+    std::vector<int> stateChanged;
+
+    Clock::time_point startTime;
+    std::thread thread;
+    std::atomic<bool> stopping{ false };
+    std::mutex commandMutex;
+    std::vector<std::function<void(PxScene&)>> commands;
+
+    std::atomic<long long> stepCount{ 0 };
+    std::atomic<long long> droppedCount{ 0 };
+    std::atomic<int> movedCount{ 0 };
+    std::atomic<int> substepCount{ 1 };
+    LatencyHistogram displayLatency;
+};
@@ -0,0 +1,81 @@
+#include "Projectiles.h"
+
+#include <algorithm>
+#include <cmath>
+
+ProjectilePool::ProjectilePool(Physics& physics, PxMaterial& material, const ProjectileConfig& config)
+    : settings(config), firedAt(config.capacity, 0.0), ring(config.capacity)
+{
+    PxShape* shape = physics.physics->createShape(PxSphereGeometry(config.radius), material);
+    if (config.queryGroup)
+        shape->setQueryFilterData(PxFilterData(config.queryGroup, 0, 0, 0));
+
+    bodies.reserve(config.capacity);
+    recycledBodies.reserve(config.capacity);
+    for (int i = 0; i < config.capacity; i++) {
+        PxRigidDynamic* body = physics.physics->createRigidDynamic(PxTransform(PxVec3(0.0f, -100.0f - i * 2 * config.radius, 0.0f)));
+        body->attachShape(*shape);
+        PxRigidBodyExt::updateMassAndInertia(*body, config.density);
+        body->setRigidBodyFlag(PxRigidBodyFlag::eENABLE_CCD, config.ccd);
+        body->setActorFlag(PxActorFlag::eDISABLE_SIMULATION, true);
+        physics.scene->addActor(*body);
+        bodies.push_back(body);
+        ring[i] = i;
+    }
+    shape->release();
+}
+
+ProjectilePool::~ProjectilePool()
+{
+    for (PxRigidDynamic* body : bodies)
+        body->release();
+}
+
+PxRigidDynamic* ProjectilePool::fire(const PxVec3& position, const PxVec3& velocity)
+{
+    int capacity = (int)bodies.size();
+    int index;
+    if (live < capacity) {
+        index = ring[(head + live) % capacity];
+        live++;
+    } else {
+        // the oldest flying one becomes the newest
+        index = ring[head];
+        head = (head + 1) % capacity;
+    }
+
+    PxRigidDynamic* body = bodies[index];
+    body->setActorFlag(PxActorFlag::eDISABLE_SIMULATION, false);
+    body->setGlobalPose(PxTransform(position));
+    body->setLinearVelocity(velocity);
+    body->setAngularVelocity(PxVec3(0.0f));
+    firedAt[index] = time;
+    return body;
+}
+
+void ProjectilePool::update(float dt)
+{
+    time += dt;
+    recycledBodies.clear();
+    while (live > 0 && time - firedAt[ring[head]] >= settings.lifetime) {
+        PxRigidDynamic* body = bodies[ring[head]];
+        body->setActorFlag(PxActorFlag::eDISABLE_SIMULATION, true);
+        recycledBodies.push_back(body);
+        head = (head + 1) % (int)bodies.size();
+        live--;
+    }
+}
+
+int ProjectilePool::substeps(float dt) const
+{
+    if (!settings.adaptiveSubsteps)
+        return 1;
+    float fastest = 0.0f;
+    for (int i = 0; i < live; i++) {
+        PxRigidDynamic* body = bodies[ring[(head + i) % bodies.size()]];
+        fastest = std::max(fastest, body->getLinearVelocity().magnitudeSquared());
+    }
+    float travel = std::sqrt(fastest) * dt;
+    int substeps = (int)std::ceil(travel / (settings.travelPerSubstep * settings.radius));
+    return std::min(std::max(substeps, 1), settings.maxSubsteps);
+}
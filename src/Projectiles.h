@@ -0,0 +1,62 @@
+#pragma once
+
+#include "Physics.h"
+#include <vector>
+
+// Options of a ProjectilePool.
+struct ProjectileConfig
+{
+    int capacity = 2048;
+    float radius = 0.1f;
+    // kg/m^3, the mass follows from it and the radius
+    float density = 2000.0f;
+    // seconds from firing until a projectile is recycled, flying or not
+    float lifetime = 4.0f;
+    // PxRigidBodyFlag::eENABLE_CCD on the projectiles, needs PhysicsConfig::enableCcd
+    bool ccd = true;
+    // substeps (see substeps()) so that the fastest projectile moves at most travelPerSubstep radii
+    // per substep, up to maxSubsteps
+    bool adaptiveSubsteps = false;
+    float travelPerSubstep = 2.0f;
+    int maxSubsteps = 8;
+    // query group of the projectile shape (see Scene_Queries.h), 0 for none
+    PxU32 queryGroup = 0;
+};
+
+// Fixed pool of small fast spheres. All actors are created up front, share one shape and wait
+// outside the simulation (PxActorFlag::eDISABLE_SIMULATION); fire() takes the one that waited
+// longest and expired projectiles go back, so firing thousands of them never creates or releases
+// actors. Projectiles expire in the order they were fired, one ring of indices keeps both the
+// flying and the waiting ones.
+// Like the scene, it belongs to the physics thread once the simulation runs on one.
+class ProjectilePool
+{
+public:
+    ProjectilePool(Physics& physics, PxMaterial& material, const ProjectileConfig& config = ProjectileConfig());
+    ~ProjectilePool();
+
+    // the fired projectile; the oldest flying one when none is waiting
+    PxRigidDynamic* fire(const PxVec3& position, const PxVec3& velocity);
+    // after every step: ages the projectiles and takes the expired ones out of the simulation
+    void update(float dt);
+    // projectiles taken out by the last update()
+    const std::vector<PxRigidDynamic*>& recycled() const { return recycledBodies; }
+    // substeps for a step of dt, 1 without adaptiveSubsteps
+    int substeps(float dt) const;
+
+    int capacity() const { return (int)bodies.size(); }
+    int liveCount() const { return live; }
+    PxRigidDynamic* body(int index) const { return bodies[index]; }
+    const ProjectileConfig& config() const { return settings; }
+
+private:
+    const ProjectileConfig settings;
+    std::vector<PxRigidDynamic*> bodies;
+    std::vector<double> firedAt;
+    // ring[head] ... ring[head + live - 1] fly in firing order, the rest wait
+    std::vector<int> ring;
+    int head = 0;
+    int live = 0;
+    double time = 0.0;
+    std::vector<PxRigidDynamic*> recycledBodies;
+};
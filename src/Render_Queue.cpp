@@ -0,0 +1,103 @@
+#include "Render_Queue.h"
+
+#include <algorithm>
+
+unsigned Core::RenderQueue::idOf(std::unordered_map<size_t, unsigned>& ids, size_t value)
+{
+	auto found = ids.find(value);
+	if (found != ids.end())
+		return found->second;
+	unsigned id = ids.size();
+	ids[value] = id;
+	return id;
+}
+
+Core::RenderQueue::ProgramState& Core::RenderQueue::programState(GLuint program)
+{
+	auto found = programStates.find(program);
+	if (found != programStates.end())
+		return found->second;
+	ProgramState& state = programStates[program];
+	state.modelMatrix = GetUniform<glm::mat4>(program, "modelMatrix");
+	state.packedNormals = GetUniform<int>(program, "packedNormals");
+	return state;
+}
+
+void Core::RenderQueue::push(RenderContext& context, const glm::mat4& modelMatrix, float depth, int lod)
+{
+	if (!context.material)
+		return;
+
+	// program 12 bits | material 16 bits | vertex array 12 bits | depth 24 bits
+	unsigned long long program = idOf(programIds, context.material->program) & 0xfff;
+	unsigned long long material = idOf(materialIds, (size_t)context.material) & 0xffff;
+	unsigned long long vertexArray = idOf(vertexArrayIds, context.vertexArray) & 0xfff;
+	unsigned long long depthBits = (unsigned long long)(glm::clamp(depth, 0.0f, 1.0f) * 0xffffff);
+	unsigned long long key = (program << 52) | (material << 36) | (vertexArray << 24) | depthBits;
+
+	keys.push_back(std::make_pair(key, (int)items.size()));
+	items.push_back(Item{ &context, modelMatrix * context.positionDequantization, lod });
+}
+
+void Core::RenderQueue::submit()
+{
+	std::sort(keys.begin(), keys.end());
+
+	Stats stats;
+	GLuint currentProgram = 0;
+	Material* currentMaterial = nullptr;
+	GLuint currentVertexArray = 0;
+	for (auto& key : keys) {
+		Item& item = items[key.second];
+		RenderContext& context = *item.context;
+		GLuint program = context.material->program;
+
+		if (program != currentProgram) {
+			glUseProgram(program);
+			currentProgram = program;
+			// a material binds its textures and samplers for one program only
+			currentMaterial = nullptr;
+			stats.programChanges++;
+		}
+		else {
+			stats.programChangesAvoided++;
+		}
+
+		if (context.material != currentMaterial) {
+			context.material->init_data();
+			currentMaterial = context.material;
+			stats.materialChanges++;
+		}
+		else {
+			stats.materialChangesAvoided++;
+		}
+
+		if (context.vertexArray != currentVertexArray) {
+			glBindVertexArray(context.vertexArray);
+			currentVertexArray = context.vertexArray;
+			stats.vertexArrayChanges++;
+		}
+		else {
+			stats.vertexArrayChangesAvoided++;
+		}
+
+		ProgramState& state = programState(program);
+		state.modelMatrix.set(item.modelMatrix);
+		int packedNormals = context.vertexFormat == VertexFormat::Quantized;
+		if (packedNormals != state.packedNormalsValue) {
+			state.packedNormals.set(packedNormals);
+			state.packedNormalsValue = packedNormals;
+		}
+		else {
+			stats.uniformUpdatesAvoided++;
+		}
+
+		context.renderRange(item.lod);
+		stats.draws++;
+	}
+	glBindVertexArray(0);
+
+	lastStats = stats;
+	items.clear();
+	keys.clear();
+}
@@ -0,0 +1,64 @@
+#pragma once
+#include "Render_Utils.h"
+#include "Shader_Loader.h"
+#include <unordered_map>
+#include <vector>
+
+namespace Core
+{
+	// Collects the draws of a frame, sorts them by (program, material, vertex array, depth)
+	// and submits them while tracking the bound GL state, so a program, the material
+	// textures or a vertex array are only changed when the next draw needs different ones.
+	// The per-draw uniforms are modelMatrix (with the position dequantization of the
+	// context folded in) and packedNormals, which is only uploaded when it changes (so no other
+	// code may set packedNormals of the programs used with a queue).
+	class RenderQueue
+	{
+	public:
+		// state changes made by the last submit() and the ones skipped because the state was already set
+		struct Stats {
+			int draws = 0;
+			int programChanges = 0;
+			int programChangesAvoided = 0;
+			int materialChanges = 0;
+			int materialChangesAvoided = 0;
+			int vertexArrayChanges = 0;
+			int vertexArrayChangesAvoided = 0;
+			int uniformUpdatesAvoided = 0;
+		};
+
+		// depth - distance to the camera scaled to [0, 1], nearer draws of equal state go first.
+		// Contexts without a material are ignored. The context must stay alive until submit().
+		// lod - level of detail of the context to draw
+		void push(RenderContext& context, const glm::mat4& modelMatrix, float depth, int lod = 0);
+
+		// draws and clears the queue, leaves no vertex array bound
+		void submit();
+
+		const Stats& stats() const { return lastStats; }
+
+	private:
+		struct Item {
+			RenderContext* context;
+			glm::mat4 modelMatrix;
+			int lod;
+		};
+		struct ProgramState {
+			Uniform<glm::mat4> modelMatrix;
+			Uniform<int> packedNormals;
+			int packedNormalsValue = -1;
+		};
+
+		// small sequential ids keep the sort key compact
+		unsigned idOf(std::unordered_map<size_t, unsigned>& ids, size_t value);
+		ProgramState& programState(GLuint program);
+
+		std::vector<Item> items;
+		std::vector<std::pair<unsigned long long, int> > keys;
+		std::unordered_map<size_t, unsigned> programIds;
+		std::unordered_map<size_t, unsigned> materialIds;
+		std::unordered_map<size_t, unsigned> vertexArrayIds;
+		std::unordered_map<GLuint, ProgramState> programStates;
+		Stats lastStats;
+	};
+}
@@ -8,38 +8,45 @@
 
 
 
-void Core::RenderContext::initFromOBJ(obj::Model& model)
+// uploads the model vertices together with the given indices
+static void uploadOBJ(Core::RenderContext& context, obj::Model& model, const std::vector<unsigned int>& faces)
 {
-    vertexArray = 0;
-    vertexBuffer = 0;
-    vertexIndexBuffer = 0;
+    context.vertexArray = 0;
+    context.vertexBuffer = 0;
+    context.vertexIndexBuffer = 0;
     unsigned int vertexDataBufferSize = sizeof(float) * model.vertex.size();
     unsigned int vertexNormalBufferSize = sizeof(float) * model.normal.size();
     unsigned int vertexTexBufferSize = sizeof(float) * model.texCoord.size();
 
-    size = model.faces["default"].size();
-    unsigned int vertexElementBufferSize = sizeof(unsigned int) * size;
-    
-
-    std::vector<unsigned int> indices;
-    for (unsigned short index : model.faces["default"]) {
-        indices.push_back(index);
+    context.size = faces.size();
+    context.firstIndex = 0;
+    context.vertexFormat = Core::VertexFormat::Planar;
+    context.boundsMin = context.boundsMax = glm::vec3(0.0f);
+    for (size_t i = 0; i + 2 < model.vertex.size(); i += 3) {
+        glm::vec3 p(model.vertex[i], model.vertex[i + 1], model.vertex[i + 2]);
+        context.boundsMin = i ? glm::min(context.boundsMin, p) : p;
+        context.boundsMax = i ? glm::max(context.boundsMax, p) : p;
     }
 
-    glGenVertexArrays(1, &vertexArray);
-    glBindVertexArray(vertexArray);
+    glGenVertexArrays(1, &context.vertexArray);
+    glBindVertexArray(context.vertexArray);
 
 
-    glGenBuffers(1, &vertexIndexBuffer);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, vertexIndexBuffer);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, vertexElementBufferSize, &indices[0], GL_STATIC_DRAW);
-
-    glGenBuffers(1, &vertexBuffer);
-    glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+    glGenBuffers(1, &context.vertexIndexBuffer);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, context.vertexIndexBuffer);
+    // upload the narrowest index type that can address every vertex
+    if (model.shortIndices()) {
+        std::vector<unsigned short> indices(faces.begin(), faces.end());
+        context.indexType = GL_UNSIGNED_SHORT;
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(unsigned short) * indices.size(), &indices[0], GL_STATIC_DRAW);
+    }
+    else {
+        context.indexType = GL_UNSIGNED_INT;
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(unsigned int) * faces.size(), &faces[0], GL_STATIC_DRAW);
+    }
 
-    glEnableVertexAttribArray(0);
-    glEnableVertexAttribArray(1);
-    glEnableVertexAttribArray(2);
+    glGenBuffers(1, &context.vertexBuffer);
+    glBindBuffer(GL_ARRAY_BUFFER, context.vertexBuffer);
 
     glBufferData(GL_ARRAY_BUFFER, vertexDataBufferSize + vertexNormalBufferSize + vertexTexBufferSize, NULL, GL_STATIC_DRAW);
 
@@ -49,15 +56,58 @@ void Core::RenderContext::initFromOBJ(obj::Model& model)
 
     glBufferSubData(GL_ARRAY_BUFFER, vertexDataBufferSize + vertexNormalBufferSize, vertexTexBufferSize, &model.texCoord[0]);
 
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (void*)(0));
-    glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, 0, (void*)(vertexDataBufferSize));
-    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 0, (void*)(vertexNormalBufferSize + vertexDataBufferSize));
+    // positions, uvs and normals at locations 0, 1 and 2
+    size_t offsets[] = { 0, vertexDataBufferSize + vertexNormalBufferSize, vertexDataBufferSize };
+    int sizes[] = { 3, 2, 3 };
+    for (int i = 0; i < 5; i++) {
+        context.planarOffsets[i] = i < 3 ? offsets[i] : 0;
+        context.planarSizes[i] = i < 3 ? sizes[i] : 0;
+    }
+    context.setVertexAttributes();
+}
+
+void Core::RenderContext::initFromOBJ(obj::Model& model)
+{
+    uploadOBJ(*this, model, model.faces["default"]);
+}
+
+// uploads the mesh as one interleaved (optionally quantized) vertex buffer
+static void uploadPackedAssimpMesh(Core::RenderContext& context, aiMesh* mesh, const std::vector<unsigned int>& indices)
+{
+    Core::PackedVertices packed;
+    Core::packVertices(mesh, context.vertexFormat, packed);
+    context.positionDequantization = packed.positionDequantization;
+
+    glGenVertexArrays(1, &context.vertexArray);
+    glBindVertexArray(context.vertexArray);
+
+    glGenBuffers(1, &context.vertexIndexBuffer);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, context.vertexIndexBuffer);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(unsigned int) * indices.size(), &indices[0], GL_STATIC_DRAW);
+
+    glGenBuffers(1, &context.vertexBuffer);
+    glBindBuffer(GL_ARRAY_BUFFER, context.vertexBuffer);
+    glBufferData(GL_ARRAY_BUFFER, packed.data.size(), &packed.data[0], GL_STATIC_DRAW);
+    Core::setVertexAttributes(context.vertexFormat);
 }
 
 void Core::RenderContext::initFromAssimpMesh(aiMesh* mesh){
     vertexArray = 0;
     vertexBuffer = 0;
     vertexIndexBuffer = 0;
+    positionDequantization = glm::mat4();
+    meshBounds(mesh, boundsMin, boundsMax);
+
+    if (vertexFormat != VertexFormat::Planar) {
+        std::vector<unsigned int> indices;
+        for (unsigned int i = 0; i < mesh->mNumFaces; i++)
+            indices.insert(indices.end(), mesh->mFaces[i].mIndices, mesh->mFaces[i].mIndices + mesh->mFaces[i].mNumIndices);
+        size = indices.size();
+        indexType = GL_UNSIGNED_INT;
+        firstIndex = 0;
+        uploadPackedAssimpMesh(*this, mesh, indices);
+        return;
+    }
 
     std::vector<float> textureCoord;
     std::vector<unsigned int> indices;
@@ -92,6 +142,7 @@ void Core::RenderContext::initFromAssimpMesh(aiMesh* mesh){
 
     unsigned int vertexElementBufferSize = sizeof(unsigned int) * indices.size();
     size = indices.size();
+    indexType = GL_UNSIGNED_INT;
 
     glGenVertexArrays(1, &vertexArray);
     glBindVertexArray(vertexArray);
@@ -104,11 +155,6 @@ void Core::RenderContext::initFromAssimpMesh(aiMesh* mesh){
     glGenBuffers(1, &vertexBuffer);
     glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
     //std::cout << vertexBuffer;
-    glEnableVertexAttribArray(0);
-    glEnableVertexAttribArray(1);
-    glEnableVertexAttribArray(2);
-    glEnableVertexAttribArray(3);
-    glEnableVertexAttribArray(4);
 
     glBufferData(GL_ARRAY_BUFFER, vertexDataBufferSize + vertexNormalBufferSize + vertexTexBufferSize + vertexTangentBufferSize + vertexBiTangentBufferSize, NULL, GL_STATIC_DRAW);
 
@@ -122,28 +168,85 @@ void Core::RenderContext::initFromAssimpMesh(aiMesh* mesh){
 
     glBufferSubData(GL_ARRAY_BUFFER, vertexDataBufferSize + vertexNormalBufferSize + vertexTexBufferSize + vertexTangentBufferSize, vertexBiTangentBufferSize, mesh->mBitangents);
 
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (void*)(0));
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, (void*)(vertexDataBufferSize));
-    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 0, (void*)(vertexNormalBufferSize + vertexDataBufferSize));
-    glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, 0, (void*)(vertexDataBufferSize + vertexNormalBufferSize + vertexTexBufferSize));
-    glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, 0, (void*)(vertexDataBufferSize + vertexNormalBufferSize + vertexTexBufferSize + vertexTangentBufferSize));
+    // positions, normals, uvs, tangents and bitangents at locations 0-4
+    size_t offsets[] = { 0, vertexDataBufferSize, vertexDataBufferSize + vertexNormalBufferSize, vertexDataBufferSize + vertexNormalBufferSize + vertexTexBufferSize,
+        vertexDataBufferSize + vertexNormalBufferSize + vertexTexBufferSize + vertexTangentBufferSize };
+    int sizes[] = { 3, 3, 2, 3, 3 };
+    std::copy(offsets, offsets + 5, planarOffsets);
+    std::copy(sizes, sizes + 5, planarSizes);
+    setVertexAttributes();
+}
 
+void Core::RenderContext::setVertexAttributes() const
+{
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, vertexIndexBuffer);
+    glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+    // OBJ models keep vertexFormat at Planar and set planarSizes like Planar Assimp meshes
+    if (vertexFormat != VertexFormat::Planar) {
+        Core::setVertexAttributes(vertexFormat);
+        return;
+    }
+    for (int i = 0; i < 5; i++) {
+        if (planarSizes[i] == 0) {
+            glDisableVertexAttribArray(i);
+            continue;
+        }
+        glEnableVertexAttribArray(i);
+        glVertexAttribPointer(i, planarSizes[i], GL_FLOAT, GL_FALSE, 0, (void*)planarOffsets[i]);
+    }
 }
 
 void Core::RenderContext::render()
 {
-
     glBindVertexArray(this->vertexArray);
-    glDrawElements(
+    renderRange();
+    glBindVertexArray(0);
+}
+
+int Core::RenderContext::lodFirstIndex(int level) const
+{
+    level = std::min(level, lodCount - 1);
+    return level > 0 ? lods[level].firstIndex : firstIndex;
+}
+
+int Core::RenderContext::lodSize(int level) const
+{
+    level = std::min(level, lodCount - 1);
+    return level > 0 ? lods[level].size : size;
+}
+
+int Core::RenderContext::selectLod(float screenSize, int currentLevel) const
+{
+    float diameter = glm::length(boundsMax - boundsMin);
+    float relativeErrors[MAX_LOD_LEVELS] = {};
+    for (int i = 1; i < lodCount; i++)
+        relativeErrors[i] = diameter > 0.0f ? lods[i].error / diameter : 0.0f;
+    return Core::selectLod(relativeErrors, lodCount, screenSize, currentLevel);
+}
+
+void Core::RenderContext::renderRange(int lod)
+{
+    size_t indexSize = this->indexType == GL_UNSIGNED_SHORT ? sizeof(unsigned short) : sizeof(unsigned int);
+    glDrawElementsBaseVertex(
         GL_TRIANGLES,      // mode
-        this->size,    // count
-        GL_UNSIGNED_INT,   // type
-        (void*)0           // element array buffer offset
+        lodSize(lod),    // count
+        this->indexType,   // type
+        (void*)(lodFirstIndex(lod) * indexSize),           // element array buffer offset
+        this->baseVertex   // added to every index
     );
-    glBindVertexArray(0);
 }
 
 
+void Core::RenderContext::renderInstanced(int instanceCount, int lod, int baseInstance)
+{
+    size_t indexSize = this->indexType == GL_UNSIGNED_SHORT ? sizeof(unsigned short) : sizeof(unsigned int);
+    void* offset = (void*)(lodFirstIndex(lod) * indexSize);
+    if (baseInstance != 0)
+        glDrawElementsInstancedBaseVertexBaseInstance(GL_TRIANGLES, lodSize(lod), this->indexType, offset, instanceCount, this->baseVertex, baseInstance);
+    else
+        glDrawElementsInstancedBaseVertex(GL_TRIANGLES, lodSize(lod), this->indexType, offset, instanceCount, this->baseVertex);
+}
+
 void Core::DrawVertexArray(const float * vertexArray, int numVertices, int elementSize )
 {
 	glVertexAttribPointer(0, elementSize, GL_FLOAT, false, 0, vertexArray);
@@ -172,15 +275,14 @@ void Core::DrawVertexArray( const VertexData & data )
 	glDrawArrays(GL_TRIANGLES, 0, data.NumVertices);
 }
 
-void Core::DiffuseMaterial::init_data() {
-    glUniform3f(glGetUniformLocation(program, "lightDir"), lightDir.x, lightDir.y, lightDir.z);
-    Core::SetActiveTexture(texture, "color_texture", program, 0);
+// lightDir comes from the FrameData uniform block, see Shader_Loader.h
+void Core::DiffuseMaterial::init_data(GLuint targetProgram) {
+    Core::SetActiveTexture(texture, "color_texture", targetProgram, 0);
 }
 
-void Core::DiffuseSpecularMaterial::init_data() {
-    glUniform3f(glGetUniformLocation(program, "lightDir"), lightDir.x, lightDir.y, lightDir.z);
-    Core::SetActiveTexture(texture, "color_texture", program, 0);
-    Core::SetActiveTexture(textureSpecular, "specular_texture", program, 1);
+void Core::DiffuseSpecularMaterial::init_data(GLuint targetProgram) {
+    Core::SetActiveTexture(texture, "color_texture", targetProgram, 0);
+    Core::SetActiveTexture(textureSpecular, "specular_texture", targetProgram, 1);
 }
 
 
@@ -212,29 +314,25 @@ void Core::initRay(RayContext& rayContext) {
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (void*)(0));
     glBindVertexArray(0);
 }
-void Core::updateRayPos(RayContext& rayContext,std::vector<glm::vec3> ray) {
+void Core::updateRayPos(RayContext& rayContext, glm::vec3 origin, glm::vec3 direction) {
     glBindVertexArray(rayContext.vertexArray);
-    std::vector<glm::vec3> keyPoints;
     float offset = 4.f;
     float scale = 0.2f;
     float rayEnd = 50.f;
-    keyPoints.push_back(ray[0] + ray[1] * offset);
-    keyPoints.push_back(ray[0] + ray[1] * rayEnd);
-
-    keyPoints.push_back(ray[0] + ray[1] * offset + scale * glm::vec3(1.f, 1.f, 0.f));
-    keyPoints.push_back(ray[0] + ray[1] * offset - scale * glm::vec3(1.f, 1.f, 0.f));
-    keyPoints.push_back(ray[0] + ray[1] * offset + scale * glm::vec3(1.f, -1.f, 0.f));
-    keyPoints.push_back(ray[0] + ray[1] * offset - scale * glm::vec3(1.f, -1.f, 0.f));
-
-    keyPoints.push_back(ray[0] + ray[1] * offset + scale * glm::vec3(1.f, 1.f, 0.f));
-    keyPoints.push_back(ray[0] + ray[1] * rayEnd * scale);
-    keyPoints.push_back(ray[0] + ray[1] * offset - scale * glm::vec3(1.f, 1.f, 0.f));
-    keyPoints.push_back(ray[0] + ray[1] * rayEnd * scale);
-    keyPoints.push_back(ray[0] + ray[1] * offset + scale * glm::vec3(1.f, -1.f, 0.f));
-    keyPoints.push_back(ray[0] + ray[1] * rayEnd * scale);
-    keyPoints.push_back(ray[0] + ray[1] * offset - scale * glm::vec3(1.f, -1.f, 0.f));
-    keyPoints.push_back(ray[0] + ray[1] * rayEnd * scale);
+    glm::vec3 start = origin + direction * offset;
+    glm::vec3 tip = origin + direction * rayEnd * scale;
+    glm::vec3 keyPoints[] = {
+        start, origin + direction * rayEnd,
+
+        start + scale * glm::vec3(1.f, 1.f, 0.f), start - scale * glm::vec3(1.f, 1.f, 0.f),
+        start + scale * glm::vec3(1.f, -1.f, 0.f), start - scale * glm::vec3(1.f, -1.f, 0.f),
+
+        start + scale * glm::vec3(1.f, 1.f, 0.f), tip,
+        start - scale * glm::vec3(1.f, 1.f, 0.f), tip,
+        start + scale * glm::vec3(1.f, -1.f, 0.f), tip,
+        start - scale * glm::vec3(1.f, -1.f, 0.f), tip,
+    };
     glBindBuffer(GL_ARRAY_BUFFER, rayContext.vertexBuffer);
-    glBufferSubData(GL_ARRAY_BUFFER, 0, keyPoints.size()*3 * sizeof(float), &keyPoints[0]);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(keyPoints), keyPoints);
     glBindVertexArray(0);
 }
\ No newline at end of file
@@ -7,6 +7,8 @@
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
 #include "Texture.h"
+#include "Vertex_Format.h"
+#include "Mesh_Lod.h"
 
 #define BUFFER_OFFSET(i) ((char *)NULL + (i))
 
@@ -16,21 +18,21 @@ namespace Core
 
 	struct  Material {
 		GLuint program;
-		virtual void init_data() = 0;
+		void init_data() { init_data(program); }
+		// sets the material uniforms of another program, e.g. the multi-draw variant of the shader
+		virtual void init_data(GLuint targetProgram) = 0;
 	};
 
 	struct DiffuseMaterial : Core::Material {
 		GLuint texture;
-		glm::vec3 lightDir;
-		void init_data();
+		void init_data(GLuint targetProgram);
 
 	};
 
 	struct DiffuseSpecularMaterial : Core::Material {
 		GLuint texture;
 		GLuint textureSpecular;
-		glm::vec3 lightDir;
-		void init_data();
+		void init_data(GLuint targetProgram);
 
 	};
 
@@ -42,24 +44,60 @@ namespace Core
 		GLuint vertexIndexBuffer;
 		Material* material;
 		int size = 0;
+		GLenum indexType = GL_UNSIGNED_INT;
+		int firstIndex = 0;
+		// added to every index, non-zero for meshes suballocated from a GeometryPool
+		int baseVertex = 0;
+		// layout used by initFromAssimpMesh, set before calling it
+		VertexFormat vertexFormat = VertexFormat::Planar;
+		// separate float arrays (initFromOBJ, VertexFormat::Planar): offset in vertexBuffer and
+		// number of floats per vertex of the attribute at each location, 0 floats if it is unused
+		size_t planarOffsets[5] = {};
+		int planarSizes[5] = {};
+		// maps quantized positions back to mesh space, multiply the model matrix by it when drawing
+		glm::mat4 positionDequantization;
+		// axis aligned bounds of the mesh in mesh space (not quantized)
+		glm::vec3 boundsMin = glm::vec3(0.0f);
+		glm::vec3 boundsMax = glm::vec3(0.0f);
+
+		// simplified versions in the same buffers and with the same baseVertex (see GeometryPool),
+		// level 0 is the mesh itself (firstIndex, size) and lods[0] is not used
+		struct LodRange {
+			int firstIndex = 0;
+			int size = 0;
+			// cost of the worst collapse, the area-weighted RMS distance of the merged vertex to the
+			// planes of its original triangles (not a max or Hausdorff distance), in mesh units
+			float error = 0.0f;
+		};
+		LodRange lods[MAX_LOD_LEVELS];
+		int lodCount = 1;
+		// levels past lodCount are clamped to the coarsest one
+		int lodFirstIndex(int level) const;
+		int lodSize(int level) const;
+		// selectLod from Mesh_Lod.h with the errors of this mesh relative to its bounds
+		int selectLod(float screenSize, int currentLevel) const;
 
         void initFromOBJ(obj::Model& model);
 
 		void initFromAssimpMesh(aiMesh* mesh);
 
+		// binds the index and vertex buffers to the bound vertex array and sets its attributes 0-4
+		// as init did, for another vertex array over the same mesh (e.g. with instance attributes);
+		// leaves vertexBuffer bound to GL_ARRAY_BUFFER
+		void setVertexAttributes() const;
+
 		void render();
+		// draws without binding the vertex array, for callers that already bound it
+		void renderRange(int lod = 0);
+		// draws instanceCount instances, the vertex array must be bound as for renderRange;
+		// a non-zero baseInstance needs OpenGL 4.2
+		void renderInstanced(int instanceCount, int lod = 0, int baseInstance = 0);
 	};
 	struct RayContext : RenderContext {
 
 		void render();
 	};
 
-	struct Node {
-		std::vector<RenderContext> renderContexts;
-		glm::mat4 matrix;
-		int parent;
-	};
-
 	// vertexArray - jednowymiarowa tablica zawierajaca wartosci opisujace pozycje kolejnych wierzcholkow w jednym ciagu (x1, y1, z1, w1, x2, y2, z2, w2, ...)
 	// numVertices - liczba wierzcholkow do narysowania
 	// elementSize - liczba wartosci opisujacych pojedynczy wierzcholek (np. 3 gdy wierzcholek opisany jest trojka (x, y, z))
@@ -110,7 +148,8 @@ namespace Core
 
 	void initRay(RayContext& rayContext);
 
-	void updateRayPos(RayContext& rayContext, std::vector<glm::vec3> keyPoints);
+	// direction must be normalized
+	void updateRayPos(RayContext& rayContext, glm::vec3 origin, glm::vec3 direction);
 
 	//void DrawContext(Core::RayContext& rayContext);
 
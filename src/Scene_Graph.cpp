@@ -0,0 +1,74 @@
+#include "Scene_Graph.h"
+
+#include <algorithm>
+
+int Core::SceneGraph::addNode(int parent, const glm::mat4& localMatrix)
+{
+	parents.push_back(parent);
+	localMatrices.push_back(localMatrix);
+	worldMatrices.push_back(localMatrix);
+	dirty.push_back(1);
+	anyDirty = true;
+	return parents.size() - 1;
+}
+
+void Core::SceneGraph::addRenderContext(const RenderContext& context)
+{
+	contexts.push_back(context);
+	contextNodes.push_back(parents.size() - 1);
+	contextBounds.resize(contexts.size());
+	dirty.back() = 1;
+	anyDirty = true;
+}
+
+void Core::SceneGraph::setLocalMatrix(int node, const glm::mat4& localMatrix)
+{
+	localMatrices[node] = localMatrix;
+	dirty[node] = 1;
+	anyDirty = true;
+}
+
+void Core::SceneGraph::updateWorldMatrices()
+{
+	if (!anyDirty)
+		return;
+	for (size_t i = 0; i < parents.size(); i++) {
+		int parent = parents[i];
+		// parents come first, so their dirty flag is already final
+		if (parent >= 0 && dirty[parent])
+			dirty[i] = 1;
+		if (!dirty[i])
+			continue;
+		worldMatrices[i] = parent >= 0 ? worldMatrices[parent] * localMatrices[i] : localMatrices[i];
+	}
+	for (size_t i = 0; i < contexts.size(); i++) {
+		if (!dirty[contextNodes[i]])
+			continue;
+		glm::vec3 center, extent;
+		transformBounds(worldMatrices[contextNodes[i]], contexts[i].boundsMin, contexts[i].boundsMax, center, extent);
+		contextBounds.set(i, center, extent);
+	}
+	// flags are cleared afterwards, children read them during the pass
+	std::fill(dirty.begin(), dirty.end(), 0);
+	anyDirty = false;
+}
+
+glm::mat4 Core::SceneGraph::relativeMatrix(int node, int ancestor) const
+{
+	glm::mat4 transformation;
+	for (; node != ancestor && node >= 0; node = parents[node])
+		transformation = localMatrices[node] * transformation;
+	return transformation;
+}
+
+void Core::SceneGraph::clear()
+{
+	parents.clear();
+	localMatrices.clear();
+	worldMatrices.clear();
+	dirty.clear();
+	anyDirty = false;
+	contexts.clear();
+	contextNodes.clear();
+	contextBounds.resize(0);
+}
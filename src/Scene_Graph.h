@@ -0,0 +1,51 @@
+#pragma once
+#include "Render_Utils.h"
+#include "Frustum.h"
+#include <vector>
+
+namespace Core
+{
+	// Flattened scene graph stored as arrays indexed by node. Nodes are kept in topological
+	// order (a parent always comes before its children), so updateWorldMatrices() is a single
+	// linear pass that only recomputes nodes whose local matrix or an ancestor's changed.
+	// The render contexts of all nodes live in one array, grouped by node, together with their
+	// world space bounds, which are refreshed with the world matrices of their nodes.
+	class SceneGraph
+	{
+	public:
+		// parent must be -1 or an already added node
+		int addNode(int parent, const glm::mat4& localMatrix);
+		// adds a render context to the last added node
+		void addRenderContext(const RenderContext& context);
+
+		void setLocalMatrix(int node, const glm::mat4& localMatrix);
+		void updateWorldMatrices();
+
+		int nodeCount() const { return parents.size(); }
+		int parent(int node) const { return parents[node]; }
+		const glm::mat4& localMatrix(int node) const { return localMatrices[node]; }
+		// valid after updateWorldMatrices()
+		const glm::mat4& worldMatrix(int node) const { return worldMatrices[node]; }
+		// matrix of the node relative to one of its ancestors (-1 for the world)
+		glm::mat4 relativeMatrix(int node, int ancestor) const;
+
+		int contextCount() const { return contexts.size(); }
+		RenderContext& renderContext(int index) { return contexts[index]; }
+		int contextNode(int index) const { return contextNodes[index]; }
+		// world space bounds of every context, valid after updateWorldMatrices()
+		const BoundsArray& worldBounds() const { return contextBounds; }
+
+		void clear();
+
+	private:
+		std::vector<int> parents;
+		std::vector<glm::mat4> localMatrices;
+		std::vector<glm::mat4> worldMatrices;
+		std::vector<unsigned char> dirty;
+		bool anyDirty = false;
+
+		std::vector<RenderContext> contexts;
+		std::vector<int> contextNodes;
+		BoundsArray contextBounds;
+	};
+}
@@ -0,0 +1,161 @@
+#include "Scene_Queries.h"
+
+#include <algorithm>
+
+void setQueryGroup(PxRigidActor& actor, PxU32 group)
+{
+    PxShape* shapes[16];
+    PxU32 shapeCount = actor.getNbShapes();
+    for (PxU32 first = 0; first < shapeCount; first += 16) {
+        PxU32 count = actor.getShapes(shapes, 16, first);
+        for (PxU32 i = 0; i < count; i++)
+            shapes[i]->setQueryFilterData(PxFilterData(group, 0, 0, 0));
+    }
+}
+
+QueryBatch::QueryBatch(int capacity)
+    : queries(capacity), results(capacity)
+{
+}
+
+int QueryBatch::add(const Query& query)
+{
+    if (count == (int)queries.size())
+        return -1;
+    queries[count] = query;
+    return count++;
+}
+
+int QueryBatch::raycast(const PxVec3& origin, const PxVec3& direction, float distance, PxU32 mask)
+{
+    return add({ Type::Raycast, origin, direction, 0.0f, distance, mask });
+}
+
+int QueryBatch::sweepSphere(const PxVec3& origin, const PxVec3& direction, float radius, float distance, PxU32 mask)
+{
+    return add({ Type::Sweep, origin, direction, radius, distance, mask });
+}
+
+int QueryBatch::overlapSphere(const PxVec3& center, float radius, PxU32 mask)
+{
+    return add({ Type::Overlap, center, PxVec3(0.0f), radius, 0.0f, mask });
+}
+
+void QueryBatch::execute(const PxScene& scene, Core::JobSystem* jobs)
+{
+    // a chunk is worth a job once it holds a few dozen queries
+    const int CHUNK = 64;
+    if (!jobs || count <= CHUNK) {
+        run(scene, 0, count);
+        return;
+    }
+    for (int first = 0; first < count; first += CHUNK) {
+        int last = std::min(first + CHUNK, count);
+        jobs->submit([this, &scene, first, last] { run(scene, first, last); });
+    }
+    jobs->wait();
+}
+
+void QueryBatch::run(const PxScene& scene, int first, int last)
+{
+    const PxHitFlags hitFlags = PxHitFlag::ePOSITION | PxHitFlag::eNORMAL;
+    for (int i = first; i < last; i++) {
+        const Query& query = queries[i];
+        QueryHit& hit = results[i];
+        hit = QueryHit();
+        PxQueryFilterData filter(PxFilterData(query.mask, 0, 0, 0), PxQueryFlag::eSTATIC | PxQueryFlag::eDYNAMIC);
+
+        switch (query.type) {
+        case Type::Raycast: {
+            PxRaycastBuffer buffer;
+            if (scene.raycast(query.origin, query.direction, query.distance, buffer, hitFlags, filter) && buffer.hasBlock) {
+                hit.actor = buffer.block.actor;
+                hit.position = buffer.block.position;
+                hit.normal = buffer.block.normal;
+                hit.distance = buffer.block.distance;
+            }
+            break;
+        }
+        case Type::Sweep: {
+            PxSweepBuffer buffer;
+            if (scene.sweep(PxSphereGeometry(query.radius), PxTransform(query.origin), query.direction, query.distance, buffer, hitFlags, filter) && buffer.hasBlock) {
+                hit.actor = buffer.block.actor;
+                hit.position = buffer.block.position;
+                hit.normal = buffer.block.normal;
+                hit.distance = buffer.block.distance;
+            }
+            break;
+        }
+        case Type::Overlap: {
+            // any overlapping shape ends the query
+            PxOverlapBuffer buffer;
+            filter.flags |= PxQueryFlag::eANY_HIT;
+            if (scene.overlap(PxSphereGeometry(query.radius), PxTransform(query.origin), buffer, filter) && buffer.hasBlock) {
+                hit.actor = buffer.block.actor;
+                hit.position = query.origin;
+            }
+            break;
+        }
+        }
+    }
+}
+
+Grabber::Grabber(Physics& physics, float stiffness, float damping)
+    : physics(physics), stiffness(stiffness), damping(damping)
+{
+}
+
+Grabber::~Grabber()
+{
+    release();
+    if (anchor)
+        anchor->release();
+}
+
+void Grabber::grab(PxRigidDynamic& body, const PxVec3& point, float distance)
+{
+    release();
+    if (!anchor) {
+        anchor = physics.physics->createRigidDynamic(PxTransform(point));
+        anchor->setRigidBodyFlag(PxRigidBodyFlag::eKINEMATIC, true);
+        physics.scene->addActor(*anchor);
+    } else {
+        anchor->setGlobalPose(PxTransform(point));
+    }
+
+    // the frame of the body sits at the picked point, the drives pull it onto the anchor
+    PxTransform pointOnBody(body.getGlobalPose().transformInv(point));
+    joint = PxD6JointCreate(*physics.physics, anchor, PxTransform(PxIdentity), &body, pointOnBody);
+    joint->setMotion(PxD6Axis::eX, PxD6Motion::eFREE);
+    joint->setMotion(PxD6Axis::eY, PxD6Motion::eFREE);
+    joint->setMotion(PxD6Axis::eZ, PxD6Motion::eFREE);
+    joint->setMotion(PxD6Axis::eTWIST, PxD6Motion::eFREE);
+    joint->setMotion(PxD6Axis::eSWING1, PxD6Motion::eFREE);
+    joint->setMotion(PxD6Axis::eSWING2, PxD6Motion::eFREE);
+    PxD6JointDrive drive(stiffness, damping, PX_MAX_F32, true);
+    joint->setDrive(PxD6Drive::eX, drive);
+    joint->setDrive(PxD6Drive::eY, drive);
+    joint->setDrive(PxD6Drive::eZ, drive);
+
+    grabbed = &body;
+    grabDistance = distance;
+    body.wakeUp();
+}
+
+void Grabber::drag(const PxVec3& origin, const PxVec3& direction)
+{
+    if (!grabbing())
+        return;
+    anchor->setKinematicTarget(PxTransform(origin + direction * grabDistance));
+    // a resting body does not notice the drive target move on its own
+    grabbed->wakeUp();
+}
+
+void Grabber::release()
+{
+    if (!joint)
+        return;
+    joint->release();
+    joint = nullptr;
+    grabbed = nullptr;
+}
@@ -0,0 +1,102 @@
+#pragma once
+
+#include "Physics.h"
+#include "Job_System.h"
+#include <vector>
+
+// Query groups of shapes, word0 of their query filter data (see setQueryGroup). A query with a
+// non-zero mask only hits the shapes whose group shares a bit with it, mask 0 hits every shape.
+enum QueryGroup : PxU32
+{
+    QUERY_GROUP_STATIC = 1 << 0,
+    QUERY_GROUP_DYNAMIC = 1 << 1,
+    QUERY_GROUP_PROJECTILE = 1 << 2,
+};
+
+// sets the query group of every shape of the actor
+void setQueryGroup(PxRigidActor& actor, PxU32 group);
+
+// Closest hit of one query. Overlaps report the first shape they found, without position,
+// normal and distance.
+struct QueryHit
+{
+    PxRigidActor* actor = nullptr;
+    PxVec3 position;
+    PxVec3 normal;
+    float distance = 0.0f;
+
+    bool hit() const { return actor != nullptr; }
+};
+
+// Ray, sphere sweep and sphere overlap queries collected into a batch of fixed capacity and run
+// together, e.g. on the physics thread between two steps (see PhysicsRunner::enqueue). Adding
+// and running queries allocates nothing. With a job system the queries run in chunks on its
+// workers: PhysX allows concurrent queries as long as nothing writes to the scene meanwhile.
+class QueryBatch
+{
+public:
+    explicit QueryBatch(int capacity = 1024);
+
+    // index of the query for result(), -1 once the batch is full; direction must be normalized
+    int raycast(const PxVec3& origin, const PxVec3& direction, float distance, PxU32 mask = 0);
+    int sweepSphere(const PxVec3& origin, const PxVec3& direction, float radius, float distance, PxU32 mask = 0);
+    int overlapSphere(const PxVec3& center, float radius, PxU32 mask = 0);
+
+    // runs the queries added since the last clear() and fills their results
+    void execute(const PxScene& scene, Core::JobSystem* jobs = nullptr);
+    void clear() { count = 0; }
+
+    int size() const { return count; }
+    int capacity() const { return (int)queries.size(); }
+    const QueryHit& result(int index) const { return results[index]; }
+
+private:
+    enum class Type { Raycast, Sweep, Overlap };
+    struct Query {
+        Type type;
+        PxVec3 origin;
+        PxVec3 direction;
+        float radius;
+        float distance;
+        PxU32 mask;
+    };
+
+    int add(const Query& query);
+    // queries [first, last)
+    void run(const PxScene& scene, int first, int last);
+
+    std::vector<Query> queries;
+    std::vector<QueryHit> results;
+    int count = 0;
+};
+
+// Drags a dynamic body on a spring instead of setting its pose: a D6 joint with linear drives
+// ties the picked point of the body to a kinematic anchor following the cursor, so the body
+// keeps colliding and swings around the point it hangs from.
+// Like the scene, it belongs to the physics thread once the simulation runs on one.
+class Grabber
+{
+public:
+    // stiffness and damping of the acceleration drives, independent of the mass of the body
+    explicit Grabber(Physics& physics, float stiffness = 400.0f, float damping = 40.0f);
+    ~Grabber();
+
+    // attaches the body at point (world space), which lies distance along the picking ray
+    void grab(PxRigidDynamic& body, const PxVec3& point, float distance);
+    // moves the anchor to the grab distance along the ray
+    void drag(const PxVec3& origin, const PxVec3& direction);
+    void release();
+
+    bool grabbing() const { return joint != nullptr; }
+    PxRigidDynamic* body() const { return grabbed; }
+
+private:
+    Physics& physics;
+    const float stiffness;
+    const float damping;
+    // kinematic and without shapes, kept for the next grab
+    PxRigidDynamic* anchor = nullptr;
+    PxD6Joint* joint = nullptr;
+    PxRigidDynamic* grabbed = nullptr;
+    float grabDistance = 0.0f;
+};
@@ -2,9 +2,67 @@
 #include<iostream>
 #include<fstream>
 #include<vector>
+#include<string>
+#include<unordered_map>
 
 using namespace Core;
 
+namespace
+{
+	struct ProgramUniforms
+	{
+		std::unordered_map<std::string, GLint> locations;
+		// location -> texture unit last set through SetSamplerUnit
+		std::unordered_map<GLint, int> samplerUnits;
+	};
+
+	std::unordered_map<GLuint, ProgramUniforms> programUniforms;
+
+	GLuint frameDataBuffer = 0;
+}
+
+template <> void Core::Uniform<int>::set(const int& value) const { glUniform1i(location, value); }
+template <> void Core::Uniform<float>::set(const float& value) const { glUniform1f(location, value); }
+template <> void Core::Uniform<glm::vec3>::set(const glm::vec3& value) const { glUniform3fv(location, 1, &value.x); }
+template <> void Core::Uniform<glm::vec4>::set(const glm::vec4& value) const { glUniform4fv(location, 1, &value.x); }
+template <> void Core::Uniform<glm::mat4>::set(const glm::mat4& value) const { glUniformMatrix4fv(location, 1, GL_FALSE, &value[0][0]); }
+
+GLint Core::GetUniformLocation(GLuint program, const char* name)
+{
+	auto found = programUniforms.find(program);
+	if (found == programUniforms.end())
+		return glGetUniformLocation(program, name);
+	auto location = found->second.locations.find(name);
+	return location == found->second.locations.end() ? -1 : location->second;
+}
+
+void Core::SetSamplerUnit(GLuint program, const char* name, int unit)
+{
+	auto found = programUniforms.find(program);
+	if (found == programUniforms.end()) {
+		glUniform1i(glGetUniformLocation(program, name), unit);
+		return;
+	}
+	GLint location = GetUniformLocation(program, name);
+	if (location < 0)
+		return;
+	auto current = found->second.samplerUnits.find(location);
+	if (current != found->second.samplerUnits.end() && current->second == unit)
+		return;
+	glUniform1i(location, unit);
+	found->second.samplerUnits[location] = unit;
+}
+
+void Core::UpdateFrameData(const FrameData& data)
+{
+	if (!frameDataBuffer)
+		glGenBuffers(1, &frameDataBuffer);
+	glBindBuffer(GL_UNIFORM_BUFFER, frameDataBuffer);
+	glBufferData(GL_UNIFORM_BUFFER, sizeof(FrameData), &data, GL_STREAM_DRAW);
+	glBindBufferBase(GL_UNIFORM_BUFFER, FRAME_DATA_BINDING, frameDataBuffer);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
 Shader_Loader::Shader_Loader(void){}
 Shader_Loader::~Shader_Loader(void){}
 
@@ -93,10 +151,73 @@ GLuint Shader_Loader::CreateProgram(char* vertexShaderFilename,
 	glDeleteShader(vertex_shader);
 	glDeleteShader(fragment_shader);
 
+	ReflectProgram(program);
+
 	return program;
 }
 
+GLuint Shader_Loader::CreateComputeProgram(char* computeShaderFilename)
+{
+	std::string compute_shader_code = ReadShader(computeShaderFilename);
+	GLuint compute_shader = CreateShader(GL_COMPUTE_SHADER, compute_shader_code, "compute shader");
+
+	int link_result = 0;
+	GLuint program = glCreateProgram();
+	glAttachShader(program, compute_shader);
+
+	glLinkProgram(program);
+	glGetProgramiv(program, GL_LINK_STATUS, &link_result);
+	if (link_result == GL_FALSE)
+	{
+
+		int info_log_length = 0;
+		glGetProgramiv(program, GL_INFO_LOG_LENGTH, &info_log_length);
+		std::vector<char> program_log(info_log_length);
+		glGetProgramInfoLog(program, info_log_length, NULL, &program_log[0]);
+		std::cout << "Shader Loader : LINK ERROR" << std::endl << &program_log[0] << std::endl;
+		return 0;
+	}
+
+	glDetachShader(program, compute_shader);
+	glDeleteShader(compute_shader);
+
+	ReflectProgram(program);
+
+	return program;
+}
+
+void Shader_Loader::ReflectProgram(GLuint program)
+{
+	ProgramUniforms& uniforms = programUniforms[program];
+	uniforms = ProgramUniforms();
+
+	int count = 0, max_length = 0;
+	glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &count);
+	glGetProgramiv(program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &max_length);
+	std::vector<char> name(max_length + 1);
+	for (int i = 0; i < count; i++)
+	{
+		GLint size = 0;
+		GLenum type = 0;
+		glGetActiveUniform(program, i, name.size(), NULL, &size, &type, &name[0]);
+		// uniforms inside blocks have no location
+		GLint location = glGetUniformLocation(program, &name[0]);
+		if (location < 0)
+			continue;
+		std::string uniformName = &name[0];
+		uniforms.locations[uniformName] = location;
+		// arrays are reported as "name[0]", make them reachable by the plain name as well
+		if (uniformName.size() > 3 && uniformName.compare(uniformName.size() - 3, 3, "[0]") == 0)
+			uniforms.locations[uniformName.substr(0, uniformName.size() - 3)] = location;
+	}
+
+	GLuint frame_block = glGetUniformBlockIndex(program, "FrameData");
+	if (frame_block != GL_INVALID_INDEX)
+		glUniformBlockBinding(program, frame_block, FRAME_DATA_BINDING);
+}
+
 void Shader_Loader::DeleteProgram( GLuint program )
 {
+	programUniforms.erase(program);
 	glDeleteProgram(program);
 }
@@ -2,10 +2,56 @@
 
 #include "glew.h"
 #include "freeglut.h"
+#include "glm.hpp"
 #include <iostream>
 
 namespace Core
 {
+	// Handle of a uniform of a known type, resolved once through GetUniform. Setting a handle
+	// of a uniform the program does not have (location -1) does nothing, like glUniform*.
+	template <typename T>
+	struct Uniform
+	{
+		GLint location = -1;
+		// the program must be current
+		void set(const T& value) const;
+	};
+
+	template <> void Uniform<int>::set(const int& value) const;
+	template <> void Uniform<float>::set(const float& value) const;
+	template <> void Uniform<glm::vec3>::set(const glm::vec3& value) const;
+	template <> void Uniform<glm::vec4>::set(const glm::vec4& value) const;
+	template <> void Uniform<glm::mat4>::set(const glm::mat4& value) const;
+
+	// Location of a uniform of a program linked by a Shader_Loader. CreateProgram reads all active
+	// uniforms once, so this is a table lookup instead of a call into the driver.
+	// Other programs fall back to glGetUniformLocation.
+	GLint GetUniformLocation(GLuint program, const char* name);
+
+	template <typename T>
+	Uniform<T> GetUniform(GLuint program, const char* name)
+	{
+		Uniform<T> uniform;
+		uniform.location = GetUniformLocation(program, name);
+		return uniform;
+	}
+
+	// Sets a sampler uniform of the current program to a texture unit. The value is remembered per
+	// program, so binding the same unit again does not touch the program.
+	void SetSamplerUnit(GLuint program, const char* name, int unit);
+
+	// Values shared by every draw of a frame, the std140 uniform block FrameData in the shaders.
+	// CreateProgram binds that block of every program to FRAME_DATA_BINDING, so the buffer is
+	// uploaded and bound once per frame by UpdateFrameData.
+	struct FrameData
+	{
+		glm::mat4 viewProjection;
+		glm::vec4 cameraPos;
+		glm::vec4 lightDir;
+	};
+	const GLuint FRAME_DATA_BINDING = 0;
+
+	void UpdateFrameData(const FrameData& data);
 
 	class Shader_Loader
 	{
@@ -15,6 +61,8 @@ namespace Core
 		GLuint CreateShader(GLenum shaderType,
 			std::string source,
 			char* shaderName);
+		// records the active uniforms of a linked program and binds its FrameData block
+		void ReflectProgram(GLuint program);
 
 	public:
 
@@ -22,6 +70,7 @@ namespace Core
 		~Shader_Loader(void);
 		GLuint CreateProgram(char* VertexShaderFilename,
 			char* FragmentShaderFilename);
+		GLuint CreateComputeProgram(char* ComputeShaderFilename);
 
 		void DeleteProgram(GLuint program);
 
@@ -1,57 +1,334 @@
 #include "Texture.h"
+#include "Shader_Loader.h"
 
+#include <algorithm>
+#include <cctype>
+#include <chrono>
 #include <fstream>
 #include <iterator>
 #include <vector>
+#include <sys/stat.h>
 #include "picopng.h"
 #include "stb_image.h"
+#include "Texture_Compression.h"
 
 typedef unsigned char byte;
 
 
-GLuint Core::LoadTexture(const char* filename)
+// false when the file does not exist
+static bool modificationTime(const std::string& path, long long& time)
 {
-    //std::string path = std::string(filename);
+#ifdef _WIN32
+    struct _stat64 st;
+    if (_stat64(path.c_str(), &st) != 0)
+        return false;
+#else
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0)
+        return false;
+#endif
+    time = st.st_mtime;
+    return true;
+}
 
-    unsigned int textureID;
+// a .dds next to the image that texture_compress_tool wrote after the image was last changed;
+// an edited image is decoded again until the tool is rerun
+static bool compressedIsFresh(const std::string& imagePath, const std::string& ddsPath)
+{
+    long long imageTime, ddsTime;
+    if (!modificationTime(ddsPath, ddsTime))
+        return false;
+    return !modificationTime(imagePath, imageTime) || ddsTime >= imageTime;
+}
+
+// a 1x1 mid grey texture with the sampling state of the loaded ones, shown until the image is uploaded
+static GLuint createPlaceholderTexture()
+{
+    static const unsigned char grey[4] = { 128, 128, 128, 255 };
+    GLuint textureID;
     glGenTextures(1, &textureID);
+    glBindTexture(GL_TEXTURE_2D, textureID);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, grey);
+
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    return textureID;
+}
+
+// GPU memory of an image with its mip chain, which adds a third
+static size_t textureBytes(int width, int height, int components)
+{
+    return (size_t)width * height * components * 4 / 3;
+}
+
+// what glGenerateMipmap builds for the uploaded images
+static Core::ImageInfo uncompressedImageInfo(int width, int height, int components)
+{
+    Core::ImageInfo info;
+    info.width = width;
+    info.height = height;
+    info.internalFormat = Core::PixelUploader::internalFormat(components);
+    info.levels = 1;
+    while ((std::max(width, height) >> info.levels) > 0)
+        info.levels++;
+    return info;
+}
 
-    int width, height, nrComponents;
-    stbi_set_flip_vertically_on_load(true);
-    unsigned char* data = stbi_load(filename, &width, &height, &nrComponents, 0);
-    if (data)
-    {
-        GLenum format;
-        if (nrComponents == 1)
-            format = GL_RED;
-        else if (nrComponents == 3)
-            format = GL_RGB;
-        else if (nrComponents == 4)
-            format = GL_RGBA;
-
-        glBindTexture(GL_TEXTURE_2D, textureID);
-        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
-
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-        stbi_image_free(data);
+// Uploads a block compressed file written by texture_compress_tool with its mip chain, so neither
+// decoding nor glGenerateMipmap is needed. Returns 0 when the file is missing, broken or its
+// format is not supported by the driver; the caller then loads the source image.
+static GLuint loadCompressedTexture(const std::string& path, size_t& bytes, Core::ImageInfo& info)
+{
+    Core::CompressedImage image;
+    if (!Core::readDds(path, image))
+        return 0;
+
+    GLenum format;
+    if (image.format == Core::BlockFormat::BC5) {
+        if (!GLEW_VERSION_3_0 && !GLEW_ARB_texture_compression_rgtc)
+            return 0;
+        format = GL_COMPRESSED_RG_RGTC2;
     }
-    else
-    {
-        std::cout << "Texture failed to load at path: " << filename << std::endl;
-        stbi_image_free(data);
+    else {
+        if (!GLEW_EXT_texture_compression_s3tc)
+            return 0;
+        format = image.format == Core::BlockFormat::BC1 ? GL_COMPRESSED_RGB_S3TC_DXT1_EXT : GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
     }
 
+    GLuint textureID;
+    glGenTextures(1, &textureID);
+    glBindTexture(GL_TEXTURE_2D, textureID);
+    bytes = 0;
+    for (size_t level = 0; level < image.levels.size(); level++) {
+        const auto& data = image.levels[level];
+        glCompressedTexImage2D(GL_TEXTURE_2D, (GLint)level, format, data.width, data.height, 0, (GLsizei)data.data.size(), data.data.data());
+        bytes += data.data.size();
+    }
+    info.width = image.levels[0].width;
+    info.height = image.levels[0].height;
+    info.levels = (int)image.levels.size();
+    info.internalFormat = format;
+    // an incomplete chain (a file without the smallest levels) still samples correctly
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint)image.levels.size() - 1);
+
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
     return textureID;
 }
 
+std::string Core::CanonicalPath(const char* path)
+{
+    std::string text(path);
+    for (auto& c : text) {
+        if (c == '\\')
+            c = '/';
+#ifdef _WIN32
+        c = (char)tolower((unsigned char)c);
+#endif
+    }
+
+    // split on '/', drop "." and empty parts, let ".." remove the previous part
+    bool absolute = !text.empty() && text[0] == '/';
+    std::vector<std::string> parts;
+    size_t start = 0;
+    while (start <= text.size()) {
+        size_t end = text.find('/', start);
+        if (end == std::string::npos)
+            end = text.size();
+        std::string part = text.substr(start, end - start);
+        if (part == "..") {
+            if (!parts.empty() && parts.back() != "..")
+                parts.pop_back();
+            else if (!absolute)
+                parts.push_back(part);
+        }
+        else if (!part.empty() && part != ".") {
+            parts.push_back(part);
+        }
+        start = end + 1;
+    }
+
+    std::string result = absolute ? "/" : "";
+    for (size_t i = 0; i < parts.size(); i++)
+        result += (i > 0 ? "/" : "") + parts[i];
+    return result;
+}
+
+Core::TextureCache& Core::TextureCache::instance()
+{
+    static TextureCache cache;
+    return cache;
+}
+
+GLuint Core::TextureCache::acquire(const char* filepath, bool flipVertically)
+{
+    if (!filepath || !*filepath)
+        return 0;
+
+    std::string key = CanonicalPath(filepath) + (flipVertically ? "" : "|noflip");
+    auto found = entries.find(key);
+    if (found != entries.end()) {
+        cacheStats.hits++;
+        if (found->second.texture)
+            found->second.references++;
+        return found->second.texture;
+    }
+
+    Entry entry = { 0, 1, 0, false, ImageInfo() };
+    // the compressed files are stored bottom row first, so only flipped loads can use them
+    std::string ddsPath = std::string(filepath) + ".dds";
+    if (flipVertically && compressedIsFresh(filepath, ddsPath))
+        entry.texture = loadCompressedTexture(ddsPath, entry.bytes, entry.info);
+    if (entry.texture) {
+        cacheStats.compressed++;
+    }
+    else if (decoder.running()) {
+        // only a file whose header cannot be read fails right away, the decoding happens on a worker
+        int width, height, components;
+        if (stbi_info(filepath, &width, &height, &components)) {
+            entry.info = uncompressedImageInfo(width, height, components);
+            entry.texture = createPlaceholderTexture();
+            entry.pending = true;
+            decoder.request(entry.texture, filepath, flipVertically);
+        }
+        else {
+            std::cout << "Texture failed to load at path: " << filepath << std::endl;
+        }
+    }
+    else {
+        auto start = std::chrono::steady_clock::now();
+        int width, height, components;
+        stbi_set_flip_vertically_on_load(flipVertically);
+        unsigned char* pixels = stbi_load(filepath, &width, &height, &components, 0);
+        cacheStats.decodes++;
+        if (pixels) {
+            entry.texture = createPlaceholderTexture();
+            uploader.upload(entry.texture, pixels, width, height, components);
+            entry.bytes = textureBytes(width, height, components);
+            entry.info = uncompressedImageInfo(width, height, components);
+            stbi_image_free(pixels);
+        }
+        else {
+            std::cout << "Texture failed to load at path: " << filepath << std::endl;
+        }
+        cacheStats.decodeMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    entries[key] = entry;
+    if (!entry.texture) {
+        cacheStats.failures++;
+        return 0;
+    }
+    keys[entry.texture] = key;
+    cacheStats.textures++;
+    cacheStats.bytes += entry.bytes;
+    return entry.texture;
+}
+
+void Core::TextureCache::startAsyncLoading(int threadCount)
+{
+    uploader.init();
+    decoder.start(threadCount);
+}
+
+void Core::TextureCache::stopAsyncLoading()
+{
+    decoder.stop();
+    for (GLuint texture : orphaned)
+        glDeleteTextures(1, &texture);
+    orphaned.clear();
+    uploader.destroy();
+}
+
+void Core::TextureCache::update(size_t uploadBudget)
+{
+    size_t uploaded = 0;
+    DecodedImage image;
+    while (uploaded < uploadBudget && decoder.pop(image)) {
+        cacheStats.decodes++;
+        cacheStats.decodeMs += image.decodeMs;
+
+        auto key = keys.find(image.texture);
+        if (key == keys.end()) {
+            // released while it was decoded, the name was kept so that no other texture got it
+            orphaned.erase(image.texture);
+            glDeleteTextures(1, &image.texture);
+        }
+        else if (!image.pixels) {
+            // the placeholder stays, like a missing file the path is not loaded again
+            std::cout << "Texture failed to load at path: " << image.path << std::endl;
+            cacheStats.failures++;
+            entries[key->second].pending = false;
+        }
+        else {
+            uploader.upload(image.texture, image.pixels, image.width, image.height, image.components);
+            Entry& entry = entries[key->second];
+            entry.pending = false;
+            entry.bytes = textureBytes(image.width, image.height, image.components);
+            cacheStats.bytes += entry.bytes;
+            uploaded += image.size();
+        }
+        ImageDecoder::freePixels(image);
+    }
+}
+
+Core::TextureCache::State Core::TextureCache::state(GLuint texture) const
+{
+    auto key = keys.find(texture);
+    if (key == keys.end())
+        return State::Missing;
+    const Entry& entry = entries.at(key->second);
+    if (entry.pending)
+        return State::Pending;
+    // only failed decodes leave a texture without bytes
+    return entry.bytes > 0 ? State::Loaded : State::Missing;
+}
+
+bool Core::TextureCache::imageInfo(GLuint texture, ImageInfo& info) const
+{
+    auto key = keys.find(texture);
+    if (key == keys.end())
+        return false;
+    info = entries.at(key->second).info;
+    return true;
+}
+
+void Core::TextureCache::release(GLuint texture)
+{
+    auto key = keys.find(texture);
+    if (key == keys.end())
+        return;
+    Entry& entry = entries[key->second];
+    if (--entry.references > 0)
+        return;
+
+    if (entry.pending)
+        orphaned.insert(texture);
+    else
+        glDeleteTextures(1, &texture);
+    cacheStats.textures--;
+    cacheStats.bytes -= entry.bytes;
+    entries.erase(key->second);
+    keys.erase(key);
+}
+
+GLuint Core::LoadTexture(const char* filename, bool flipVertically)
+{
+    return TextureCache::instance().acquire(filename, flipVertically);
+}
+
+void Core::ReleaseTexture(GLuint texture)
+{
+    TextureCache::instance().release(texture);
+}
+
 void Core::SetActiveTexture(GLuint textureID, const char * shaderVariableName, GLuint programID, int textureUnit)
 {
-	glUniform1i(glGetUniformLocation(programID, shaderVariableName), textureUnit);
+	Core::SetSamplerUnit(programID, shaderVariableName, textureUnit);
 	glActiveTexture(GL_TEXTURE0 + textureUnit);
 	glBindTexture(GL_TEXTURE_2D, textureID);
 }
@@ -4,10 +4,98 @@
 #include "freeglut.h"
 #include <string>
 #include <iostream>
+#include <unordered_map>
+#include <unordered_set>
+#include "Texture_Streaming.h"
 
 namespace Core
 {
-	GLuint LoadTexture(const char * filepath);
+	// size and format of a texture loaded from a file, internalFormat is sized (GL_RGB8, ...) or
+	// block compressed; levels counts the mip chain
+	struct ImageInfo {
+		int width = 0;
+		int height = 0;
+		int levels = 0;
+		GLenum internalFormat = 0;
+	};
+
+	// Process-wide cache of the textures loaded from files, keyed by the canonical path (and the
+	// flip flag). Loading a path that is already loaded returns the same texture and adds a
+	// reference, ReleaseTexture drops one and deletes the texture with the last. Files that fail
+	// to load are remembered as texture 0, so they are neither decoded nor reported again.
+	// A file with a "<path>.dds" next to it (see texture_compress_tool) is uploaded from that file,
+	// block compressed with its precomputed mipmaps, instead of being decoded, unless the image
+	// was changed after the .dds was written.
+	// After startAsyncLoading the files are decoded by worker threads: a load returns at once a
+	// texture holding a grey placeholder, and update() uploads the decoded images into it through
+	// a pixel buffer ring over the following frames, so materials keep the same texture names.
+	// Main thread only, like every other GL call.
+	class TextureCache
+	{
+	public:
+		struct Stats {
+			// textures alive, decoded files and loads answered from the cache
+			int textures = 0;
+			int decodes = 0;
+			int hits = 0;
+			int failures = 0;
+			// loads uploaded from block compressed files
+			int compressed = 0;
+			// estimated GPU memory of the textures alive, with mipmaps
+			size_t bytes = 0;
+			// time spent in stb_image, summed over the decoding threads
+			double decodeMs = 0.0;
+		};
+
+		enum class State { Missing, Pending, Loaded };
+
+		static TextureCache& instance();
+
+		GLuint acquire(const char* filepath, bool flipVertically);
+		void release(GLuint texture);
+
+		// needs the GL context; threadCount 0 - one decoding thread per core but one
+		void startAsyncLoading(int threadCount = 0);
+		void stopAsyncLoading();
+		// uploads decoded images until uploadBudget bytes of pixels were copied, call once per frame
+		void update(size_t uploadBudget = 16 << 20);
+		// textures still showing the placeholder because their image is being decoded or waits for update()
+		int pendingCount() const { return decoder.pendingCount(); }
+
+		// Missing for textures that are not from the cache or whose file failed to load
+		State state(GLuint texture) const;
+		// known as soon as the texture is acquired, also while it is pending
+		bool imageInfo(GLuint texture, ImageInfo& info) const;
+
+		const Stats& stats() const { return cacheStats; }
+
+	private:
+		struct Entry {
+			GLuint texture;
+			int references;
+			size_t bytes;
+			// holds the placeholder, the image is not uploaded yet
+			bool pending;
+			ImageInfo info;
+		};
+
+		std::unordered_map<std::string, Entry> entries;
+		// texture -> key in entries
+		std::unordered_map<GLuint, std::string> keys;
+		// released while pending, deleted when their decoding finishes
+		std::unordered_set<GLuint> orphaned;
+		ImageDecoder decoder;
+		PixelUploader uploader;
+		Stats cacheStats;
+	};
+
+	// Path with '\\' turned into '/' and the "." and ".." parts resolved, case-folded on Windows.
+	std::string CanonicalPath(const char* path);
+
+	// flipVertically - OpenGL expects the bottom row first, Assimp models loaded with aiProcess_FlipUVs do not
+	GLuint LoadTexture(const char * filepath, bool flipVertically = true);
+	// drops a reference taken by LoadTexture
+	void ReleaseTexture(GLuint texture);
 
 	// textureID - identyfikator tekstury otrzymany z funkcji LoadTexture
 	// shaderVariableName - nazwa zmiennej typu 'sampler2D' w shaderze, z ktora ma zostac powiazana tekstura
@@ -0,0 +1,405 @@
+#include "Texture_Compression.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+namespace
+{
+	struct Color {
+		float r, g, b;
+	};
+
+	uint16_t packColor565(const Color& c)
+	{
+		int r = std::min(31, std::max(0, (int)(c.r * 31.0f / 255.0f + 0.5f)));
+		int g = std::min(63, std::max(0, (int)(c.g * 63.0f / 255.0f + 0.5f)));
+		int b = std::min(31, std::max(0, (int)(c.b * 31.0f / 255.0f + 0.5f)));
+		return (uint16_t)(r << 11 | g << 5 | b);
+	}
+
+	Color unpackColor565(uint16_t packed)
+	{
+		int r = packed >> 11 & 31, g = packed >> 5 & 63, b = packed & 31;
+		return Color{ float(r << 3 | r >> 2), float(g << 2 | g >> 4), float(b << 3 | b >> 2) };
+	}
+
+	float distance2(const Color& a, const Color& b)
+	{
+		return (a.r - b.r) * (a.r - b.r) + (a.g - b.g) * (a.g - b.g) + (a.b - b.b) * (a.b - b.b);
+	}
+
+	// the four colors of a block in the four color mode
+	void bc1Palette(uint16_t c0, uint16_t c1, Color palette[4])
+	{
+		palette[0] = unpackColor565(c0);
+		palette[1] = unpackColor565(c1);
+		palette[2] = Color{ (2 * palette[0].r + palette[1].r) / 3, (2 * palette[0].g + palette[1].g) / 3, (2 * palette[0].b + palette[1].b) / 3 };
+		palette[3] = Color{ (palette[0].r + 2 * palette[1].r) / 3, (palette[0].g + 2 * palette[1].g) / 3, (palette[0].b + 2 * palette[1].b) / 3 };
+	}
+
+	// nearest palette entry of every pixel, returns the squared error
+	float bc1Indices(const Color pixels[16], uint16_t c0, uint16_t c1, int indices[16])
+	{
+		Color palette[4];
+		bc1Palette(c0, c1, palette);
+		float error = 0.0f;
+		for (int i = 0; i < 16; i++) {
+			float best = distance2(pixels[i], palette[0]);
+			indices[i] = 0;
+			for (int p = 1; p < 4; p++) {
+				float d = distance2(pixels[i], palette[p]);
+				if (d < best) {
+					best = d;
+					indices[i] = p;
+				}
+			}
+			error += best;
+		}
+		return error;
+	}
+
+	// Endpoints along the principal axis of the block colors, then refined by least squares
+	// on the chosen indices while that lowers the error. Always in the four color mode (c0 > c1),
+	// which BC3 requires.
+	void encodeBc1Block(const unsigned char* rgba, unsigned char* out)
+	{
+		Color pixels[16];
+		Color mean = { 0, 0, 0 };
+		for (int i = 0; i < 16; i++) {
+			pixels[i] = Color{ float(rgba[i * 4]), float(rgba[i * 4 + 1]), float(rgba[i * 4 + 2]) };
+			mean.r += pixels[i].r / 16;
+			mean.g += pixels[i].g / 16;
+			mean.b += pixels[i].b / 16;
+		}
+
+		float covariance[6] = {};
+		for (int i = 0; i < 16; i++) {
+			float r = pixels[i].r - mean.r, g = pixels[i].g - mean.g, b = pixels[i].b - mean.b;
+			covariance[0] += r * r; covariance[1] += r * g; covariance[2] += r * b;
+			covariance[3] += g * g; covariance[4] += g * b; covariance[5] += b * b;
+		}
+		float axis[3] = { 1, 1, 1 };
+		for (int iteration = 0; iteration < 8; iteration++) {
+			float x = covariance[0] * axis[0] + covariance[1] * axis[1] + covariance[2] * axis[2];
+			float y = covariance[1] * axis[0] + covariance[3] * axis[1] + covariance[4] * axis[2];
+			float z = covariance[2] * axis[0] + covariance[4] * axis[1] + covariance[5] * axis[2];
+			float length = std::max(std::fabs(x), std::max(std::fabs(y), std::fabs(z)));
+			if (length <= 0.0f)
+				break;
+			axis[0] = x / length; axis[1] = y / length; axis[2] = z / length;
+		}
+		float minProjection = 1e30f, maxProjection = -1e30f;
+		for (int i = 0; i < 16; i++) {
+			float t = (pixels[i].r - mean.r) * axis[0] + (pixels[i].g - mean.g) * axis[1] + (pixels[i].b - mean.b) * axis[2];
+			minProjection = std::min(minProjection, t);
+			maxProjection = std::max(maxProjection, t);
+		}
+		float axisLength2 = axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2];
+		if (axisLength2 > 0.0f) {
+			minProjection /= axisLength2;
+			maxProjection /= axisLength2;
+		}
+		Color end0 = { mean.r + axis[0] * maxProjection, mean.g + axis[1] * maxProjection, mean.b + axis[2] * maxProjection };
+		Color end1 = { mean.r + axis[0] * minProjection, mean.g + axis[1] * minProjection, mean.b + axis[2] * minProjection };
+
+		uint16_t c0 = packColor565(end0), c1 = packColor565(end1);
+		int indices[16];
+		float error = bc1Indices(pixels, c0, c1, indices);
+		for (int iteration = 0; iteration < 4 && error > 0.0f; iteration++) {
+			// weights of end0 for the palette entries
+			static const float weights[4] = { 1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f };
+			float aa = 0, ab = 0, bb = 0;
+			Color ax = { 0, 0, 0 }, bx = { 0, 0, 0 };
+			for (int i = 0; i < 16; i++) {
+				float a = weights[indices[i]], b = 1.0f - a;
+				aa += a * a; ab += a * b; bb += b * b;
+				ax.r += a * pixels[i].r; ax.g += a * pixels[i].g; ax.b += a * pixels[i].b;
+				bx.r += b * pixels[i].r; bx.g += b * pixels[i].g; bx.b += b * pixels[i].b;
+			}
+			float determinant = aa * bb - ab * ab;
+			if (std::fabs(determinant) < 1e-6f)
+				break;
+			Color fit0 = { (ax.r * bb - bx.r * ab) / determinant, (ax.g * bb - bx.g * ab) / determinant, (ax.b * bb - bx.b * ab) / determinant };
+			Color fit1 = { (bx.r * aa - ax.r * ab) / determinant, (bx.g * aa - ax.g * ab) / determinant, (bx.b * aa - ax.b * ab) / determinant };
+			uint16_t f0 = packColor565(fit0), f1 = packColor565(fit1);
+			if (f0 < f1)
+				std::swap(f0, f1);
+			int fitIndices[16];
+			float fitError = bc1Indices(pixels, f0, f1, fitIndices);
+			if (fitError >= error)
+				break;
+			c0 = f0;
+			c1 = f1;
+			error = fitError;
+			std::copy(fitIndices, fitIndices + 16, indices);
+		}
+
+		if (c0 < c1) {
+			std::swap(c0, c1);
+			static const int swapped[4] = { 1, 0, 3, 2 };
+			for (int i = 0; i < 16; i++)
+				indices[i] = swapped[indices[i]];
+		}
+		if (c0 == c1)
+			std::fill(indices, indices + 16, 0);
+
+		uint32_t bits = 0;
+		for (int i = 0; i < 16; i++)
+			bits |= (uint32_t)indices[i] << (2 * i);
+		out[0] = c0 & 0xff; out[1] = c0 >> 8;
+		out[2] = c1 & 0xff; out[3] = c1 >> 8;
+		for (int i = 0; i < 4; i++)
+			out[4 + i] = bits >> (8 * i) & 0xff;
+	}
+
+	void decodeBc1Block(const unsigned char* block, unsigned char* rgba)
+	{
+		uint16_t c0 = block[0] | block[1] << 8, c1 = block[2] | block[3] << 8;
+		Color palette[4];
+		bc1Palette(c0, c1, palette);
+		bool threeColors = c0 <= c1;
+		if (threeColors) {
+			palette[2] = Color{ (palette[0].r + palette[1].r) / 2, (palette[0].g + palette[1].g) / 2, (palette[0].b + palette[1].b) / 2 };
+			palette[3] = Color{ 0, 0, 0 };
+		}
+		uint32_t bits = block[4] | block[5] << 8 | block[6] << 16 | (uint32_t)block[7] << 24;
+		for (int i = 0; i < 16; i++) {
+			int index = bits >> (2 * i) & 3;
+			rgba[i * 4] = (unsigned char)(palette[index].r + 0.5f);
+			rgba[i * 4 + 1] = (unsigned char)(palette[index].g + 0.5f);
+			rgba[i * 4 + 2] = (unsigned char)(palette[index].b + 0.5f);
+			rgba[i * 4 + 3] = threeColors && index == 3 ? 0 : 255;
+		}
+	}
+
+	// the eight values of a BC4 block with a0 > a1
+	void bc4Palette(int a0, int a1, int palette[8])
+	{
+		palette[0] = a0;
+		palette[1] = a1;
+		if (a0 > a1) {
+			for (int i = 1; i < 7; i++)
+				palette[i + 1] = ((7 - i) * a0 + i * a1 + 3) / 7;
+		}
+		else {
+			for (int i = 1; i < 5; i++)
+				palette[i + 1] = ((5 - i) * a0 + i * a1 + 2) / 5;
+			palette[6] = 0;
+			palette[7] = 255;
+		}
+	}
+
+	// one channel (stride 4 bytes apart) of a 4x4 block
+	void encodeBc4Block(const unsigned char* values, unsigned char* out)
+	{
+		int a0 = 0, a1 = 255;
+		for (int i = 0; i < 16; i++) {
+			a0 = std::max(a0, (int)values[i * 4]);
+			a1 = std::min(a1, (int)values[i * 4]);
+		}
+		out[0] = (unsigned char)a0;
+		out[1] = (unsigned char)a1;
+		uint64_t bits = 0;
+		if (a0 > a1) {
+			int palette[8];
+			bc4Palette(a0, a1, palette);
+			for (int i = 0; i < 16; i++) {
+				int best = 0;
+				for (int p = 1; p < 8; p++)
+					if (std::abs(palette[p] - values[i * 4]) < std::abs(palette[best] - values[i * 4]))
+						best = p;
+				bits |= (uint64_t)best << (3 * i);
+			}
+		}
+		for (int i = 0; i < 6; i++)
+			out[2 + i] = bits >> (8 * i) & 0xff;
+	}
+
+	void decodeBc4Block(const unsigned char* block, unsigned char* values)
+	{
+		int palette[8];
+		bc4Palette(block[0], block[1], palette);
+		uint64_t bits = 0;
+		for (int i = 0; i < 6; i++)
+			bits |= (uint64_t)block[2 + i] << (8 * i);
+		for (int i = 0; i < 16; i++)
+			values[i * 4] = (unsigned char)palette[bits >> (3 * i) & 7];
+	}
+
+	const uint32_t DDS_MAGIC = 0x20534444; // "DDS "
+	const uint32_t DDSD_CAPS = 0x1, DDSD_HEIGHT = 0x2, DDSD_WIDTH = 0x4, DDSD_PIXELFORMAT = 0x1000, DDSD_MIPMAPCOUNT = 0x20000, DDSD_LINEARSIZE = 0x80000;
+	const uint32_t DDPF_FOURCC = 0x4;
+	const uint32_t DDSCAPS_COMPLEX = 0x8, DDSCAPS_TEXTURE = 0x1000, DDSCAPS_MIPMAP = 0x400000;
+
+	struct DdsHeader {
+		uint32_t size;
+		uint32_t flags;
+		uint32_t height;
+		uint32_t width;
+		uint32_t pitchOrLinearSize;
+		uint32_t depth;
+		uint32_t mipMapCount;
+		uint32_t reserved1[11];
+		uint32_t pixelFormatSize;
+		uint32_t pixelFormatFlags;
+		uint32_t fourCC;
+		uint32_t rgbBitCount;
+		uint32_t bitMasks[4];
+		uint32_t caps[4];
+		uint32_t reserved2;
+	};
+
+	uint32_t fourCC(const char* code)
+	{
+		return (uint32_t)code[0] | (uint32_t)code[1] << 8 | (uint32_t)code[2] << 16 | (uint32_t)code[3] << 24;
+	}
+
+	uint32_t fourCCOf(Core::BlockFormat format)
+	{
+		return fourCC(format == Core::BlockFormat::BC1 ? "DXT1" : format == Core::BlockFormat::BC3 ? "DXT5" : "ATI2");
+	}
+}
+
+int Core::blockBytes(BlockFormat format)
+{
+	return format == BlockFormat::BC1 ? 8 : 16;
+}
+
+size_t Core::compressedSize(BlockFormat format, int width, int height)
+{
+	return (size_t)((width + 3) / 4) * ((height + 3) / 4) * blockBytes(format);
+}
+
+void Core::compressImage(const unsigned char* rgba, int width, int height, BlockFormat format, std::vector<unsigned char>& result)
+{
+	int blocksX = (width + 3) / 4, blocksY = (height + 3) / 4;
+	int bytes = blockBytes(format);
+	result.resize((size_t)blocksX * blocksY * bytes);
+	unsigned char block[64];
+	for (int by = 0; by < blocksY; by++) {
+		for (int bx = 0; bx < blocksX; bx++) {
+			// blocks over the edge repeat the last row and column
+			for (int y = 0; y < 4; y++)
+				for (int x = 0; x < 4; x++)
+					std::memcpy(&block[(y * 4 + x) * 4], &rgba[((size_t)std::min(by * 4 + y, height - 1) * width + std::min(bx * 4 + x, width - 1)) * 4], 4);
+
+			unsigned char* out = &result[((size_t)by * blocksX + bx) * bytes];
+			if (format == BlockFormat::BC1) {
+				encodeBc1Block(block, out);
+			}
+			else if (format == BlockFormat::BC3) {
+				encodeBc4Block(block + 3, out);
+				encodeBc1Block(block, out + 8);
+			}
+			else {
+				encodeBc4Block(block, out);
+				encodeBc4Block(block + 1, out + 8);
+			}
+		}
+	}
+}
+
+void Core::decompressImage(const unsigned char* blocks, int width, int height, BlockFormat format, std::vector<unsigned char>& rgba)
+{
+	int blocksX = (width + 3) / 4, blocksY = (height + 3) / 4;
+	int bytes = blockBytes(format);
+	rgba.resize((size_t)width * height * 4);
+	unsigned char block[64];
+	for (int by = 0; by < blocksY; by++) {
+		for (int bx = 0; bx < blocksX; bx++) {
+			const unsigned char* in = &blocks[((size_t)by * blocksX + bx) * bytes];
+			if (format == BlockFormat::BC1) {
+				decodeBc1Block(in, block);
+			}
+			else if (format == BlockFormat::BC3) {
+				decodeBc1Block(in + 8, block);
+				decodeBc4Block(in, block + 3);
+			}
+			else {
+				decodeBc4Block(in, block);
+				decodeBc4Block(in + 8, block + 1);
+				for (int i = 0; i < 16; i++) {
+					block[i * 4 + 2] = 0;
+					block[i * 4 + 3] = 255;
+				}
+			}
+			for (int y = 0; y < 4 && by * 4 + y < height; y++)
+				for (int x = 0; x < 4 && bx * 4 + x < width; x++)
+					std::memcpy(&rgba[((size_t)(by * 4 + y) * width + bx * 4 + x) * 4], &block[(y * 4 + x) * 4], 4);
+		}
+	}
+}
+
+bool Core::writeDds(const std::string& path, const CompressedImage& image)
+{
+	if (image.levels.empty())
+		return false;
+	DdsHeader header;
+	std::memset(&header, 0, sizeof(header));
+	header.size = 124;
+	header.flags = DDSD_CAPS | DDSD_HEIGHT | DDSD_WIDTH | DDSD_PIXELFORMAT | DDSD_MIPMAPCOUNT | DDSD_LINEARSIZE;
+	header.height = image.levels[0].height;
+	header.width = image.levels[0].width;
+	header.pitchOrLinearSize = (uint32_t)image.levels[0].data.size();
+	header.mipMapCount = (uint32_t)image.levels.size();
+	header.pixelFormatSize = 32;
+	header.pixelFormatFlags = DDPF_FOURCC;
+	header.fourCC = fourCCOf(image.format);
+	header.caps[0] = DDSCAPS_TEXTURE | (image.levels.size() > 1 ? DDSCAPS_COMPLEX | DDSCAPS_MIPMAP : 0);
+
+	// write to a temporary file first so a crashed run never leaves a half written file behind
+	std::string tempPath = path + ".tmp";
+	FILE* out = std::fopen(tempPath.c_str(), "wb");
+	if (!out)
+		return false;
+	bool ok = std::fwrite(&DDS_MAGIC, 4, 1, out) == 1 && std::fwrite(&header, sizeof(header), 1, out) == 1;
+	for (const auto& level : image.levels)
+		ok = ok && std::fwrite(level.data.data(), 1, level.data.size(), out) == level.data.size();
+	ok = std::fclose(out) == 0 && ok;
+	if (!ok) {
+		std::remove(tempPath.c_str());
+		return false;
+	}
+	std::remove(path.c_str());
+	return std::rename(tempPath.c_str(), path.c_str()) == 0;
+}
+
+bool Core::readDds(const std::string& path, CompressedImage& image)
+{
+	FILE* in = std::fopen(path.c_str(), "rb");
+	if (!in)
+		return false;
+	uint32_t magic = 0;
+	DdsHeader header;
+	bool ok = std::fread(&magic, 4, 1, in) == 1 && std::fread(&header, sizeof(header), 1, in) == 1
+		&& magic == DDS_MAGIC && header.size == 124 && (header.pixelFormatFlags & DDPF_FOURCC) && header.width > 0 && header.height > 0;
+	if (ok) {
+		if (header.fourCC == fourCC("DXT1"))
+			image.format = BlockFormat::BC1;
+		else if (header.fourCC == fourCC("DXT5"))
+			image.format = BlockFormat::BC3;
+		else if (header.fourCC == fourCC("ATI2"))
+			image.format = BlockFormat::BC5;
+		else
+			ok = false;
+	}
+
+	image.levels.clear();
+	int width = header.width, height = header.height;
+	int levelCount = ok ? std::max(1u, header.mipMapCount) : 0;
+	for (int i = 0; i < levelCount && ok; i++) {
+		CompressedLevel level;
+		level.width = width;
+		level.height = height;
+		level.data.resize(compressedSize(image.format, width, height));
+		ok = std::fread(level.data.data(), 1, level.data.size(), in) == level.data.size();
+		image.levels.push_back(std::move(level));
+		width = std::max(1, width / 2);
+		height = std::max(1, height / 2);
+	}
+	std::fclose(in);
+	return ok;
+}
@@ -0,0 +1,37 @@
+#pragma once
+#include <string>
+#include <vector>
+
+namespace Core
+{
+	// block compressed formats of 4x4 pixel blocks: BC1 (RGB, 8 bytes), BC3 (RGBA, BC1 color and
+	// a BC4 alpha block, 16 bytes), BC5 (two BC4 channels, 16 bytes, for normal maps and other
+	// two-channel data)
+	enum class BlockFormat { BC1, BC3, BC5 };
+
+	int blockBytes(BlockFormat format);
+	// bytes of a level of width x height pixels
+	size_t compressedSize(BlockFormat format, int width, int height);
+
+	struct CompressedLevel {
+		int width;
+		int height;
+		std::vector<unsigned char> data;
+	};
+
+	// a block compressed image with its mip chain, level 0 is the full size
+	struct CompressedImage {
+		BlockFormat format = BlockFormat::BC1;
+		std::vector<CompressedLevel> levels;
+	};
+
+	// rgba - width * height * 4 bytes, rows in the order they should be stored
+	void compressImage(const unsigned char* rgba, int width, int height, BlockFormat format, std::vector<unsigned char>& result);
+	// fills rgba (width * height * 4 bytes); BC5 decodes to red and green, blue 0 and alpha 255
+	void decompressImage(const unsigned char* blocks, int width, int height, BlockFormat format, std::vector<unsigned char>& rgba);
+
+	// DDS files with the DXT1, DXT5 and ATI2 (BC5) four character codes. The textures are stored
+	// bottom row first, as OpenGL expects them, which is flipped compared to other DDS writers.
+	bool writeDds(const std::string& path, const CompressedImage& image);
+	bool readDds(const std::string& path, CompressedImage& image);
+}
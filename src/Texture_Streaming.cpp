@@ -0,0 +1,188 @@
+#include "Texture_Streaming.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include "stb_image.h"
+
+void Core::ImageDecoder::start(int threadCount)
+{
+	if (running())
+		return;
+	if (threadCount <= 0)
+		threadCount = std::max(1, (int)std::thread::hardware_concurrency() - 1);
+	stopping = false;
+	for (int i = 0; i < threadCount; i++)
+		workers.push_back(std::thread(&ImageDecoder::work, this));
+}
+
+void Core::ImageDecoder::stop()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	wake.notify_all();
+	for (auto& worker : workers)
+		worker.join();
+	workers.clear();
+
+	requests.clear();
+	for (auto& image : decoded)
+		freePixels(image);
+	decoded.clear();
+	pending = 0;
+}
+
+void Core::ImageDecoder::request(GLuint texture, const std::string& path, bool flipVertically)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		requests.push_back(Request{ texture, path, flipVertically });
+		pending++;
+	}
+	wake.notify_one();
+}
+
+bool Core::ImageDecoder::pop(DecodedImage& image)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	if (decoded.empty())
+		return false;
+	image = decoded.front();
+	decoded.pop_front();
+	pending--;
+	return true;
+}
+
+int Core::ImageDecoder::pendingCount() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return pending;
+}
+
+void Core::ImageDecoder::freePixels(DecodedImage& image)
+{
+	stbi_image_free(image.pixels);
+	image.pixels = nullptr;
+}
+
+void Core::ImageDecoder::work()
+{
+	for (;;) {
+		Request request;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			wake.wait(lock, [this] { return stopping || !requests.empty(); });
+			if (stopping)
+				return;
+			request = requests.front();
+			requests.pop_front();
+		}
+
+		auto start = std::chrono::steady_clock::now();
+		DecodedImage image;
+		image.texture = request.texture;
+		image.path = request.path;
+		// the flag of stbi_set_flip_vertically_on_load is shared by all threads, this one is not
+		stbi_set_flip_vertically_on_load_thread(request.flipVertically);
+		image.pixels = stbi_load(request.path.c_str(), &image.width, &image.height, &image.components, 0);
+		image.decodeMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+		std::lock_guard<std::mutex> lock(mutex);
+		if (stopping) {
+			freePixels(image);
+			return;
+		}
+		decoded.push_back(image);
+	}
+}
+
+void Core::PixelUploader::init(size_t ringSize)
+{
+	if (buffer || !(GLEW_VERSION_4_4 || GLEW_ARB_buffer_storage))
+		return;
+	GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+	glGenBuffers(1, &buffer);
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+	glBufferStorage(GL_PIXEL_UNPACK_BUFFER, ringSize, NULL, flags);
+	mapped = (unsigned char*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, ringSize, flags);
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	if (!mapped) {
+		glDeleteBuffers(1, &buffer);
+		buffer = 0;
+		return;
+	}
+	capacity = ringSize;
+	head = 0;
+}
+
+void Core::PixelUploader::destroy()
+{
+	for (auto& region : inFlight)
+		glDeleteSync(region.fence);
+	inFlight.clear();
+	if (buffer) {
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+		glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		glDeleteBuffers(1, &buffer);
+	}
+	buffer = 0;
+	mapped = nullptr;
+	capacity = 0;
+}
+
+size_t Core::PixelUploader::allocate(size_t size)
+{
+	// uploads the GPU has finished with
+	while (!inFlight.empty() && glClientWaitSync(inFlight.front().fence, 0, 0) != GL_TIMEOUT_EXPIRED) {
+		glDeleteSync(inFlight.front().fence);
+		inFlight.pop_front();
+	}
+
+	if (head + size > capacity)
+		head = 0;
+	for (auto region = inFlight.begin(); region != inFlight.end();) {
+		if (region->offset < head + size && head < region->offset + region->size) {
+			glClientWaitSync(region->fence, GL_SYNC_FLUSH_COMMANDS_BIT, GLuint64(1000000000));
+			glDeleteSync(region->fence);
+			region = inFlight.erase(region);
+		}
+		else {
+			++region;
+		}
+	}
+
+	size_t offset = head;
+	head = (offset + size + 15) & ~(size_t)15;
+	return offset;
+}
+
+GLenum Core::PixelUploader::internalFormat(int components)
+{
+	return components == 1 ? GL_R8 : components == 2 ? GL_RG8 : components == 3 ? GL_RGB8 : GL_RGBA8;
+}
+
+void Core::PixelUploader::upload(GLuint texture, const unsigned char* pixels, int width, int height, int components)
+{
+	GLenum format = components == 1 ? GL_RED : components == 2 ? GL_RG : components == 3 ? GL_RGB : GL_RGBA;
+	GLenum sizedFormat = internalFormat(components);
+	size_t size = (size_t)width * height * components;
+
+	glBindTexture(GL_TEXTURE_2D, texture);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	if (mapped && size <= capacity) {
+		size_t offset = allocate(size);
+		std::memcpy(mapped + offset, pixels, size);
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+		glTexImage2D(GL_TEXTURE_2D, 0, sizedFormat, width, height, 0, format, GL_UNSIGNED_BYTE, (void*)offset);
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		inFlight.push_back(Region{ offset, size, glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0) });
+	}
+	else {
+		glTexImage2D(GL_TEXTURE_2D, 0, sizedFormat, width, height, 0, format, GL_UNSIGNED_BYTE, pixels);
+	}
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	glGenerateMipmap(GL_TEXTURE_2D);
+}
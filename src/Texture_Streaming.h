@@ -0,0 +1,97 @@
+#pragma once
+#include "glew.h"
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace Core
+{
+	// an image decoded by an ImageDecoder worker, pixels is null when the file could not be decoded
+	struct DecodedImage {
+		GLuint texture = 0;
+		std::string path;
+		unsigned char* pixels = nullptr;
+		int width = 0;
+		int height = 0;
+		int components = 0;
+		double decodeMs = 0.0;
+
+		size_t size() const { return (size_t)width * height * components; }
+	};
+
+	// Decodes image files with stb_image on a pool of worker threads. Requests are decoded in
+	// the order they came, finished images wait until the main thread pops them.
+	class ImageDecoder
+	{
+	public:
+		~ImageDecoder() { stop(); }
+
+		// threadCount 0 - one thread per core but the one running the main thread
+		void start(int threadCount = 0);
+		// waits for the workers, the work not finished yet is dropped
+		void stop();
+		bool running() const { return !workers.empty(); }
+
+		void request(GLuint texture, const std::string& path, bool flipVertically);
+		// false when no decoded image is waiting, free the pixels of a popped image with freePixels
+		bool pop(DecodedImage& image);
+		// requested and not popped yet
+		int pendingCount() const;
+
+		static void freePixels(DecodedImage& image);
+
+	private:
+		struct Request {
+			GLuint texture;
+			std::string path;
+			bool flipVertically;
+		};
+
+		void work();
+
+		std::vector<std::thread> workers;
+		mutable std::mutex mutex;
+		std::condition_variable wake;
+		std::deque<Request> requests;
+		std::deque<DecodedImage> decoded;
+		int pending = 0;
+		bool stopping = false;
+	};
+
+	// Uploads pixels to textures through a ring buffer of persistently mapped pixel unpack
+	// memory (OpenGL 4.4 or ARB_buffer_storage), so the copy to the GPU does not stall the main
+	// thread. A fence per upload keeps its part of the ring from being overwritten before the GPU
+	// has read it. Without buffer storage (or before init) and for images larger than the ring the
+	// pixels are uploaded straight from client memory.
+	class PixelUploader
+	{
+	public:
+		void init(size_t ringSize = 32 << 20);
+		void destroy();
+
+		// replaces level 0 of the texture, builds its mipmaps and leaves it bound to GL_TEXTURE_2D
+		void upload(GLuint texture, const unsigned char* pixels, int width, int height, int components);
+
+		// sized format the textures of images with that many components get (GL_R8 ... GL_RGBA8)
+		static GLenum internalFormat(int components);
+
+	private:
+		struct Region {
+			size_t offset;
+			size_t size;
+			GLsync fence;
+		};
+
+		// offset of size bytes of the ring the GPU no longer reads, waits for it when necessary
+		size_t allocate(size_t size);
+
+		GLuint buffer = 0;
+		unsigned char* mapped = nullptr;
+		size_t capacity = 0;
+		size_t head = 0;
+		std::deque<Region> inFlight;
+	};
+}
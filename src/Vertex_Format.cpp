@@ -0,0 +1,200 @@
+#include "Vertex_Format.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+
+int Core::vertexStride(VertexFormat format)
+{
+	switch (format) {
+	case VertexFormat::Quantized: return sizeof(QuantizedVertex);
+	case VertexFormat::Interleaved: return sizeof(InterleavedVertex);
+	default: return 0;
+	}
+}
+
+void Core::meshBounds(aiMesh* mesh, glm::vec3& boundsMin, glm::vec3& boundsMax)
+{
+	boundsMin = boundsMax = glm::vec3(0.0f);
+	for (unsigned int i = 0; i < mesh->mNumVertices; i++) {
+		glm::vec3 p(mesh->mVertices[i].x, mesh->mVertices[i].y, mesh->mVertices[i].z);
+		boundsMin = i ? glm::min(boundsMin, p) : p;
+		boundsMax = i ? glm::max(boundsMax, p) : p;
+	}
+}
+
+static float signNotZero(float value)
+{
+	return value >= 0.0f ? 1.0f : -1.0f;
+}
+
+glm::vec2 Core::octahedralEncode(glm::vec3 n)
+{
+	float length = fabs(n.x) + fabs(n.y) + fabs(n.z);
+	if (length == 0.0f)
+		return glm::vec2(0.0f);
+	n /= length;
+	glm::vec2 e(n.x, n.y);
+	if (n.z < 0.0f) {
+		e.x = (1.0f - fabs(n.y)) * signNotZero(n.x);
+		e.y = (1.0f - fabs(n.x)) * signNotZero(n.y);
+	}
+	return e;
+}
+
+glm::vec3 Core::octahedralDecode(glm::vec2 e)
+{
+	glm::vec3 n(e.x, e.y, 1.0f - fabs(e.x) - fabs(e.y));
+	if (n.z < 0.0f) {
+		n.x = (1.0f - fabs(e.y)) * signNotZero(e.x);
+		n.y = (1.0f - fabs(e.x)) * signNotZero(e.y);
+	}
+	return glm::normalize(n);
+}
+
+static void storePacked(void* destination, glm::uint value)
+{
+	memcpy(destination, &value, sizeof(value));
+}
+
+static glm::uint loadPacked(const void* source)
+{
+	glm::uint value;
+	memcpy(&value, source, sizeof(value));
+	return value;
+}
+
+void Core::packVertices(aiMesh* mesh, VertexFormat format, PackedVertices& result)
+{
+	unsigned int count = mesh->mNumVertices;
+	result.stride = vertexStride(format);
+	result.data.assign((size_t)count * result.stride, 0);
+	result.positionDequantization = glm::mat4();
+
+	glm::vec3 boundsMin, boundsMax;
+	meshBounds(mesh, boundsMin, boundsMax);
+	result.boundsMin = boundsMin;
+	result.boundsMax = boundsMax;
+	// a single scale for all axes keeps the dequantization matrix free of non-uniform scaling,
+	// so normals transformed with the model matrix stay correct
+	glm::vec3 center = (boundsMin + boundsMax) * 0.5f;
+	glm::vec3 halfExtent = (boundsMax - boundsMin) * 0.5f;
+	float scale = std::max(halfExtent.x, std::max(halfExtent.y, halfExtent.z));
+	if (scale <= 0.0f)
+		scale = 1.0f;
+
+	for (unsigned int i = 0; i < count; i++) {
+		glm::vec3 position(mesh->mVertices[i].x, mesh->mVertices[i].y, mesh->mVertices[i].z);
+		glm::vec3 normal = mesh->mNormals ? glm::vec3(mesh->mNormals[i].x, mesh->mNormals[i].y, mesh->mNormals[i].z) : glm::vec3(0, 1, 0);
+		glm::vec2 texCoord = mesh->mTextureCoords[0] ? glm::vec2(mesh->mTextureCoords[0][i].x, mesh->mTextureCoords[0][i].y) : glm::vec2(0.0f);
+		glm::vec3 tangent = mesh->mTangents ? glm::vec3(mesh->mTangents[i].x, mesh->mTangents[i].y, mesh->mTangents[i].z) : glm::vec3(0.0f);
+		glm::vec3 bitangent = mesh->mBitangents ? glm::vec3(mesh->mBitangents[i].x, mesh->mBitangents[i].y, mesh->mBitangents[i].z) : glm::vec3(0.0f);
+
+		if (format == VertexFormat::Interleaved) {
+			InterleavedVertex& vertex = ((InterleavedVertex*)&result.data[0])[i];
+			vertex.position = position;
+			vertex.normal = normal;
+			vertex.texCoord = texCoord;
+			vertex.tangent = tangent;
+			vertex.bitangent = bitangent;
+			continue;
+		}
+
+		QuantizedVertex& vertex = ((QuantizedVertex*)&result.data[0])[i];
+		glm::vec3 q = (position - center) / scale;
+		storePacked(&vertex.position[0], glm::packHalf2x16(glm::vec2(q.x, q.y)));
+		storePacked(&vertex.position[2], glm::packHalf2x16(glm::vec2(q.z, 1.0f)));
+		storePacked(&vertex.normal[0], glm::packSnorm2x16(octahedralEncode(normal)));
+		storePacked(&vertex.texCoord[0], glm::packHalf2x16(texCoord));
+		float bitangentSign = glm::dot(glm::cross(normal, tangent), bitangent) < 0.0f ? -1.0f : 1.0f;
+		storePacked(&vertex.tangent[0], glm::packSnorm2x16(octahedralEncode(tangent)));
+		storePacked(&vertex.tangent[2], glm::packSnorm2x16(glm::vec2(bitangentSign, 0.0f)));
+	}
+
+	if (format == VertexFormat::Quantized)
+		result.positionDequantization = glm::translate(center) * glm::scale(glm::vec3(scale));
+}
+
+void Core::setVertexAttributes(VertexFormat format, size_t offset)
+{
+	for (int i = 0; i < 5; i++)
+		glEnableVertexAttribArray(i);
+
+	if (format == VertexFormat::Quantized) {
+		GLsizei stride = sizeof(QuantizedVertex);
+		glVertexAttribPointer(0, 4, GL_HALF_FLOAT, GL_FALSE, stride, (void*)(offset + offsetof(QuantizedVertex, position)));
+		glVertexAttribPointer(1, 2, GL_SHORT, GL_TRUE, stride, (void*)(offset + offsetof(QuantizedVertex, normal)));
+		glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, stride, (void*)(offset + offsetof(QuantizedVertex, texCoord)));
+		glVertexAttribPointer(3, 4, GL_SHORT, GL_TRUE, stride, (void*)(offset + offsetof(QuantizedVertex, tangent)));
+		// the bitangent is rebuilt from normal, tangent and the sign stored in tangent.z
+		glDisableVertexAttribArray(4);
+		return;
+	}
+
+	GLsizei stride = sizeof(InterleavedVertex);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (void*)(offset + offsetof(InterleavedVertex, position)));
+	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, stride, (void*)(offset + offsetof(InterleavedVertex, normal)));
+	glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, stride, (void*)(offset + offsetof(InterleavedVertex, texCoord)));
+	glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, stride, (void*)(offset + offsetof(InterleavedVertex, tangent)));
+	glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, stride, (void*)(offset + offsetof(InterleavedVertex, bitangent)));
+}
+
+void Core::setInstanceMatrixAttribute(int location)
+{
+	for (int column = 0; column < 4; column++) {
+		glEnableVertexAttribArray(location + column);
+		glVertexAttribPointer(location + column, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void*)(sizeof(glm::vec4) * column));
+		glVertexAttribDivisor(location + column, 1);
+	}
+}
+
+void Core::decodeQuantizedVertex(const QuantizedVertex& vertex, const glm::mat4& positionDequantization,
+	glm::vec3& position, glm::vec3& normal, glm::vec2& texCoord, glm::vec3& tangent, float& bitangentSign)
+{
+	glm::vec2 xy = glm::unpackHalf2x16(loadPacked(&vertex.position[0]));
+	glm::vec2 zw = glm::unpackHalf2x16(loadPacked(&vertex.position[2]));
+	position = glm::vec3(positionDequantization * glm::vec4(xy.x, xy.y, zw.x, 1.0f));
+	normal = octahedralDecode(glm::unpackSnorm2x16(loadPacked(&vertex.normal[0])));
+	texCoord = glm::unpackHalf2x16(loadPacked(&vertex.texCoord[0]));
+	tangent = octahedralDecode(glm::unpackSnorm2x16(loadPacked(&vertex.tangent[0])));
+	bitangentSign = glm::unpackSnorm2x16(loadPacked(&vertex.tangent[2])).x < 0.0f ? -1.0f : 1.0f;
+}
+
+// angle between two directions, atan2 keeps it exact for tiny angles where acos of the dot is not
+static float angleDegrees(glm::vec3 a, glm::vec3 b)
+{
+	return glm::degrees(atan2f(glm::length(glm::cross(a, b)), glm::dot(a, b)));
+}
+
+Core::QuantizationError Core::measureQuantizationError(aiMesh* mesh, const PackedVertices& packed)
+{
+	QuantizationError error;
+	glm::mat4 inverse = glm::inverse(packed.positionDequantization);
+	for (unsigned int i = 0; i < mesh->mNumVertices; i++) {
+		glm::vec3 position, normal, tangent;
+		glm::vec2 texCoord;
+		float sign;
+		decodeQuantizedVertex(((const QuantizedVertex*)&packed.data[0])[i], packed.positionDequantization, position, normal, texCoord, tangent, sign);
+
+		glm::vec3 original(mesh->mVertices[i].x, mesh->mVertices[i].y, mesh->mVertices[i].z);
+		error.position = std::max(error.position, glm::length(glm::vec3(inverse * glm::vec4(position - original, 0.0f))));
+		glm::vec3 n = mesh->mNormals ? glm::vec3(mesh->mNormals[i].x, mesh->mNormals[i].y, mesh->mNormals[i].z) : glm::vec3(0.0f);
+		if (glm::length(n) > 0.0f)
+			error.normal = std::max(error.normal, angleDegrees(glm::normalize(n), normal));
+		if (mesh->mTextureCoords[0]) {
+			glm::vec2 uv(mesh->mTextureCoords[0][i].x, mesh->mTextureCoords[0][i].y);
+			error.texCoord = std::max(error.texCoord, glm::length(uv - texCoord));
+		}
+		if (mesh->mTangents && mesh->mBitangents && glm::length(n) > 0.0f) {
+			glm::vec3 t(mesh->mTangents[i].x, mesh->mTangents[i].y, mesh->mTangents[i].z);
+			glm::vec3 b(mesh->mBitangents[i].x, mesh->mBitangents[i].y, mesh->mBitangents[i].z);
+			if (glm::length(t) > 0.0f) {
+				error.tangent = std::max(error.tangent, angleDegrees(glm::normalize(t), tangent));
+				if ((glm::dot(glm::cross(n, t), b) < 0.0f) != (sign < 0.0f))
+					error.bitangentSignErrors++;
+			}
+		}
+	}
+	return error;
+}
@@ -0,0 +1,81 @@
+#pragma once
+#include "glm.hpp"
+#include "ext.hpp"
+#include "glew.h"
+#include <assimp/scene.h>
+#include <vector>
+
+namespace Core
+{
+	// Layout of the vertex data uploaded for Assimp meshes.
+	// Planar      - separate float arrays of positions, normals, uvs, tangents and bitangents (56 bytes per vertex)
+	// Interleaved - the same float attributes interleaved per vertex (56 bytes per vertex)
+	// Quantized   - interleaved and compressed to 24 bytes per vertex, see QuantizedVertex
+	enum class VertexFormat { Planar, Interleaved, Quantized };
+
+	struct InterleavedVertex {
+		glm::vec3 position;
+		glm::vec3 normal;
+		glm::vec2 texCoord;
+		glm::vec3 tangent;
+		glm::vec3 bitangent;
+	};
+
+	// position - half floats of (position - center) / scale, so the mesh fits into [-1, 1]; w is 1
+	// normal   - octahedral encoding, 2 x snorm16
+	// texCoord - half floats
+	// tangent  - octahedral encoding in xy, sign of the bitangent (+1/-1) in z, all snorm16
+	struct QuantizedVertex {
+		unsigned short position[4];
+		short normal[2];
+		unsigned short texCoord[2];
+		short tangent[4];
+	};
+
+	// Vertex data of a mesh ready to be copied into a vertex buffer. For quantized data
+	// positionDequantization maps the stored positions back to mesh space (identity otherwise).
+	struct PackedVertices {
+		std::vector<char> data;
+		int stride = 0;
+		glm::mat4 positionDequantization;
+		glm::vec3 boundsMin;
+		glm::vec3 boundsMax;
+	};
+
+	int vertexStride(VertexFormat format);
+
+	// axis aligned bounds of the mesh vertices
+	void meshBounds(aiMesh* mesh, glm::vec3& boundsMin, glm::vec3& boundsMax);
+
+	// packs the vertices of the mesh into the interleaved or quantized layout (not Planar)
+	void packVertices(aiMesh* mesh, VertexFormat format, PackedVertices& result);
+
+	// sets the attribute pointers 0-4 for packed vertex data starting at offset in the bound GL_ARRAY_BUFFER
+	void setVertexAttributes(VertexFormat format, size_t offset = 0);
+
+	// sets a per-instance mat4 attribute (locations location..location+3) reading tightly packed
+	// matrices from the bound GL_ARRAY_BUFFER
+	void setInstanceMatrixAttribute(int location);
+
+	glm::vec2 octahedralEncode(glm::vec3 n);
+	glm::vec3 octahedralDecode(glm::vec2 e);
+
+	// reconstructs the attributes of a quantized vertex, used to check the compression error
+	void decodeQuantizedVertex(const QuantizedVertex& vertex, const glm::mat4& positionDequantization,
+		glm::vec3& position, glm::vec3& normal, glm::vec2& texCoord, glm::vec3& tangent, float& bitangentSign);
+
+	// largest differences between the decoded quantized vertices of a mesh and the source mesh
+	struct QuantizationError {
+		// relative to the quantization range, the half extent of the longest side of the bounds
+		float position = 0.0f;
+		// degrees
+		float normal = 0.0f;
+		float tangent = 0.0f;
+		// absolute, in uv units; half floats lose precision as uvs grow, tiled ones most
+		float texCoord = 0.0f;
+		int bitangentSignErrors = 0;
+	};
+
+	// decodes every vertex of packed (VertexFormat::Quantized) and compares it with the mesh
+	QuantizationError measureQuantizationError(aiMesh* mesh, const PackedVertices& packed);
+}
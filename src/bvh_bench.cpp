@@ -0,0 +1,128 @@
+// Measures the city BVH (see Bvh.h) on a synthetic scene.
+//
+// usage: bvh_bench [objectCount]
+//   objectCount - number of boxes, 100000 by default
+//
+// Builds the tree over a grid of building-like boxes, culls it from several camera positions
+// and compares the time and the result with the linear SIMD test (Core::cullBounds). Then times
+// mouse-style ray queries and an incremental edit (1% of the boxes removed and re-added).
+// Exits with 1 when hierarchical culling misses the budget of 1 ms per frustum or the two
+// culling methods disagree.
+
+#include "Bvh.h"
+#include "Camera.h"
+#include "Frustum.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+static const double CULL_BUDGET_MS = 1.0;
+
+static float randomFloat(float from, float to)
+{
+	return from + (to - from) * (rand() / (float)RAND_MAX);
+}
+
+static double millisecondsSince(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+static Core::Frustum viewFrustum(float angle, float height)
+{
+	glm::vec3 position(cosf(angle) * 900.f, height, sinf(angle) * 900.f);
+	glm::vec3 target(cosf(angle + 2.f) * 300.f, 0.f, sinf(angle + 2.f) * 300.f);
+	glm::vec3 forward = glm::normalize(target - position);
+	glm::vec3 up = glm::normalize(glm::cross(glm::cross(forward, glm::vec3(0, 1, 0)), forward));
+	return Core::Frustum::fromMatrix(Core::createPerspectiveMatrix(0.1f, 2000.f) * Core::createViewMatrix(position, forward, up));
+}
+
+int main(int argc, char** argv)
+{
+	int objectCount = argc > 1 ? atoi(argv[1]) : 100000;
+	srand(1);
+
+	// lots on a square grid, a few boxes (buildings, props) per lot, 2 km across like the city model
+	int side = (int)ceil(sqrt(objectCount / 4.0));
+	float lot = 2000.f / side;
+	std::vector<glm::vec3> boundsMin(objectCount), boundsMax(objectCount);
+	Core::BoundsArray bounds;
+	bounds.resize(objectCount);
+	for (int i = 0; i < objectCount; i++) {
+		int cell = i / 4;
+		glm::vec3 corner(-1000.f + (cell % side) * lot, 0.f, -1000.f + (cell / side) * lot);
+		glm::vec3 size(randomFloat(0.1f, 0.5f) * lot, randomFloat(2.f, i % 4 ? 10.f : 150.f), randomFloat(0.1f, 0.5f) * lot);
+		boundsMin[i] = corner + glm::vec3(randomFloat(0.f, lot) - size.x * 0.5f, 0.f, randomFloat(0.f, lot) - size.z * 0.5f);
+		boundsMax[i] = boundsMin[i] + size;
+		bounds.set(i, (boundsMin[i] + boundsMax[i]) * 0.5f, size * 0.5f);
+	}
+
+	Core::Bvh bvh;
+	auto start = std::chrono::steady_clock::now();
+	for (int i = 0; i < objectCount; i++)
+		bvh.add(i, boundsMin[i], boundsMax[i]);
+	bvh.build();
+	std::cout << objectCount << " boxes: build " << millisecondsSince(start) << " ms, " << bvh.nodes().size() << " nodes" << std::endl;
+
+	// street level, rooftop and overview cameras around the city
+	const int VIEW_COUNT = 8;
+	const int REPEATS = 50;
+	bool failed = false;
+	std::vector<unsigned char> visible, expected;
+	for (int v = 0; v < VIEW_COUNT; v++) {
+		Core::Frustum frustum = viewFrustum(v * 6.2831853f / VIEW_COUNT, v % 3 == 0 ? 2.f : v % 3 == 1 ? 120.f : 800.f);
+
+		int visibleCount = 0, expectedCount = 0;
+		start = std::chrono::steady_clock::now();
+		for (int r = 0; r < REPEATS; r++)
+			visibleCount = bvh.cull(frustum, visible);
+		double bvhMs = millisecondsSince(start) / REPEATS;
+		start = std::chrono::steady_clock::now();
+		for (int r = 0; r < REPEATS; r++)
+			expectedCount = Core::cullBounds(frustum, bounds, expected);
+		double linearMs = millisecondsSince(start) / REPEATS;
+
+		bool same = visible == expected && visibleCount == expectedCount;
+		std::cout << "view " << v << ": " << visibleCount << " visible, bvh " << bvhMs << " ms, linear " << linearMs << " ms"
+			<< (bvhMs > CULL_BUDGET_MS ? "  OVER BUDGET" : "") << (same ? "" : "  RESULT MISMATCH") << std::endl;
+		failed = failed || bvhMs > CULL_BUDGET_MS || !same;
+	}
+
+	const int RAY_COUNT = 10000;
+	int hits = 0;
+	start = std::chrono::steady_clock::now();
+	for (int r = 0; r < RAY_COUNT; r++) {
+		glm::vec3 origin(randomFloat(-1000.f, 1000.f), 200.f, randomFloat(-1000.f, 1000.f));
+		glm::vec3 direction(randomFloat(-1.f, 1.f), -1.f, randomFloat(-1.f, 1.f));
+		float distance;
+		hits += bvh.raycast(origin, direction, distance) >= 0;
+	}
+	std::cout << RAY_COUNT << " rays: " << millisecondsSince(start) * 1000.0 / RAY_COUNT << " us per ray, " << hits << " hits" << std::endl;
+
+	int editCount = objectCount / 100;
+	start = std::chrono::steady_clock::now();
+	for (int i = 0; i < editCount; i++)
+		bvh.remove(i * 100);
+	double removeMs = millisecondsSince(start);
+	start = std::chrono::steady_clock::now();
+	for (int i = 0; i < editCount; i++)
+		bvh.add(i * 100, boundsMin[i * 100], boundsMax[i * 100]);
+	bvh.refresh();
+	std::cout << "edit of " << editCount << " boxes: remove " << removeMs << " ms, add and refresh " << millisecondsSince(start)
+		<< " ms, " << bvh.pendingCount() << " boxes pending" << std::endl;
+
+	// the edited tree must still agree with the linear test
+	Core::Frustum frustum = viewFrustum(0.f, 120.f);
+	bvh.cull(frustum, visible);
+	Core::cullBounds(frustum, bounds, expected);
+	if (visible != expected) {
+		std::cout << "RESULT MISMATCH after the edit" << std::endl;
+		failed = true;
+	}
+
+	std::cout << (failed ? "FAILED" : "ok") << std::endl;
+	return failed ? 1 : 0;
+}
@@ -8,6 +8,7 @@
 #include "freeglut.h"
 #include "glm.hpp"
 #include "ext.hpp"
+#include <algorithm>
 #include <iostream>
 #include <cmath>
 #include <vector>
@@ -17,13 +18,17 @@
 #include "Camera.h"
 #include "Texture.h"
 #include "Physics.h"
+#include "Physics_Runner.h"
+#include "Instance_Batch.h"
+#include "Scene_Queries.h"
+#include "Projectiles.h"
+#include "objcache.h"
 
 
-bool DRAGING_ON = false;
-
 Core::Shader_Loader shaderLoader;
 GLuint programColor;
 GLuint programTexture, programRed;
+GLuint programTextureBatch;
 
 obj::Model planeModel, boxModel, sphereModel;
 Core::RenderContext planeContext, boxContext, sphereContext;
@@ -39,35 +44,95 @@ glm::mat4 cameraMatrix, perspectiveMatrix;
 glm::vec3 lightDir = glm::normalize(glm::vec3(0.5, -1, -0.5));
 
 
-// Initalization of physical scene (PhysX)
-Physics pxScene(9.8 /* gravity (m/s^2) */);
+PhysicsConfig sceneConfig()
+{
+    PhysicsConfig config;
+    config.gravity = 9.8f; // m/s^2
+    // the projectiles are too small and fast for discrete collision detection
+    config.enableCcd = true;
+    return config;
+}
+
+// Initalization of physical scene (PhysX), stepped by all cores but one (see PhysicsConfig)
+Physics pxScene(sceneConfig());
 
 // fixed timestep for stable and deterministic simulation
 const double physicsStepTime = 1.f / 60.f;
-double physicsTimeToProcess = 0;
+// drags the picked body on a spring; a part of the scene, so only touched by physicsRunner commands
+Grabber grabber(pxScene);
+// the raycast of a click, run on the physics thread
+QueryBatch pickQueries(1);
+// farthest pickable object from the camera
+const float PICK_DISTANCE = 100.0f;
+// steps the scene on its own thread, see Physics_Runner.h; destroyed before grabber and pxScene
+PhysicsRunner physicsRunner(pxScene, physicsStepTime);
+// frames between two prints of the simulate-to-display latency
+const int LATENCY_STATS_INTERVAL = 300;
+int latencyStatsFrames = 0;
 
 // physical objects
 PxRigidStatic *planeBody = nullptr;
 PxMaterial *planeMaterial = nullptr;
 std::vector<PxRigidDynamic*> boxBodies;
 PxMaterial *boxMaterial = nullptr;
-PxRigidDynamic *sphereBody = nullptr;
 PxMaterial *sphereMaterial = nullptr;
+// spheres fired from the camera, 'f' one and 'v' a volley; a part of the scene like grabber
+ProjectilePool *projectiles = nullptr;
+// m/s
+const float PROJECTILE_SPEED = 80.0f;
+const int VOLLEY_SIZE = 256;
+// direction spread of a volley at the edge of its grid, and the random part on top (radians)
+const float VOLLEY_SPREAD = 0.1f;
+const float VOLLEY_JITTER = 0.005f;
 
-struct GrabbedObject {
-    PxRigidDynamic* actor;
-    float distance;
-    PxVec3 newPos;
-    bool update = false;
-} grabbedObject;
+struct SleepBatch;
 
 // renderable objects (description of a single renderable instance)
 struct Renderable {
     Core::RenderContext *context;
+    // used by objects without an actor, the others take theirs from physicsRunner
     glm::mat4 modelMatrix;
     GLuint textureId;
+    // slot of the actor in physicsRunner, -1 for objects without one
+    int physicsSlot = -1;
+
+    // transformation of the mesh relative to the actor
+    glm::mat4 meshMatrix = glm::mat4(1.0f);
+    // drawn with the rest of the batch in two instanced draws when sleepBatching is on
+    SleepBatch* batch = nullptr;
+    // index in batch->awake, -1 while at rest or disabled
+    int awakeIndex = -1;
+
+    const glm::mat4& matrix() const { return physicsSlot >= 0 ? physicsRunner.pose(physicsSlot) : modelMatrix; }
 };
 std::vector<Renderable*> renderables;
+// renderable of each physicsRunner slot
+std::vector<Renderable*> slotRenderables;
+
+// Sleep batching (key 'b'): the renderables of a batch at rest are drawn from its resting batch,
+// whose matrices stay on the GPU until they wake up, only the matrices of the awake ones are
+// uploaded every frame. Disabled ones (projectiles waiting in the pool) are not drawn at all.
+bool sleepBatching = true;
+struct SleepBatch {
+    Core::RenderContext *context;
+    GLuint textureId;
+    // transformation of the mesh relative to the actor, the same for the whole batch
+    glm::mat4 meshMatrix = glm::mat4(1.0f);
+    Core::InstanceBatch resting;
+    GLuint awakeBuffer = 0;
+    // the vertex and index buffers of context plus the awake or the resting matrices at location 6,
+    // so that the instanced attributes never end up on context->vertexArray, which the renderables
+    // drawn one by one use too
+    GLuint awakeArray = 0;
+    GLuint restingArray = 0;
+    std::vector<glm::mat4> awakeMatrices;
+    std::vector<Renderable*> awake;
+    // renderables in the batch, the size of awakeBuffer
+    int capacity = 0;
+};
+SleepBatch boxBatch, projectileBatch;
+// matrices uploaded since the last stats print
+long long awakeUploads = 0;
 
 PxVec3 vec3ToPxVec(glm::vec3 vector) {
     return PxVec3(vector.x, vector.y, vector.z);
@@ -81,10 +146,10 @@ const int BOX_NUMBER = 10;
 
 void initRenderables()
 {
-    // load models
-    planeModel = obj::loadModelFromFile("models/plane.obj");
-    boxModel = obj::loadModelFromFile("models/box.obj");
-    sphereModel = obj::loadModelFromFile("models/sphere.obj");
+    // load models (through the binary mesh cache, see objcache.h)
+    planeModel = obj::loadModelFromFileCached("models/plane.obj");
+    boxModel = obj::loadModelFromFileCached("models/box.obj");
+    sphereModel = obj::loadModelFromFileCached("models/sphere.obj");
 
     planeContext.initFromOBJ(planeModel);
     boxContext.initFromOBJ(boxModel);
@@ -94,6 +159,8 @@ void initRenderables()
     // load textures
     groundTexture = Core::LoadTexture("textures/sand.jpg");
     boxTexture = Core::LoadTexture("textures/a.jpg");
+    boxBatch.context = &boxContext;
+    boxBatch.textureId = boxTexture;
 
     // create ground
     Renderable *ground = new Renderable();
@@ -106,6 +173,7 @@ void initRenderables()
 				Renderable* box = new Renderable();
 				box->context = &boxContext;
 				box->textureId = boxTexture;
+				box->batch = &boxBatch;
 				renderables.emplace_back(box);
 			
     }
@@ -126,7 +194,9 @@ void initPhysicsScene()
 	PxShape* planeShape = pxScene.physics->createShape(PxPlaneGeometry(), *planeMaterial);
 	planeBody->attachShape(*planeShape);
 	planeShape->release();
-	planeBody->userData = (void*)renderables[0];
+	setQueryGroup(*planeBody, QUERY_GROUP_STATIC);
+	renderables[0]->physicsSlot = physicsRunner.track(planeBody);
+	slotRenderables.push_back(renderables[0]);
 	pxScene.scene->addActor(*planeBody);
 	boxMaterial = pxScene.physics->createMaterial(0.9, 0.5, 0.4);
 
@@ -137,53 +207,184 @@ void initPhysicsScene()
 		PxShape* boxShape = pxScene.physics->createShape(PxBoxGeometry(1, 1, 1), *boxMaterial);
 		x->attachShape(*boxShape);
 		boxShape->release();
-		x->userData = (void*)renderables[i + 1];
+		setQueryGroup(*x, QUERY_GROUP_DYNAMIC);
+		renderables[i + 1]->physicsSlot = physicsRunner.track(x);
+		slotRenderables.push_back(renderables[i + 1]);
 		pxScene.scene->addActor(*x);
 	}
 
+	// the pool creates all of its spheres now, each one gets a slot and a renderable
+	sphereMaterial = pxScene.physics->createMaterial(0.5, 0.5, 0.6);
+	ProjectileConfig projectileConfig;
+	projectileConfig.adaptiveSubsteps = true;
+	projectileConfig.travelPerSubstep = 5.0f;
+	projectileConfig.maxSubsteps = 4;
+	projectileConfig.queryGroup = QUERY_GROUP_PROJECTILE;
+	projectiles = new ProjectilePool(pxScene, *sphereMaterial, projectileConfig);
+	projectileBatch.context = &sphereContext;
+	projectileBatch.textureId = boxTexture;
+	projectileBatch.meshMatrix = glm::scale(glm::vec3(projectileConfig.radius));
+	for (int i = 0; i < projectiles->capacity(); i++) {
+		Renderable* sphere = new Renderable();
+		sphere->context = &sphereContext;
+		sphere->textureId = boxTexture;
+		sphere->meshMatrix = projectileBatch.meshMatrix;
+		sphere->batch = &projectileBatch;
+		sphere->physicsSlot = physicsRunner.track(projectiles->body(i));
+		renderables.push_back(sphere);
+		slotRenderables.push_back(sphere);
+	}
+
+	// enough substeps for the fastest projectile, expired ones are taken out of the simulation
+	// and out of the picture
+	physicsRunner.setSubsteps([](double dt) { return projectiles->substeps((float)dt); });
+	physicsRunner.setAfterStep([](double dt) {
+		projectiles->update((float)dt);
+		for (PxRigidDynamic* body : projectiles->recycled())
+			physicsRunner.touched(body);
+	});
+}
+
+void setAwake(Renderable* renderable, bool awake)
+{
+    if (awake == (renderable->awakeIndex >= 0))
+        return;
+    std::vector<Renderable*>& awakeOnes = renderable->batch->awake;
+    if (awake) {
+        renderable->awakeIndex = awakeOnes.size();
+        awakeOnes.push_back(renderable);
+    } else {
+        awakeOnes[renderable->awakeIndex] = awakeOnes.back();
+        awakeOnes[renderable->awakeIndex]->awakeIndex = renderable->awakeIndex;
+        awakeOnes.pop_back();
+        renderable->awakeIndex = -1;
+    }
+}
+
+// puts a batched renderable where the state of its actor says: the resting batch with its current
+// pose, the awake ones or, while disabled, neither
+void placeInBatch(Renderable* renderable)
+{
+    int slot = renderable->physicsSlot;
+    Core::InstanceBatch& resting = renderable->batch->resting;
+    bool enabled = physicsRunner.enabled(slot);
+    if (enabled && physicsRunner.resting(slot))
+        resting.add(slot, physicsRunner.pose(slot));
+    else if (resting.contains(slot))
+        resting.remove(slot);
+    setAwake(renderable, enabled && !physicsRunner.resting(slot));
+}
+
+void initSleepBatch(SleepBatch& batch)
+{
+    for (Renderable* renderable : slotRenderables)
+        if (renderable->batch == &batch)
+            batch.capacity++;
+    batch.resting.init(slotRenderables.size());
+    glGenBuffers(1, &batch.awakeBuffer);
+    glBindBuffer(GL_ARRAY_BUFFER, batch.awakeBuffer);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(glm::mat4) * batch.capacity, NULL, GL_STREAM_DRAW);
+    glGenVertexArrays(1, &batch.awakeArray);
+    glBindVertexArray(batch.awakeArray);
+    batch.context->setVertexAttributes();
+    glBindBuffer(GL_ARRAY_BUFFER, batch.awakeBuffer);
+    Core::setInstanceMatrixAttribute(6);
+    glGenVertexArrays(1, &batch.restingArray);
+    glBindVertexArray(batch.restingArray);
+    batch.context->setVertexAttributes();
+    batch.resting.bindAttribute(6);
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    batch.awakeMatrices.reserve(batch.capacity);
+    batch.awake.reserve(batch.capacity);
+}
+
+void destroySleepBatch(SleepBatch& batch)
+{
+    batch.resting.destroy();
+    glDeleteBuffers(1, &batch.awakeBuffer);
+    glDeleteVertexArrays(1, &batch.awakeArray);
+    glDeleteVertexArrays(1, &batch.restingArray);
+}
+
+// after physicsRunner.start(), splits the batched renderables into the resting and the awake ones
+void initSleepBatches()
+{
+    initSleepBatch(boxBatch);
+    initSleepBatch(projectileBatch);
+    for (Renderable* renderable : slotRenderables)
+        if (renderable->batch)
+            placeInBatch(renderable);
 }
 
 void updateTransforms()
 {
-    // Here we retrieve the current transforms of the objects from the physical simulation.
-    auto actorFlags = PxActorTypeFlag::eRIGID_DYNAMIC | PxActorTypeFlag::eRIGID_STATIC;
-    PxU32 nbActors = pxScene.scene->getNbActors(actorFlags);
-    if (nbActors)
-    {
-        std::vector<PxRigidActor*> actors(nbActors);
-        pxScene.scene->getActors(actorFlags, (PxActor**)&actors[0], nbActors);
-        for (auto actor : actors)
-        {
-            // We use the userData of the objects to set up the model matrices
-            // of proper renderables.
-            if (!actor->userData) continue;
-            Renderable *renderable = (Renderable*)actor->userData;
-
-            // get world matrix of the object (actor)
-            PxMat44 transform = actor->getGlobalPose();
-            auto &c0 = transform.column0;
-            auto &c1 = transform.column1;
-            auto &c2 = transform.column2;
-            auto &c3 = transform.column3;
-
-            // set up the model matrix used for the rendering
-            renderable->modelMatrix = glm::mat4(
-                c0.x, c0.y, c0.z, c0.w,
-                c1.x, c1.y, c1.z, c1.w,
-                c2.x, c2.y, c2.z, c2.w,
-                c3.x, c3.y, c3.z, c3.w);
-        }
+    // The scene belongs to the physics thread, the poses come from the states it published,
+    // interpolated between the last two of them. Only the matrices of the actors that moved
+    // are updated, the renderables read them by slot.
+    physicsRunner.update();
+
+    // bodies that fell asleep move into the resting batch with their final pose, woken ones leave
+    // it, fired and recycled projectiles appear and disappear
+    for (int slot : physicsRunner.stateChanges()) {
+        Renderable* renderable = slotRenderables[slot];
+        if (renderable->batch)
+            placeInBatch(renderable);
     }
 }
-std::vector<glm::vec3> calculate_ray(float x, float y) {
-    glm::vec2 screen_space_pos(x, y);
-    std::vector<glm::vec3> result;
+struct Ray {
+    glm::vec3 origin;
+    // normalized
+    glm::vec3 direction;
+};
+
+// ray from the near to the far plane through x, y in normalized device coordinates, unprojected
+// with the view and projection of the last frame
+Ray calculate_ray(float x, float y) {
+    glm::mat4 inverseViewProjection = glm::inverse(perspectiveMatrix * cameraMatrix);
+    glm::vec4 nearPoint = inverseViewProjection * glm::vec4(x, y, -1.0f, 1.0f);
+    glm::vec4 farPoint = inverseViewProjection * glm::vec4(x, y, 1.0f, 1.0f);
+
+    Ray ray;
+    ray.origin = glm::vec3(nearPoint) / nearPoint.w;
+    ray.direction = glm::normalize(glm::vec3(farPoint) / farPoint.w - ray.origin);
+    return ray;
+}
 
-    //here ray should be calculated
+// ray through the pixel under the cursor
+Ray cursorRay(int x, int y) {
+    int size_x = glutGet(GLUT_WINDOW_WIDTH);
+    int size_y = glutGet(GLUT_WINDOW_HEIGHT);
+    return calculate_ray((x / float(size_x) - 0.5f) * 2, -((y / float(size_y)) - 0.5f) * 2);
+}
+
+// fires count projectiles from the camera through the cursor. A volley starts as a square grid
+// across the ray with a radius between neighbours, and its directions fan out from the grid, so
+// the spheres never start overlapping and move apart; the random jitter is too small to close
+// the gaps.
+void fireProjectiles(const Ray& ray, int count) {
+    physicsRunner.enqueue([ray, count](PxScene&) {
+        glm::vec3 side = glm::normalize(glm::cross(ray.direction, glm::vec3(0, 1, 0)));
+        glm::vec3 up = glm::cross(side, ray.direction);
+        int columns = (int)std::ceil(std::sqrt((float)count));
+        float spacing = 3.0f * projectiles->config().radius;
+        float halfWidth = std::max(0.5f * (columns - 1) * spacing, spacing);
+        for (int i = 0; i < count; i++) {
+            glm::vec2 offset((i % columns - (columns - 1) * 0.5f) * spacing, (i / columns - (columns - 1) * 0.5f) * spacing);
+            glm::vec2 spread = count > 1 ? offset * (VOLLEY_SPREAD / halfWidth) + glm::diskRand(VOLLEY_JITTER) : glm::vec2(0.0f);
+            glm::vec3 direction = glm::normalize(ray.direction + side * spread.x + up * spread.y);
+            glm::vec3 position = ray.origin + ray.direction * 2.0f + side * offset.x + up * offset.y;
+            PxRigidDynamic* body = projectiles->fire(vec3ToPxVec(position), vec3ToPxVec(direction * PROJECTILE_SPEED));
+            physicsRunner.touched(body);
+        }
+    });
+}
 
-    result.push_back(cameraPos);
-    result.push_back(cameraDir);
-    return result;
+// moves the anchor of the grabbed body (if any) along with the cursor
+void dragGrabbed(const Ray& ray) {
+    physicsRunner.enqueue([ray](PxScene&) {
+        grabber.drag(vec3ToPxVec(ray.origin), vec3ToPxVec(ray.direction));
+    });
 }
 
 void keyboard(unsigned char key, int x, int y)
@@ -198,51 +399,44 @@ void keyboard(unsigned char key, int x, int y)
 		case 's': cameraPos -= cameraDir * moveSpeed; break;
 		case 'd': cameraPos += cameraSide * moveSpeed; break;
 		case 'a': cameraPos -= cameraSide * moveSpeed; break;
+		case 'b': sleepBatching = !sleepBatching; break;
+		case 'f': fireProjectiles(cursorRay(x, y), 1); break;
+		case 'v': fireProjectiles(cursorRay(x, y), VOLLEY_SIZE); break;
     }
 
-
-    int size_x = glutGet(GLUT_WINDOW_WIDTH);
-    int size_y = glutGet(GLUT_WINDOW_HEIGHT);
-    std::vector<glm::vec3> ray = calculate_ray((x / float(size_x) - 0.5) * 2, -((y / float(size_y)) - 0.5) * 2);
-    grabbedObject.newPos = vec3ToPxVec(ray[1]) * grabbedObject.distance + vec3ToPxVec(ray[0]);
+    // the grabbed body follows the camera
+    dragGrabbed(cursorRay(x, y));
 }
 
 
 void mouse(int x, int y)
 {
-
-    int size_x = glutGet(GLUT_WINDOW_WIDTH);
-    int size_y = glutGet(GLUT_WINDOW_HEIGHT);
-    std::vector<glm::vec3> ray = calculate_ray((x / float(size_x) - 0.5) * 2, -((y / float(size_y)) - 0.5) * 2);
-    Core::updateRayPos(rayContext, ray);
-    grabbedObject.newPos = vec3ToPxVec(ray[1]) * grabbedObject.distance + vec3ToPxVec(ray[0]);
-
+    Ray ray = cursorRay(x, y);
+    Core::updateRayPos(rayContext, ray.origin, ray.direction);
+    dragGrabbed(ray);
 }
 void click_mouse(int button, int state, int x, int y) {
     if ((GLUT_LEFT_BUTTON == button && state == GLUT_DOWN)) {
-
-        int size_x = glutGet(GLUT_WINDOW_WIDTH);
-        int size_y = glutGet(GLUT_WINDOW_HEIGHT);
-        std::vector<glm::vec3> ray = calculate_ray((x / float(size_x) - 0.5) * 2, -((y / float(size_y)) - 0.5) * 2);
-        Core::updateRayPos(rayContext, ray);
-
-        //here raycast should be done
-
-        //check if there is a hit
-        if (false) {
-
-            //check if it is rigid dynamic
-            if (false) {
-            }
-        }
-        else {
-            std::cout << "no hit\n";
-        }
+        Ray ray = cursorRay(x, y);
+        Core::updateRayPos(rayContext, ray.origin, ray.direction);
+
+        // the scene belongs to the physics thread, the raycast runs there before the next step;
+        // the ground blocks the ray too but only dynamic bodies can be grabbed
+        physicsRunner.enqueue([ray](PxScene& scene) {
+            pickQueries.clear();
+            pickQueries.raycast(vec3ToPxVec(ray.origin), vec3ToPxVec(ray.direction), PICK_DISTANCE, QUERY_GROUP_STATIC | QUERY_GROUP_DYNAMIC);
+            pickQueries.execute(scene);
+            const QueryHit& hit = pickQueries.result(0);
+            PxRigidDynamic* body = hit.hit() ? hit.actor->is<PxRigidDynamic>() : nullptr;
+            if (body)
+                grabber.grab(*body, hit.position, hit.distance);
+            else
+                std::cout << (hit.hit() ? "hit a static object\n" : "no hit\n");
+        });
     }
 
     if (GLUT_LEFT_BUTTON == button && state == GLUT_UP) {
-        DRAGING_ON = false;
-        grabbedObject.update = false;
+        physicsRunner.enqueue([](PxScene&) { grabber.release(); });
     }
 
 }
@@ -264,12 +458,12 @@ void drawObjectColor(Core::RenderContext* context, glm::mat4 modelMatrix, glm::v
 
     glUseProgram(program);
 
-    glUniform3f(glGetUniformLocation(program, "objectColor"), color.x, color.y, color.z);
-    glUniform3f(glGetUniformLocation(program, "lightDir"), lightDir.x, lightDir.y, lightDir.z);
+    glUniform3f(Core::GetUniformLocation(program, "objectColor"), color.x, color.y, color.z);
+    glUniform3f(Core::GetUniformLocation(program, "lightDir"), lightDir.x, lightDir.y, lightDir.z);
 
     glm::mat4 transformation = perspectiveMatrix * cameraMatrix * modelMatrix;
-    glUniformMatrix4fv(glGetUniformLocation(program, "modelViewProjectionMatrix"), 1, GL_FALSE, (float*)&transformation);
-    glUniformMatrix4fv(glGetUniformLocation(program, "modelMatrix"), 1, GL_FALSE, (float*)&modelMatrix);
+    glUniformMatrix4fv(Core::GetUniformLocation(program, "modelViewProjectionMatrix"), 1, GL_FALSE, (float*)&transformation);
+    glUniformMatrix4fv(Core::GetUniformLocation(program, "modelMatrix"), 1, GL_FALSE, (float*)&modelMatrix);
 
     context->render();
 
@@ -280,7 +474,7 @@ void drawRay(Core::RayContext& context) {
     glUseProgram(programRed);
 
     glm::mat4 transformation = perspectiveMatrix * cameraMatrix;
-    glUniformMatrix4fv(glGetUniformLocation(programRed, "modelViewProjectionMatrix"), 1, GL_FALSE, (float*)&transformation);
+    glUniformMatrix4fv(Core::GetUniformLocation(programRed, "modelViewProjectionMatrix"), 1, GL_FALSE, (float*)&transformation);
     context.render();
     glUseProgram(0);
 }
@@ -291,39 +485,54 @@ void drawObjectTexture(Core::RenderContext * context, glm::mat4 modelMatrix, GLu
 
     glUseProgram(program);
 
-    glUniform3f(glGetUniformLocation(program, "lightDir"), lightDir.x, lightDir.y, lightDir.z);
+    glUniform3f(Core::GetUniformLocation(program, "lightDir"), lightDir.x, lightDir.y, lightDir.z);
     Core::SetActiveTexture(textureId, "textureSampler", program, 0);
 
     glm::mat4 transformation = perspectiveMatrix * cameraMatrix * modelMatrix;
-    glUniformMatrix4fv(glGetUniformLocation(program, "modelViewProjectionMatrix"), 1, GL_FALSE, (float*)&transformation);
-    glUniformMatrix4fv(glGetUniformLocation(program, "modelMatrix"), 1, GL_FALSE, (float*)&modelMatrix);
+    glUniformMatrix4fv(Core::GetUniformLocation(program, "modelViewProjectionMatrix"), 1, GL_FALSE, (float*)&transformation);
+    glUniformMatrix4fv(Core::GetUniformLocation(program, "modelMatrix"), 1, GL_FALSE, (float*)&modelMatrix);
 
     context->render();
     glUseProgram(0);
 }
 
-void renderScene()
+// the awake renderables of a batch from matrices uploaded this frame, the resting ones from its
+// resting batch
+void drawSleepBatch(SleepBatch& batch)
 {
-    
-    if (grabbedObject.update) {
-        // Here should be grab object update
-    }
+    GLuint program = programTextureBatch;
 
-    double time = glutGet(GLUT_ELAPSED_TIME) / 1000.0;
-    static double prevTime = time;
-    double dtime = time - prevTime;
-    prevTime = time;
-
-    // Update physics
-    if (dtime < 1.f) {
-        physicsTimeToProcess += dtime;
-        while (physicsTimeToProcess > 0) {
-            // here we perform the physics simulation step
-            pxScene.step(physicsStepTime);
-            physicsTimeToProcess -= physicsStepTime;
-        }
+    glUseProgram(program);
+
+    glUniform3f(Core::GetUniformLocation(program, "lightDir"), lightDir.x, lightDir.y, lightDir.z);
+    Core::SetActiveTexture(batch.textureId, "textureSampler", program, 0);
+    glm::mat4 viewProjection = perspectiveMatrix * cameraMatrix;
+    glUniformMatrix4fv(Core::GetUniformLocation(program, "viewProjectionMatrix"), 1, GL_FALSE, (float*)&viewProjection);
+    glUniformMatrix4fv(Core::GetUniformLocation(program, "modelMatrix"), 1, GL_FALSE, (float*)&batch.meshMatrix);
+
+    if (!batch.awake.empty()) {
+        batch.awakeMatrices.clear();
+        for (Renderable* renderable : batch.awake)
+            batch.awakeMatrices.push_back(renderable->matrix());
+        glBindBuffer(GL_ARRAY_BUFFER, batch.awakeBuffer);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(glm::mat4) * batch.capacity, NULL, GL_STREAM_DRAW);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(glm::mat4) * batch.awakeMatrices.size(), batch.awakeMatrices.data());
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        glBindVertexArray(batch.awakeArray);
+        batch.context->renderInstanced(batch.awakeMatrices.size());
+        awakeUploads += batch.awakeMatrices.size();
     }
+    if (batch.resting.size() > 0) {
+        glBindVertexArray(batch.restingArray);
+        batch.context->renderInstanced(batch.resting.size());
+    }
+    glBindVertexArray(0);
+
+    glUseProgram(0);
+}
 
+void renderScene()
+{
 
     // Update of camera and perspective matrices
     cameraMatrix = createCameraMatrix();
@@ -337,7 +546,15 @@ void renderScene()
 
     // render models
     for (Renderable* renderable : renderables) {
-        drawObjectTexture(renderable->context, renderable->modelMatrix, renderable->textureId);
+        if (sleepBatching && renderable->batch)
+            continue;
+        if (renderable->physicsSlot >= 0 && !physicsRunner.enabled(renderable->physicsSlot))
+            continue;
+        drawObjectTexture(renderable->context, renderable->matrix() * renderable->meshMatrix, renderable->textureId);
+    }
+    if (sleepBatching) {
+        drawSleepBatch(boxBatch);
+        drawSleepBatch(projectileBatch);
     }
     #ifdef SHOW_RAY
         drawRay(rayContext);
@@ -345,6 +562,21 @@ void renderScene()
 
 
     glutSwapBuffers();
+    physicsRunner.framePresented();
+    if (++latencyStatsFrames == LATENCY_STATS_INTERVAL) {
+        std::cout << "physics: " << physicsRunner.steps() << " steps, " << physicsRunner.droppedSteps() << " dropped, " << physicsRunner.movedActors() << " of " << physicsRunner.modelMatrices().size() << " actors moving, simulate-to-display ";
+        physicsRunner.latency().print(std::cout);
+        std::cout << std::endl;
+        physicsRunner.latency().reset();
+        std::cout << "boxes: " << boxBatch.awake.size() << " awake, " << boxBatch.resting.size() << " resting; projectiles: "
+            << projectileBatch.awake.size() << " flying, " << projectileBatch.resting.size() << " resting; " << physicsRunner.substeps()
+            << " substeps; matrices uploaded per frame: "
+            << double(awakeUploads + boxBatch.resting.uploads() + projectileBatch.resting.uploads()) / LATENCY_STATS_INTERVAL << std::endl;
+        awakeUploads = 0;
+        boxBatch.resting.resetUploads();
+        projectileBatch.resting.resetUploads();
+        latencyStatsFrames = 0;
+    }
 }
 
 void init()
@@ -354,20 +586,28 @@ void init()
     programColor = shaderLoader.CreateProgram("shaders/shader_color.vert", "shaders/shader_color.frag");
     programTexture = shaderLoader.CreateProgram("shaders/shader_tex.vert", "shaders/shader_tex.frag");
     programRed = shaderLoader.CreateProgram("shaders/shader_red.vert", "shaders/shader_red.frag");
+    programTextureBatch = shaderLoader.CreateProgram("shaders/shader_tex_batch.vert", "shaders/shader_tex.frag");
 
 
     Core::initRay(rayContext);
-    auto ray = calculate_ray(0.5f,0.5f);
-    //Core::updateRayPos(rayContext, ray);
 
     initRenderables();
     initPhysicsScene();
+    physicsRunner.start();
+    initSleepBatches();
+    std::cout << "physics: " << pxScene.workerCount() << " worker threads" << std::endl;
 }
 
 void shutdown()
 {
+    physicsRunner.stop();
     shaderLoader.DeleteProgram(programColor);
     shaderLoader.DeleteProgram(programTexture);
+    shaderLoader.DeleteProgram(programTextureBatch);
+    destroySleepBatch(boxBatch);
+    destroySleepBatch(projectileBatch);
+    delete projectiles;
+    projectiles = nullptr;
 }
 
 void idle()
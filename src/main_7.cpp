@@ -8,9 +8,19 @@
 #include <iostream>
 #include <cmath>
 #include <ctime>
+#include <chrono>
+#include <unordered_map>
 
 #include "Shader_Loader.h"
 #include "Render_Utils.h"
+#include "Geometry_Pool.h"
+#include "Indirect_Draw.h"
+#include "Material_Table.h"
+#include "Occlusion_Culling.h"
+#include "Scene_Graph.h"
+#include "Render_Queue.h"
+#include "Frustum.h"
+#include "Bvh.h"
 #include "Camera.h"
 
 
@@ -52,11 +62,28 @@ std::vector<glm::quat> keyRotation;
 
 int index = 0;
 bool FOLLOW_CAR = false;
+// Direct    - one draw per context through the render queue, cars queued 30 times
+// Instanced - city as Direct, every car mesh drawn once for all cars with glDrawElementsInstanced
+// Indirect  - city and cars with glMultiDrawElementsIndirect (OpenGL 4.3)
+// Occlusion - Indirect with two-phase Hi-Z culling on the GPU: last frame's visible draws first,
+//             then the rest tested against their depth pyramid (see OcclusionCuller). The window
+//             is multisampled, so the pyramid is built from the farthest sample of each pixel; the
+//             extra resolve pass reads every sample, a plain blit could keep a nearer one and cull
+//             meshes that are partly visible at silhouettes
+// switched with 'i'; Indirect and Occlusion fall back to Direct when isSupported() is false
+enum class RenderPath { Direct, Instanced, Indirect, Occlusion };
+RenderPath renderPath = RenderPath::Direct;
+const char* renderPathNames[] = { "direct", "instanced", "indirect", "occlusion" };
 
 GLuint program;
 GLuint programTextureSpecular;
 GLuint programTexture;
 GLuint programSun;
+GLuint programTextureSpecularIndirect;
+GLuint programTextureIndirect;
+GLuint programTextureSpecularArray;
+GLuint programTextureArray;
+GLuint programTextureInstanced;
 Core::Shader_Loader shaderLoader;
 
 
@@ -66,9 +93,95 @@ Core::RenderContext armContext;
 
 std::vector<Core::RenderContext> armContexts;
 
-std::vector<Core::Node> city;
-
-std::vector<Core::Node> car;
+Core::SceneGraph city;
+
+Core::SceneGraph car;
+
+// vertex layout of the loaded Assimp meshes, Quantized needs 24 instead of 56 bytes per vertex
+Core::VertexFormat meshVertexFormat = Core::VertexFormat::Quantized;
+// reorder triangles and vertices of the loaded meshes for the vertex cache, overdraw and fetch (see Mesh_Optimize.h)
+bool optimizeMeshes = true;
+// city and car meshes are suballocated from shared buffers, see Geometry_Pool.h
+Core::GeometryPool geometryPool;
+// vertex array bound by renderInstancedCars, the car meshes of one pool page share it
+GLuint boundVertexArray = 0;
+// sorts the draws of the direct path by state, see Render_Queue.h
+Core::RenderQueue renderQueue;
+
+const int CAR_COUNT = 30;
+Core::IndirectDrawList indirectDraws;
+// textures of the city and car materials in texture arrays, lets the indirect paths batch across materials
+Core::MaterialTable materialTable;
+// the occlusion path culls the same draw list on the GPU
+Core::OcclusionCuller occlusionCuller;
+// one entry per context of every car instance, nodeMatrix places the node relative to the car root
+struct CarDraw {
+	int handle;
+	int instance;
+	int context;
+	glm::mat4 nodeMatrix;
+};
+std::vector<CarDraw> carDraws;
+
+// instanced path: the car root matrices of all visible cars, one context per car mesh
+GLuint carInstanceBuffer;
+// vertex arrays of the instanced cars, one per pool page they use: the page vertex and index
+// buffers plus the instance matrices, so the city draws of the shared page vertex arrays never
+// fetch instanced attributes from carInstanceBuffer
+std::vector<GLuint> carVertexArrays;
+std::vector<glm::mat4> carInstanceMatrices;
+struct InstancedCarDraw {
+	Core::RenderContext context;
+	// node matrix relative to the car root, with the position dequantization
+	glm::mat4 nodeMatrix;
+};
+std::vector<InstancedCarDraw> instancedCarDraws;
+
+// levels of detail (see Mesh_Lod.h), 'l' turns the selection off and draws everything at level 0
+bool lodEnabled = true;
+// projected size in pixels of an object 1 unit across at distance 1, set every frame
+float projectionScale = 1;
+// level of every city context in the last frame, the selection keeps a level unless it is clearly wrong
+std::vector<unsigned char> cityLods;
+// a car draws all its meshes at one level, picked from the bounding sphere of the car (relative to its root)
+int carLods[CAR_COUNT] = {};
+int carLodLevels = 1;
+// per level the largest error of any car mesh relative to the car diameter
+float carLodErrors[Core::MAX_LOD_LEVELS] = {};
+glm::vec3 carCenter;
+float carRadius = 0;
+
+// lengths of the segments between keyPoints and their sum, used by animationMatrix
+std::vector<float> keyPointDistances;
+float keyPointsTimeStep = 0;
+
+// textures are decoded on worker threads while the first frames are drawn (see Texture.h),
+// the time from the start of main to the first frame and to the last texture upload is printed
+std::chrono::steady_clock::time_point programStart;
+bool firstFrameDrawn = false;
+bool texturesStreamed = false;
+
+// draw calls and CPU time of renderScene, printed for the active path every FRAME_STATS_INTERVAL frames
+const int FRAME_STATS_INTERVAL = 100;
+int drawCalls = 0;
+// contexts that passed frustum culling and all contexts considered, per frame
+int visibleDraws = 0;
+int totalDraws = 0;
+long long statsVisibleDraws = 0;
+long long statsTotalDraws = 0;
+// drawn contexts (or instances) per level of detail
+int lodDraws[Core::MAX_LOD_LEVELS] = {};
+long long statsLodDraws[Core::MAX_LOD_LEVELS] = {};
+
+Core::Frustum viewFrustum;
+std::vector<unsigned char> visibleContexts;
+// the city is static, its contexts (ids are the context indices) are culled and picked through a BVH
+Core::Bvh cityBvh;
+int pickedContext = -1;
+std::vector<int> hiddenContexts;
+int statsFrames = 0;
+long long statsDrawCalls = 0;
+double statsCpuMs = 0;
 
 
 float cameraAngle = 0;
@@ -107,6 +220,34 @@ void keyboard(unsigned char key, int x, int y)
 	case 'q': index = (keyPoints.size() + index - 1) % keyPoints.size(); cameraPos = keyPoints[index] + glm::vec3(-3, 20, -3);  break;
 	case '1': FOLLOW_CAR = !FOLLOW_CAR;  break;
 	case 'r': cameraPos = glm::vec3(0,0,1); break;
+	case 'i':
+		renderPath = RenderPath(((int)renderPath + 1) % 4);
+		if (renderPath == RenderPath::Indirect && !Core::IndirectDrawList::isSupported())
+			renderPath = RenderPath::Direct;
+		if (renderPath == RenderPath::Occlusion && !Core::OcclusionCuller::isSupported())
+			renderPath = RenderPath::Direct;
+		statsFrames = 0; statsDrawCalls = 0; statsVisibleDraws = 0; statsTotalDraws = 0; statsCpuMs = 0;
+		std::fill(statsLodDraws, statsLodDraws + Core::MAX_LOD_LEVELS, 0);
+		break;
+	case 'l':
+		lodEnabled = !lodEnabled;
+		std::cout << "levels of detail " << (lodEnabled ? "on" : "off") << std::endl;
+		break;
+	case 'h':
+		if (cityBvh.contains(pickedContext)) {
+			cityBvh.remove(pickedContext);
+			hiddenContexts.push_back(pickedContext);
+			cityBvh.refresh();
+		}
+		break;
+	case 'u':
+		for (int hidden : hiddenContexts) {
+			const Core::BoundsArray& bounds = city.worldBounds();
+			cityBvh.add(hidden, bounds.center(hidden) - bounds.extent(hidden), bounds.center(hidden) + bounds.extent(hidden));
+		}
+		hiddenContexts.clear();
+		cityBvh.refresh();
+		break;
 	}
 }
 
@@ -123,6 +264,28 @@ void mouse(int x, int y)
 	old_y = y;
 }
 
+// left click picks the nearest city mesh under the cursor ('h' hides it, 'u' shows all hidden ones)
+void mouseButton(int button, int state, int x, int y)
+{
+	if (button != GLUT_LEFT_BUTTON || state != GLUT_DOWN)
+		return;
+	float ndcX = 2.f * x / glutGet(GLUT_WINDOW_WIDTH) - 1.f;
+	float ndcY = 1.f - 2.f * y / glutGet(GLUT_WINDOW_HEIGHT);
+	glm::mat4 inverseViewProjection = glm::inverse(perspectiveMatrix * cameraMatrix);
+	glm::vec4 nearPoint = inverseViewProjection * glm::vec4(ndcX, ndcY, -1, 1);
+	glm::vec4 farPoint = inverseViewProjection * glm::vec4(ndcX, ndcY, 1, 1);
+	glm::vec3 origin = glm::vec3(nearPoint) / nearPoint.w;
+	glm::vec3 direction = glm::vec3(farPoint) / farPoint.w - origin;
+
+	float distance;
+	pickedContext = cityBvh.raycast(origin, direction, distance);
+	if (pickedContext >= 0)
+		std::cout << "picked city mesh " << pickedContext << " (node " << city.contextNode(pickedContext) << ") at "
+			<< distance * glm::length(direction) << " m" << std::endl;
+	else
+		std::cout << "nothing picked" << std::endl;
+}
+
 
 glm::mat4 createCameraMatrix()
 {
@@ -153,13 +316,8 @@ glm::mat4 createCameraMatrix()
 glm::mat4 animationMatrix(float time) {
 	float speed = 1.;
 	time = time * speed;
-	std::vector<float> distances;
-	float timeStep = 0;
-	for (int i = 0; i < keyPoints.size() - 1; i++) {
-		timeStep += (keyPoints[i] - keyPoints[i + 1]).length();
-		distances.push_back((keyPoints[i] - keyPoints[i + 1]).length());
-	}
-	time = fmod(time, timeStep);
+	const std::vector<float>& distances = keyPointDistances;
+	time = fmod(time, keyPointsTimeStep);
 
 	//index of first keyPoint
 	int index = 0;
@@ -204,41 +362,82 @@ glm::mat4 animationMatrix(float time) {
 }
 
 
-void drawObject(GLuint program, Core::RenderContext context, glm::mat4 modelMatrix)
-{
-	glm::mat4 transformation = perspectiveMatrix * cameraMatrix * modelMatrix;
+// per-draw uniforms of a program, resolved on its first draw
+struct ObjectUniforms {
+	Core::Uniform<glm::mat4> modelMatrix;
+	Core::Uniform<int> packedNormals;
+};
+std::unordered_map<GLuint, ObjectUniforms> objectUniforms;
 
+const ObjectUniforms& getObjectUniforms(GLuint program)
+{
+	auto found = objectUniforms.find(program);
+	if (found != objectUniforms.end())
+		return found->second;
+	ObjectUniforms& uniforms = objectUniforms[program];
+	uniforms.modelMatrix = Core::GetUniform<glm::mat4>(program, "modelMatrix");
+	uniforms.packedNormals = Core::GetUniform<int>(program, "packedNormals");
+	return uniforms;
+}
 
-	glUniformMatrix4fv(glGetUniformLocation(program, "modelMatrix"), 1, GL_FALSE, (float*)&modelMatrix);
-	glUniformMatrix4fv(glGetUniformLocation(program, "transformation"), 1, GL_FALSE, (float*)&transformation);
-	context.render();
+// level of detail of context i of a graph from the projected size of its world bounds,
+// lods holds the levels of the last frame and is updated
+int selectContextLod(Core::SceneGraph& graph, int i, std::vector<unsigned char>& lods)
+{
+	if (!lodEnabled)
+		return lods[i] = 0;
+	const Core::BoundsArray& bounds = graph.worldBounds();
+	float screenSize = Core::projectedSize(bounds.center(i), glm::length(bounds.extent(i)), cameraPos, projectionScale);
+	return lods[i] = graph.renderContext(i).selectLod(screenSize, lods[i]);
 }
 
-void renderRecursive(std::vector<Core::Node>& nodes) {
-	for (auto node : nodes) {
-		if (node.renderContexts.size() == 0) {
-			continue;
-		}
+// level of detail of car instance car placed by carMatrix
+int selectCarLod(int car, const glm::mat4& carMatrix)
+{
+	if (!lodEnabled)
+		return carLods[car] = 0;
+	glm::vec3 center = glm::vec3(carMatrix * glm::vec4(carCenter, 1.0f));
+	float scale = glm::length(glm::vec3(carMatrix[0]));
+	float screenSize = Core::projectedSize(center, carRadius * scale, cameraPos, projectionScale);
+	return carLods[car] = Core::selectLod(carLodErrors, carLodLevels, screenSize, carLods[car]);
+}
 
-		glm::mat4 transformation = node.matrix;
+// frustum test of car instance placed by carMatrix, with the cube around its bounding sphere;
+// counts the contexts of the car as considered and, if it passes, as visible
+bool cullCar(const glm::mat4& carMatrix)
+{
+	glm::vec3 center = glm::vec3(carMatrix * glm::vec4(carCenter, 1.0f));
+	float scale = glm::length(glm::vec3(carMatrix[0]));
+	bool visible = viewFrustum.intersects(center, glm::vec3(carRadius * scale));
+	totalDraws += car.contextCount();
+	if (visible)
+		visibleDraws += car.contextCount();
+	return visible;
+}
 
-		Core::Node currentNode = node;
-		while (currentNode.parent != -1)
-		{
-			currentNode = nodes[currentNode.parent];
-			transformation = currentNode.matrix * transformation;
-		}
+// bvh - hierarchy over the contexts of a static graph, otherwise every context is tested
+// contextLods - levels of detail picked per context (see selectContextLod), otherwise all contexts are drawn at level lod
+void queueSceneGraph(Core::SceneGraph& graph, const Core::Bvh* bvh = nullptr, std::vector<unsigned char>* contextLods = nullptr, int lod = 0) {
+	graph.updateWorldMatrices();
+	const Core::BoundsArray& bounds = graph.worldBounds();
+	visibleDraws += bvh ? bvh->cull(viewFrustum, visibleContexts) : Core::cullBounds(viewFrustum, bounds, visibleContexts);
+	totalDraws += graph.contextCount();
 
-		// dodaj odwolania do nadrzednych zmiennych
-		for (auto context : node.renderContexts) {
-			auto program = context.material->program;
-			glUseProgram(program);
-			glUniform3f(glGetUniformLocation(program, "cameraPos"), cameraPos.x, cameraPos.y, cameraPos.z);
-			context.material->init_data();
-			drawObject(program, context, transformation);
-		}
+	for (int i = 0; i < graph.contextCount(); i++) {
+		if (!visibleContexts[i])
+			continue;
+		Core::RenderContext& context = graph.renderContext(i);
+		const glm::mat4& modelMatrix = graph.worldMatrix(graph.contextNode(i));
+		int level = std::min(contextLods ? selectContextLod(graph, i, *contextLods) : lod, context.lodCount - 1);
+		lodDraws[level]++;
+		renderQueue.push(context, modelMatrix, glm::length(bounds.center(i) - cameraPos) / 2000.f, level);
 	}
+}
 
+void submitRenderQueue()
+{
+	renderQueue.submit();
+	drawCalls += renderQueue.stats().draws;
 }
 
 glm::mat4 followCarCamera(float time) {
@@ -258,13 +457,283 @@ glm::mat4 followCarCamera(float time) {
 
 }
 
+void initCityBvh()
+{
+	city.updateWorldMatrices();
+	const Core::BoundsArray& bounds = city.worldBounds();
+	for (int i = 0; i < city.contextCount(); i++)
+		cityBvh.add(i, bounds.center(i) - bounds.extent(i), bounds.center(i) + bounds.extent(i));
+	cityBvh.build();
+	std::cout << "city bvh: " << cityBvh.size() << " meshes, " << cityBvh.nodes().size() << " nodes" << std::endl;
+}
+
+void initLods()
+{
+	cityLods.assign(city.contextCount(), 0);
+
+	// bounding sphere of the car relative to its root
+	glm::vec3 carMin(1e30f), carMax(-1e30f);
+	for (int i = 0; i < car.contextCount(); i++) {
+		const Core::RenderContext& context = car.renderContext(i);
+		glm::vec3 center, extent;
+		Core::transformBounds(car.relativeMatrix(car.contextNode(i), 0), context.boundsMin, context.boundsMax, center, extent);
+		carMin = glm::min(carMin, center - extent);
+		carMax = glm::max(carMax, center + extent);
+	}
+	carCenter = (carMin + carMax) * 0.5f;
+	carRadius = glm::length(carMax - carMin) * 0.5f;
+
+	// the errors are in mesh space, the node matrices may scale them
+	for (int i = 0; i < car.contextCount() && carRadius > 0; i++) {
+		const Core::RenderContext& context = car.renderContext(i);
+		glm::mat4 nodeMatrix = car.relativeMatrix(car.contextNode(i), 0);
+		float scale = std::max(glm::length(glm::vec3(nodeMatrix[0])), std::max(glm::length(glm::vec3(nodeMatrix[1])), glm::length(glm::vec3(nodeMatrix[2]))));
+		carLodLevels = std::max(carLodLevels, context.lodCount);
+		for (int level = 1; level < Core::MAX_LOD_LEVELS; level++) {
+			float error = context.lods[std::min(level, context.lodCount - 1)].error * scale / (2.0f * carRadius);
+			carLodErrors[level] = std::max(carLodErrors[level], error);
+		}
+	}
+	std::cout << "levels of detail: " << geometryPool.triangleCount() << " triangles at full detail, "
+		<< geometryPool.lodTriangleCount() << " in simplified levels, " << carLodLevels << " car levels" << std::endl;
+}
+
+void initIndirectDraws()
+{
+	city.updateWorldMatrices();
+	std::vector<std::pair<int, glm::mat4>> cityDraws;
+	for (int i = 0; i < city.contextCount(); i++)
+		cityDraws.push_back(std::make_pair(indirectDraws.add(city.renderContext(i)), city.worldMatrix(city.contextNode(i))));
+	for (int instance = 0; instance < CAR_COUNT; instance++) {
+		for (int i = 0; i < car.contextCount(); i++)
+			carDraws.push_back(CarDraw{ indirectDraws.add(car.renderContext(i)), instance, i, car.relativeMatrix(car.contextNode(i), 0) });
+	}
+	indirectDraws.build(materialTable.materialCount() > 0 ? &materialTable : nullptr);
+	// the city does not move, its matrices are set once
+	for (auto& draw : cityDraws)
+		indirectDraws.setModelMatrix(draw.first, draw.second);
+	std::cout << "indirect path: " << indirectDraws.drawCount() << " draws in " << indirectDraws.batchCount() << " multi-draw calls" << std::endl;
+}
+
+void initMaterialTable()
+{
+	for (Core::SceneGraph* graph : { &city, &car }) {
+		for (int i = 0; i < graph->contextCount(); i++) {
+			if (graph->renderContext(i).material)
+				materialTable.add(graph->renderContext(i).material);
+		}
+	}
+	materialTable.build();
+	std::cout << "material table: " << materialTable.materialCount() << " materials in " << materialTable.groupCount() << " groups, "
+		<< materialTable.arrayCount() << " texture arrays" << std::endl;
+}
+
+// the materials of a group share one batch, the textures come from the arrays
+void useIndirectMaterial(Core::Material* material)
+{
+	if (materialTable.contains(material)) {
+		GLuint program = material->program == programTextureSpecular ? programTextureSpecularArray : programTextureArray;
+		glUseProgram(program);
+		materialTable.bind(material, program);
+		return;
+	}
+	GLuint program = material->program == programTextureSpecular ? programTextureSpecularIndirect : programTextureIndirect;
+	glUseProgram(program);
+	material->init_data(program);
+}
+
+void updateIndirectCars(float time)
+{
+	glm::mat4 carAnimation[CAR_COUNT];
+	bool carVisible[CAR_COUNT];
+	for (int i = 0; i < CAR_COUNT; i++, time -= 3) {
+		carVisible[i] = false;
+		if (time > -10) {
+			carAnimation[i] = animationMatrix(time + 15);
+			carVisible[i] = cullCar(carAnimation[i]);
+			if (carVisible[i])
+				selectCarLod(i, carAnimation[i]);
+		}
+	}
+	for (auto& draw : carDraws) {
+		indirectDraws.setVisible(draw.handle, carVisible[draw.instance]);
+		if (carVisible[draw.instance]) {
+			indirectDraws.setModelMatrix(draw.handle, carAnimation[draw.instance] * draw.nodeMatrix);
+			indirectDraws.setLod(draw.handle, carLods[draw.instance]);
+			lodDraws[std::min(carLods[draw.instance], car.renderContext(draw.context).lodCount - 1)]++;
+		}
+	}
+}
+
+void renderIndirect(float time)
+{
+	updateIndirectCars(time);
+	// the city draws were added first, so their handles are the context indices
+	visibleDraws += cityBvh.cull(viewFrustum, visibleContexts);
+	totalDraws += city.contextCount();
+	for (int i = 0; i < city.contextCount(); i++) {
+		indirectDraws.setVisible(i, visibleContexts[i] != 0);
+		if (visibleContexts[i]) {
+			int level = selectContextLod(city, i, cityLods);
+			indirectDraws.setLod(i, level);
+			lodDraws[std::min(level, city.renderContext(i).lodCount - 1)]++;
+		}
+	}
+
+	indirectDraws.draw(useIndirectMaterial);
+	drawCalls += indirectDraws.batchCount();
+}
+
+// frustum and occlusion culling of the city run on the GPU, only meshes hidden with 'h' are left
+// out here; the cars are frustum culled on the CPU as well, but the stats only report the GPU counts
+void renderOcclusionCulled(float time)
+{
+	updateIndirectCars(time);
+	visibleDraws = 0;
+	totalDraws = 0;
+	city.updateWorldMatrices();
+	for (int i = 0; i < city.contextCount(); i++) {
+		indirectDraws.setVisible(i, cityBvh.contains(i));
+		// levels are picked before culling here, lodDraws counts the contexts sent to the GPU
+		if (cityBvh.contains(i)) {
+			int level = selectContextLod(city, i, cityLods);
+			indirectDraws.setLod(i, level);
+			lodDraws[std::min(level, city.renderContext(i).lodCount - 1)]++;
+		}
+	}
+
+	occlusionCuller.draw(indirectDraws, glutGet(GLUT_WINDOW_WIDTH), glutGet(GLUT_WINDOW_HEIGHT), useIndirectMaterial);
+	drawCalls += 2 * indirectDraws.batchCount();
+}
+
+void initInstancedCars()
+{
+	carInstanceMatrices.resize(CAR_COUNT);
+	glGenBuffers(1, &carInstanceBuffer);
+	glBindBuffer(GL_ARRAY_BUFFER, carInstanceBuffer);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(glm::mat4) * CAR_COUNT, NULL, GL_STREAM_DRAW);
+
+	// vertex array of the pool page -> the one of the instanced cars
+	std::unordered_map<GLuint, GLuint> instancedArrays;
+	for (int i = 0; i < car.contextCount(); i++) {
+		Core::RenderContext& context = car.renderContext(i);
+		if (!context.material)
+			continue;
+		GLuint& vertexArray = instancedArrays[context.vertexArray];
+		if (!vertexArray) {
+			glGenVertexArrays(1, &vertexArray);
+			glBindVertexArray(vertexArray);
+			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, context.vertexIndexBuffer);
+			glBindBuffer(GL_ARRAY_BUFFER, context.vertexBuffer);
+			Core::setVertexAttributes(context.vertexFormat);
+			glBindBuffer(GL_ARRAY_BUFFER, carInstanceBuffer);
+			Core::setInstanceMatrixAttribute(6);
+			carVertexArrays.push_back(vertexArray);
+		}
+		InstancedCarDraw draw{ context, car.relativeMatrix(car.contextNode(i), 0) * context.positionDequantization };
+		draw.context.vertexArray = vertexArray;
+		instancedCarDraws.push_back(draw);
+	}
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void renderInstancedCars(float time)
+{
+	// the instances are sorted by level of detail, each level is a range of the instance buffer
+	// drawn with its baseInstance, without base instances (OpenGL 4.2) all cars are drawn at level 0
+	bool baseInstance = GLEW_VERSION_4_2 || GLEW_ARB_base_instance;
+	// the cars that passed the frustum test, carLods is indexed by car
+	glm::mat4 carMatrices[CAR_COUNT];
+	int visibleCarIndices[CAR_COUNT];
+	int visibleCars = 0;
+	for (int i = 0; i < CAR_COUNT && time > -10; i++, time -= 3) {
+		glm::mat4 carMatrix = animationMatrix(time + 15);
+		if (!cullCar(carMatrix))
+			continue;
+		if (baseInstance)
+			selectCarLod(i, carMatrix);
+		else
+			carLods[i] = 0;
+		carMatrices[visibleCars] = carMatrix;
+		visibleCarIndices[visibleCars++] = i;
+	}
+	if (visibleCars == 0)
+		return;
+
+	int levelFirst[Core::MAX_LOD_LEVELS] = {};
+	int levelCount[Core::MAX_LOD_LEVELS] = {};
+	for (int i = 0; i < visibleCars; i++)
+		levelCount[carLods[visibleCarIndices[i]]]++;
+	for (int level = 1; level < Core::MAX_LOD_LEVELS; level++)
+		levelFirst[level] = levelFirst[level - 1] + levelCount[level - 1];
+	int levelFill[Core::MAX_LOD_LEVELS];
+	std::copy(levelFirst, levelFirst + Core::MAX_LOD_LEVELS, levelFill);
+	for (int i = 0; i < visibleCars; i++)
+		carInstanceMatrices[levelFill[carLods[visibleCarIndices[i]]]++] = carMatrices[i];
+
+	glBindBuffer(GL_ARRAY_BUFFER, carInstanceBuffer);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(glm::mat4) * CAR_COUNT, NULL, GL_STREAM_DRAW);
+	glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(glm::mat4) * visibleCars, carInstanceMatrices.data());
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	GLuint program = programTextureInstanced;
+	const ObjectUniforms& uniforms = getObjectUniforms(program);
+	glUseProgram(program);
+	for (auto& draw : instancedCarDraws) {
+		draw.context.material->init_data(program);
+		uniforms.modelMatrix.set(draw.nodeMatrix);
+		uniforms.packedNormals.set(draw.context.vertexFormat == Core::VertexFormat::Quantized);
+		if (draw.context.vertexArray != boundVertexArray) {
+			glBindVertexArray(draw.context.vertexArray);
+			boundVertexArray = draw.context.vertexArray;
+		}
+		for (int level = 0; level < Core::MAX_LOD_LEVELS; level++) {
+			if (levelCount[level] == 0)
+				continue;
+			draw.context.renderInstanced(levelCount[level], level, levelFirst[level]);
+			lodDraws[std::min(level, draw.context.lodCount - 1)] += levelCount[level];
+			drawCalls++;
+		}
+	}
+}
+
+void printTextureStats()
+{
+	const Core::TextureCache::Stats& textures = Core::TextureCache::instance().stats();
+	std::cout << "textures: " << textures.textures << " loaded (" << textures.bytes / (1024 * 1024) << " MB), " << textures.hits
+		<< " repeated loads served from the cache, " << textures.compressed << " block compressed, " << textures.failures << " missing, " << textures.decodeMs << " ms decoding" << std::endl;
+}
+
+// uploads the textures decoded since the last frame
+void streamTextures()
+{
+	Core::TextureCache& textures = Core::TextureCache::instance();
+	textures.update();
+	materialTable.update();
+	if (!texturesStreamed && textures.pendingCount() == 0) {
+		texturesStreamed = true;
+		std::cout << "all textures uploaded " << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - programStart).count()
+			<< " ms after start" << std::endl;
+		printTextureStats();
+	}
+}
+
 void renderScene()
 {
-	// Aktualizacja macierzy widoku i rzutowania. Macierze sa przechowywane w zmiennych globalnych, bo uzywa ich funkcja drawObject.
+	auto frameStart = std::chrono::steady_clock::now();
+	streamTextures();
+	drawCalls = 0;
+	visibleDraws = 0;
+	totalDraws = 0;
+	std::fill(lodDraws, lodDraws + Core::MAX_LOD_LEVELS, 0);
+
+	// Aktualizacja macierzy widoku i rzutowania. Macierze sa przechowywane w zmiennych globalnych, bo uzywa ich m.in. FrameData.
 	// (Bardziej elegancko byloby przekazac je jako argumenty do funkcji, ale robimy tak dla uproszczenia kodu.
 	//  Jest to mozliwe dzieki temu, ze macierze widoku i rzutowania sa takie same dla wszystkich obiektow!)
 	cameraMatrix = createCameraMatrix();
 	perspectiveMatrix = Core::createPerspectiveMatrix(0.1, 2000);
+	projectionScale = perspectiveMatrix[1][1] * glutGet(GLUT_WINDOW_HEIGHT) * 0.5f;
 	float time = glutGet(GLUT_ELAPSED_TIME) / 1000.f;
 
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
@@ -278,16 +747,82 @@ void renderScene()
 		cameraMatrix = followCarCamera(time);
 	}
 
-	renderRecursive(city);
-	for (int i = 0; i < 30; i++) {
-		if (time > -10) {
-			car[0].matrix = animationMatrix(time + 15);;
-			renderRecursive(car);
-			time -= 3;
+	Core::FrameData frameData;
+	frameData.viewProjection = perspectiveMatrix * cameraMatrix;
+	frameData.cameraPos = glm::vec4(cameraPos, 1);
+	frameData.lightDir = glm::vec4(lightDir, 0);
+	Core::UpdateFrameData(frameData);
+	viewFrustum = Core::Frustum::fromMatrix(frameData.viewProjection);
+
+	if (renderPath == RenderPath::Occlusion) {
+		renderOcclusionCulled(time);
+	}
+	else if (renderPath == RenderPath::Indirect) {
+		renderIndirect(time);
+	}
+	else if (renderPath == RenderPath::Instanced) {
+		queueSceneGraph(city, &cityBvh, &cityLods);
+		submitRenderQueue();
+		renderInstancedCars(time);
+	}
+	else {
+		queueSceneGraph(city, &cityBvh, &cityLods);
+		for (int i = 0; i < CAR_COUNT; i++) {
+			if (time > -10) {
+				glm::mat4 carMatrix = animationMatrix(time + 15);
+				car.setLocalMatrix(0, carMatrix);
+				queueSceneGraph(car, nullptr, nullptr, selectCarLod(i, carMatrix));
+				time -= 3;
+			}
 		}
+		submitRenderQueue();
 	}
+	glBindVertexArray(0);
+	boundVertexArray = 0;
 	glUseProgram(0);
+
+	statsCpuMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - frameStart).count();
+	statsDrawCalls += drawCalls;
+	statsVisibleDraws += visibleDraws;
+	statsTotalDraws += totalDraws;
+	for (int level = 0; level < Core::MAX_LOD_LEVELS; level++)
+		statsLodDraws[level] += lodDraws[level];
+	if (++statsFrames == FRAME_STATS_INTERVAL) {
+		std::cout << renderPathNames[(int)renderPath] << " path: " << statsDrawCalls / statsFrames << " draw calls, "
+			<< statsCpuMs / statsFrames << " ms CPU per frame";
+		// the occlusion path culls on the GPU, its counts are read back below
+		if (statsTotalDraws > 0)
+			std::cout << ", " << statsVisibleDraws / statsFrames << " of " << statsTotalDraws / statsFrames << " culled contexts visible";
+		std::cout << std::endl;
+		std::cout << "  levels of detail:";
+		for (int level = 0; level < Core::MAX_LOD_LEVELS; level++)
+			std::cout << " " << level << ": " << statsLodDraws[level] / statsFrames;
+		std::cout << std::endl;
+		if (renderPath == RenderPath::Occlusion) {
+			int lastFrameDraws, newlyVisibleDraws;
+			occlusionCuller.readStats(lastFrameDraws, newlyVisibleDraws);
+			std::cout << "  occlusion culling: " << lastFrameDraws << " draws from the last visible set, " << newlyVisibleDraws
+				<< " newly visible, of " << indirectDraws.drawCount() << std::endl;
+		}
+		else if (renderPath != RenderPath::Indirect) {
+			const Core::RenderQueue::Stats& queue = renderQueue.stats();
+			std::cout << "  render queue: programs " << queue.programChanges << " (" << queue.programChangesAvoided << " avoided), materials "
+				<< queue.materialChanges << " (" << queue.materialChangesAvoided << " avoided), vertex arrays " << queue.vertexArrayChanges
+				<< " (" << queue.vertexArrayChangesAvoided << " avoided), uniform updates avoided " << queue.uniformUpdatesAvoided << std::endl;
+		}
+		statsFrames = 0;
+		statsDrawCalls = 0;
+		statsVisibleDraws = 0;
+		statsTotalDraws = 0;
+		statsCpuMs = 0;
+		std::fill(statsLodDraws, statsLodDraws + Core::MAX_LOD_LEVELS, 0);
+	}
 	glutSwapBuffers();
+	if (!firstFrameDrawn) {
+		firstFrameDrawn = true;
+		std::cout << "first frame " << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - programStart).count()
+			<< " ms after start, " << Core::TextureCache::instance().pendingCount() << " textures still loading" << std::endl;
+	}
 }
 
 
@@ -304,7 +839,6 @@ Core::Material* loadDiffuseMaterial(aiMaterial* material) {
 	Core::DiffuseMaterial* result = new Core::DiffuseMaterial();
 	result->texture = Core::LoadTexture(colorPath.C_Str());
 	result->program = programTexture;
-	result->lightDir = lightDir;
 
 	return result;
 }
@@ -322,34 +856,34 @@ Core::Material* loadDiffuseSpecularMaterial(aiMaterial* material) {
 	aiString specularPath;
 	material->Get(AI_MATKEY_TEXTURE(aiTextureType_SPECULAR, 0), specularPath);
 	result->textureSpecular = Core::LoadTexture(specularPath.C_Str());
-	result->lightDir = lightDir;
 	result->program = programTextureSpecular;
 
 	return result;
 }
 
 
-void loadRecusive(const aiScene* scene, aiNode* node, std::vector<Core::Node>& nodes, std::vector<Core::Material*> materialsVector, int parentIndex) {
-	int index = nodes.size();
-	nodes.push_back(Core::Node());
-	nodes[index].parent = parentIndex;
-	nodes[index].matrix = Core::mat4_cast(node->mTransformation);
+// depth-first, so every node is added after its parent as SceneGraph requires
+void loadRecusive(const aiScene* scene, aiNode* node, Core::SceneGraph& nodes, std::vector<Core::Material*>& materialsVector, int parentIndex) {
+	int index = nodes.addNode(parentIndex, Core::mat4_cast(node->mTransformation));
 	for (int i = 0; i < node->mNumMeshes; i++) {
 		Core::RenderContext context;
-		context.initFromAssimpMesh(scene->mMeshes[node->mMeshes[i]]);
+		geometryPool.add(scene->mMeshes[node->mMeshes[i]], context);
 		context.material = materialsVector[scene->mMeshes[node->mMeshes[i]]->mMaterialIndex];
-		nodes[index].renderContexts.push_back(context);
+		nodes.addRenderContext(context);
 	}
 	for (int i = 0; i < node->mNumChildren; i++) {
 		loadRecusive(scene, node->mChildren[i], nodes, materialsVector, index);
 	}
 }
-void loadRecusive(const aiScene* scene, std::vector<Core::Node>& nodes, std::vector<Core::Material*> materialsVector) {
+void loadRecusive(const aiScene* scene, Core::SceneGraph& nodes, std::vector<Core::Material*>& materialsVector) {
 
 	loadRecusive(scene, scene->mRootNode, nodes, materialsVector, -1);
 }
 
 void initModels() {
+	geometryPool.init(meshVertexFormat);
+	geometryPool.setLodLevels(Core::MAX_LOD_LEVELS);
+	geometryPool.setOptimizeMeshes(optimizeMeshes);
 	Assimp::Importer importer;
 	//replace to get more buildings, unrecomdnded
 	//const aiScene* scene = importer.ReadFile("models/blade-runner-style-cityscapes.fbx", aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_CalcTangentSpace);
@@ -386,6 +920,14 @@ void initModels() {
 		materialsVector.push_back(loadDiffuseMaterial(scene->mMaterials[i]));
 	}
 	loadRecusive(scene, car, materialsVector);
+	std::cout << "geometry pool: " << geometryPool.meshCount() << " meshes in " << geometryPool.pages().size()
+		<< " pages, " << geometryPool.usedBytes() / (1024 * 1024) << " MB" << std::endl;
+	if (optimizeMeshes) {
+		const Core::VertexCacheStats& before = geometryPool.vertexCacheBefore();
+		const Core::VertexCacheStats& after = geometryPool.vertexCacheAfter();
+		std::cout << "mesh optimization: ACMR " << before.acmr() << " -> " << after.acmr() << ", ATVR " << before.atvr() << " -> " << after.atvr()
+			<< " (" << Core::VERTEX_CACHE_SIZE << " entry FIFO)" << std::endl;
+	}
 
 
 	//Recovering points from fbx
@@ -413,7 +955,14 @@ void initKeyRoation() {
 		oldRotationCamera = rotationCamera;
 	}
 	keyRotation.push_back(glm::quat(1, 0, 0, 0));
-	
+
+	// animationMatrix runs for every car every frame, so the segment lengths are computed once
+	keyPointDistances.clear();
+	keyPointsTimeStep = 0;
+	for (int i = 0; i < keyPoints.size() - 1; i++) {
+		keyPointDistances.push_back((keyPoints[i] - keyPoints[i + 1]).length());
+		keyPointsTimeStep += keyPointDistances.back();
+	}
 }
 
 void init()
@@ -425,7 +974,24 @@ void init()
 	programTexture = shaderLoader.CreateProgram("shaders/shader_tex_2.vert", "shaders/shader_tex_2.frag");
 	programSun = shaderLoader.CreateProgram("shaders/shader_4_sun.vert", "shaders/shader_4_sun.frag");
 
+	Core::TextureCache::instance().startAsyncLoading();
 	initModels();
+	initCityBvh();
+	initLods();
+	programTextureInstanced = shaderLoader.CreateProgram("shaders/shader_tex_instanced.vert", "shaders/shader_tex_2.frag");
+	initInstancedCars();
+	if (Core::IndirectDrawList::isSupported()) {
+		programTextureSpecularIndirect = shaderLoader.CreateProgram("shaders/shader_tex_mdi.vert", "shaders/shader_spec_tex.frag");
+		programTextureIndirect = shaderLoader.CreateProgram("shaders/shader_tex_mdi.vert", "shaders/shader_tex_2.frag");
+		if (Core::MaterialTable::isSupported()) {
+			programTextureSpecularArray = shaderLoader.CreateProgram("shaders/shader_tex_mdi.vert", "shaders/shader_spec_tex_array.frag");
+			programTextureArray = shaderLoader.CreateProgram("shaders/shader_tex_mdi.vert", "shaders/shader_tex_2_array.frag");
+			initMaterialTable();
+		}
+		initIndirectDraws();
+		if (Core::OcclusionCuller::isSupported())
+			occlusionCuller.init(indirectDraws, shaderLoader);
+	}
 
 	initKeyRoation();
 
@@ -434,6 +1000,10 @@ void init()
 void shutdown()
 {
 	shaderLoader.DeleteProgram(program);
+	glDeleteVertexArrays(carVertexArrays.size(), carVertexArrays.data());
+	glDeleteBuffers(1, &carInstanceBuffer);
+	materialTable.destroy();
+	Core::TextureCache::instance().stopAsyncLoading();
 }
 
 void idle()
@@ -443,6 +1013,7 @@ void idle()
 
 int main(int argc, char** argv)
 {
+	programStart = std::chrono::steady_clock::now();
 	glutInit(&argc, argv);
 	glutSetOption(GLUT_MULTISAMPLE, 2);
 	glutInitDisplayMode(GLUT_DEPTH | GLUT_DOUBLE | GLUT_RGBA | GLUT_MULTISAMPLE);
@@ -453,6 +1024,7 @@ int main(int argc, char** argv)
 
 	init();
 	glutPassiveMotionFunc(mouse);
+	glutMouseFunc(mouseButton);
 	glutKeyboardFunc(keyboard);
 	glutDisplayFunc(renderScene);
 	glutIdleFunc(idle);
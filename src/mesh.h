@@ -9,6 +9,7 @@
 #include "ext.hpp"
 #include <iostream>
 #include <cmath>
+#include "Shader_Loader.h"
 
 #include <string>
 #include <vector>
@@ -41,6 +42,8 @@ public:
     vector<Texture>      textures;
     glm::mat4            matrix;
     unsigned int VAO;
+    // sampler uniform of each texture (texture_diffuse1, texture_specular1, ...), named once here instead of on every draw
+    vector<string>       samplerNames;
 
     // constructor
     Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures,glm::mat4 matrix)
@@ -50,40 +53,44 @@ public:
         this->textures = textures;
         this->matrix = matrix;
 
-        // now that we have all the required data, set the vertex buffers and its attribute pointers.
-        setupMesh();
-    }
-
-    // render the mesh
-    void Draw(GLuint program)
-    {
-        // bind appropriate textures
         unsigned int diffuseNr = 1;
         unsigned int specularNr = 1;
         unsigned int normalNr = 1;
         unsigned int heightNr = 1;
         for (unsigned int i = 0; i < textures.size(); i++)
         {
-            glActiveTexture(GL_TEXTURE0 + i); // active proper texture unit before binding
-            // retrieve texture number (the N in diffuse_textureN)
+            // the N in diffuse_textureN
             string number;
             string name = textures[i].type;
             if (name == "texture_diffuse")
                 number = std::to_string(diffuseNr++);
             else if (name == "texture_specular")
-                number = std::to_string(specularNr++); // transfer unsigned int to stream
+                number = std::to_string(specularNr++);
             else if (name == "texture_normal")
-                number = std::to_string(normalNr++); // transfer unsigned int to stream
+                number = std::to_string(normalNr++);
             else if (name == "texture_height")
-                number = std::to_string(heightNr++); // transfer unsigned int to stream
+                number = std::to_string(heightNr++);
+            samplerNames.push_back(name + number);
+        }
 
-            // now set the sampler to the correct texture unit
-            glUniform1i(glGetUniformLocation(program, (name + number).c_str()), i);
+        // now that we have all the required data, set the vertex buffers and its attribute pointers.
+        setupMesh();
+    }
+
+    // render the mesh
+    void Draw(GLuint program)
+    {
+        // bind appropriate textures
+        for (unsigned int i = 0; i < textures.size(); i++)
+        {
+            glActiveTexture(GL_TEXTURE0 + i); // active proper texture unit before binding
+            // set the sampler to the texture unit, only when the program's value differs
+            Core::SetSamplerUnit(program, samplerNames[i].c_str(), i);
             // and finally bind the texture
             glBindTexture(GL_TEXTURE_2D, textures[i].id);
         }
 
-        glUniformMatrix4fv(glGetUniformLocation(program, "model"), 1, GL_FALSE, (float*)&matrix);
+        glUniformMatrix4fv(Core::GetUniformLocation(program, "model"), 1, GL_FALSE, (float*)&matrix);
         // draw mesh
         glBindVertexArray(VAO); 
         glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
@@ -0,0 +1,166 @@
+// Prebuilds binary mesh caches (see objcache.h) for every OBJ file in a directory.
+//
+// usage: mesh_cache_tool [directory] [--force] [--optimize]
+//        mesh_cache_tool --bench [maxTriangles]
+//   directory  - folder with OBJ files, "models" by default
+//   --force    - rebuild caches even when they are up to date
+//   --optimize - reorder the meshes for the vertex cache, overdraw and vertex fetch before caching
+//                them (see Mesh_Optimize.h) and print the ACMR/ATVR before and after
+//   --bench   - compares the istream parser with the in-memory parser (single and multi
+//               threaded) on synthetic grids from 10k triangles up to maxTriangles (10M by default)
+
+#include "objcache.h"
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#ifndef _WIN32
+#include <dirent.h>
+#endif
+
+static bool hasObjExtension(const std::string& name)
+{
+	if (name.size() < 4)
+		return false;
+	std::string ext = name.substr(name.size() - 4);
+	for (auto& c : ext)
+		c = (char)tolower(c);
+	return ext == ".obj";
+}
+
+static std::vector<std::string> listObjFiles(const std::string& directory)
+{
+	std::vector<std::string> result;
+#ifdef _WIN32
+	WIN32_FIND_DATAA findData;
+	HANDLE find = FindFirstFileA((directory + "\\*").c_str(), &findData);
+	if (find == INVALID_HANDLE_VALUE)
+		return result;
+	do {
+		if (!(findData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) && hasObjExtension(findData.cFileName))
+			result.push_back(directory + "/" + findData.cFileName);
+	} while (FindNextFileA(find, &findData));
+	FindClose(find);
+#else
+	DIR* dir = opendir(directory.c_str());
+	if (!dir)
+		return result;
+	while (dirent* entry = readdir(dir)) {
+		if (hasObjExtension(entry->d_name))
+			result.push_back(directory + "/" + entry->d_name);
+	}
+	closedir(dir);
+#endif
+	std::sort(result.begin(), result.end());
+	return result;
+}
+
+// grid of (side x side) quads written as triangles with positions, texture coordinates and normals
+static std::string syntheticObj(int side)
+{
+	std::string text;
+	char line[256];
+	for (int y = 0; y <= side; y++) {
+		for (int x = 0; x <= side; x++) {
+			float fx = x / float(side), fy = y / float(side);
+			snprintf(line, sizeof(line), "v %f %f %f\nvt %f %f\nvn %f %f %f\n", fx * 10.f - 5.f, 0.1f * sinf(fx * 20.f), fy * 10.f - 5.f, fx, fy, 0.f, 1.f, 0.f);
+			text += line;
+		}
+	}
+	for (int y = 0; y < side; y++) {
+		for (int x = 0; x < side; x++) {
+			int a = y * (side + 1) + x + 1, b = a + 1, c = a + side + 1, d = c + 1;
+			snprintf(line, sizeof(line), "f %d/%d/%d %d/%d/%d %d/%d/%d\nf %d/%d/%d %d/%d/%d %d/%d/%d\n", a, a, a, c, c, c, b, b, b, b, b, b, c, c, c, d, d, d);
+			text += line;
+		}
+	}
+	return text;
+}
+
+static bool sameObjModel(const obj::ObjModel& a, const obj::ObjModel& b)
+{
+	if (a.vertex != b.vertex || a.texCoord != b.texCoord || a.normal != b.normal || a.faces.size() != b.faces.size())
+		return false;
+	for (auto g = a.faces.begin(), h = b.faces.begin(); g != a.faces.end(); ++g, ++h) {
+		if (g->first != h->first || !(g->second.first == h->second.first) || g->second.second != h->second.second)
+			return false;
+	}
+	return true;
+}
+
+static int runParserBenchmark(long long maxTriangles)
+{
+	for (long long triangles = 10000; triangles <= maxTriangles; triangles *= 10) {
+		int side = (int)sqrt(triangles / 2.0);
+		std::string text = syntheticObj(side);
+
+		auto start = std::chrono::steady_clock::now();
+		std::istringstream in(text);
+		obj::ObjModel streamModel = obj::parseObjModel(in);
+		auto middle = std::chrono::steady_clock::now();
+		obj::ObjModel memoryModel = obj::parseObjModel(text.data(), text.data() + text.size());
+		auto parallelStart = std::chrono::steady_clock::now();
+		obj::ObjModel parallelModel = obj::parseObjModelParallel(text.data(), text.data() + text.size());
+		auto end = std::chrono::steady_clock::now();
+
+		double streamMs = std::chrono::duration<double, std::milli>(middle - start).count();
+		double memoryMs = std::chrono::duration<double, std::milli>(parallelStart - middle).count();
+		double parallelMs = std::chrono::duration<double, std::milli>(end - parallelStart).count();
+		bool same = sameObjModel(streamModel, memoryModel) && sameObjModel(streamModel, parallelModel);
+		std::cout << 2LL * side * side << " triangles (" << text.size() / (1024 * 1024) << " MB): istream " << streamMs
+			<< " ms, in-memory " << memoryMs << " ms, parallel " << parallelMs << " ms ("
+			<< std::thread::hardware_concurrency() << " threads), speedup " << streamMs / std::min(memoryMs, parallelMs)
+			<< (same ? "" : "  OUTPUT MISMATCH") << std::endl;
+	}
+	return 0;
+}
+
+int main(int argc, char** argv)
+{
+	std::string directory = "models";
+	bool force = false;
+	bool optimize = false;
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if (arg == "--bench")
+			return runParserBenchmark(i + 1 < argc ? atoll(argv[i + 1]) : 10000000LL);
+		if (arg == "--force")
+			force = true;
+		else if (arg == "--optimize")
+			optimize = true;
+		else
+			directory = arg;
+	}
+
+	std::vector<std::string> files = listObjFiles(directory);
+	if (files.empty()) {
+		std::cout << "No OBJ files found in " << directory << std::endl;
+		return 1;
+	}
+
+	int failed = 0;
+	for (const auto& path : files) {
+		Core::VertexCacheStats before, after;
+		if (!obj::buildModelCache(path, force, optimize, &before, &after)) {
+			std::cout << "FAILED  " << path << std::endl;
+			failed++;
+			continue;
+		}
+		obj::Model model;
+		obj::MeshCacheHeader header = {};
+		obj::readModelCache(path + obj::MESH_CACHE_EXTENSION, model, &header);
+		std::cout << "ok      " << path << "  vertices: " << header.vertexCount / 3
+			<< "  triangles: " << model.faces["default"].size() / 3;
+		// the statistics are only filled when the cache was rebuilt
+		if (before.triangles > 0)
+			std::cout << "  ACMR: " << before.acmr() << " -> " << after.acmr() << "  ATVR: " << before.atvr() << " -> " << after.atvr();
+		std::cout << std::endl;
+	}
+	return failed == 0 ? 0 : 1;
+}
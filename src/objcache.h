@@ -0,0 +1,448 @@
+#ifndef OBJCACHE_H_
+#define OBJCACHE_H_
+
+// Binary cache for obj::Model.
+//
+// loadModelFromFileCached("models/box.obj") looks for "models/box.obj.meshcache"
+// next to the source file. The cache stores the already converted model
+// (positions, normals, texture coordinates, per group indices and bounds), so
+// a valid cache is memory mapped and copied out without touching the text
+// parser. A cache is valid when the recorded size and modification time of the
+// source match; if only the time differs (fresh checkout, copied files) the
+// source is hashed and the cache is accepted when the hash still matches.
+//
+// With optimize set the model is reordered for the vertex cache, overdraw and
+// vertex fetch (see Mesh_Optimize.h) before it is cached, and caches written
+// without optimization are rebuilt. mesh_cache_tool --optimize does that
+// offline for a whole directory.
+
+#include "objload.h"
+#include "Mesh_Optimize.h"
+
+#include <cstdio>
+#include <cstring>
+#include <stdint.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace obj {
+
+static const char MESH_CACHE_MAGIC[4] = { 'O', 'B', 'J', 'C' };
+static const uint32_t MESH_CACHE_VERSION = 3;
+static const char * const MESH_CACHE_EXTENSION = ".meshcache";
+// MeshCacheHeader::flags
+static const uint32_t MESH_CACHE_OPTIMIZED = 1;
+
+struct MeshCacheHeader {
+    char magic[4];
+    uint32_t version;
+    uint64_t sourceSize;
+    int64_t sourceTime;
+    uint64_t sourceHash;
+    uint32_t vertexCount; //< number of floats in Model::vertex
+    uint32_t texCoordCount; //< number of floats in Model::texCoord
+    uint32_t normalCount; //< number of floats in Model::normal
+    uint32_t groupCount;
+    float boundsMin[3];
+    float boundsMax[3];
+    uint32_t flags;
+};
+
+// every group is stored as a MeshCacheGroup followed by the name (padded to 4 bytes) and the indices,
+// which are 16 bit when the model has at most 65536 vertices and 32 bit otherwise
+struct MeshCacheGroup {
+    uint32_t nameLength;
+    uint32_t indexCount;
+    uint32_t indexSize; //< 2 or 4 bytes
+};
+
+// read-only view of a whole file, memory mapped when possible
+class MappedFile {
+public:
+    MappedFile() : data(0), size(0) {
+#ifdef _WIN32
+        file = INVALID_HANDLE_VALUE;
+        mapping = 0;
+#endif
+    }
+    ~MappedFile() { close(); }
+
+    inline bool open( const std::string & path );
+    inline void close();
+
+    const char * data;
+    size_t size;
+
+private:
+    MappedFile( const MappedFile & );
+    MappedFile & operator=( const MappedFile & );
+#ifdef _WIN32
+    HANDLE file;
+    HANDLE mapping;
+#endif
+};
+
+inline bool statSourceFile( const std::string & path, uint64_t & size, int64_t & time );
+inline uint64_t hashBytes( const char * data, size_t size );
+inline bool readModelCache( const std::string & cachePath, Model & model, MeshCacheHeader * header = 0 );
+inline bool writeModelCache( const std::string & cachePath, const Model & model, uint64_t sourceSize, int64_t sourceTime, uint64_t sourceHash, uint32_t flags = 0 );
+// before/after receive the vertex cache statistics when the model is optimized
+inline bool buildModelCache( const std::string & path, bool force = false, bool optimize = false,
+    Core::VertexCacheStats * before = 0, Core::VertexCacheStats * after = 0 );
+// reorders the triangles of every group and the vertices shared by the groups, see Mesh_Optimize.h
+inline void optimizeModel( Model & model, Core::VertexCacheStats * before = 0, Core::VertexCacheStats * after = 0 );
+
+inline Model loadModelFromFileCached( const std::string & path, bool optimize = false );
+
+// ---------------------------- Implementation starts here -----------------------
+
+#ifdef _WIN32
+bool MappedFile::open( const std::string & path ){
+    close();
+    file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if(file == INVALID_HANDLE_VALUE)
+        return false;
+    LARGE_INTEGER fileSize;
+    if(!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0){
+        close();
+        return false;
+    }
+    mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if(!mapping){
+        close();
+        return false;
+    }
+    data = (const char *)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    size = (size_t)fileSize.QuadPart;
+    if(!data){
+        close();
+        return false;
+    }
+    return true;
+}
+
+void MappedFile::close(){
+    if(data)
+        UnmapViewOfFile(data);
+    if(mapping)
+        CloseHandle(mapping);
+    if(file != INVALID_HANDLE_VALUE)
+        CloseHandle(file);
+    data = 0;
+    size = 0;
+    mapping = 0;
+    file = INVALID_HANDLE_VALUE;
+}
+
+bool statSourceFile( const std::string & path, uint64_t & size, int64_t & time ){
+    struct _stat64 st;
+    if(_stat64(path.c_str(), &st) != 0)
+        return false;
+    size = (uint64_t)st.st_size;
+    time = (int64_t)st.st_mtime;
+    return true;
+}
+#else
+bool MappedFile::open( const std::string & path ){
+    close();
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if(fd < 0)
+        return false;
+    struct stat st;
+    if(fstat(fd, &st) != 0 || st.st_size == 0){
+        ::close(fd);
+        return false;
+    }
+    void * ptr = mmap(0, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if(ptr == MAP_FAILED)
+        return false;
+    data = (const char *)ptr;
+    size = (size_t)st.st_size;
+    return true;
+}
+
+void MappedFile::close(){
+    if(data)
+        munmap((void *)data, size);
+    data = 0;
+    size = 0;
+}
+
+bool statSourceFile( const std::string & path, uint64_t & size, int64_t & time ){
+    struct stat st;
+    if(stat(path.c_str(), &st) != 0)
+        return false;
+    size = (uint64_t)st.st_size;
+    time = (int64_t)st.st_mtime;
+    return true;
+}
+#endif
+
+// 64 bit FNV-1a
+uint64_t hashBytes( const char * data, size_t size ){
+    uint64_t hash = 14695981039346656037ULL;
+    for(size_t i = 0; i < size; ++i){
+        hash ^= (unsigned char)data[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+inline bool validCacheHeader( const MappedFile & file ){
+    if(file.size < sizeof(MeshCacheHeader))
+        return false;
+    const MeshCacheHeader * header = (const MeshCacheHeader *)file.data;
+    return std::memcmp(header->magic, MESH_CACHE_MAGIC, 4) == 0 && header->version == MESH_CACHE_VERSION;
+}
+
+bool readModelCache( const std::string & cachePath, Model & model, MeshCacheHeader * headerOut ){
+    MappedFile file;
+    if(!file.open(cachePath) || !validCacheHeader(file))
+        return false;
+
+    const MeshCacheHeader & header = *(const MeshCacheHeader *)file.data;
+    const char * ptr = file.data + sizeof(MeshCacheHeader);
+    const char * end = file.data + file.size;
+
+    const size_t floatBytes = sizeof(float) * ((size_t)header.vertexCount + header.texCoordCount + header.normalCount);
+    if((size_t)(end - ptr) < floatBytes)
+        return false;
+
+    Model result;
+    const float * floats = (const float *)ptr;
+    result.vertex.assign(floats, floats + header.vertexCount);
+    floats += header.vertexCount;
+    result.texCoord.assign(floats, floats + header.texCoordCount);
+    floats += header.texCoordCount;
+    result.normal.assign(floats, floats + header.normalCount);
+    ptr += floatBytes;
+
+    for(uint32_t g = 0; g < header.groupCount; ++g){
+        if((size_t)(end - ptr) < sizeof(MeshCacheGroup))
+            return false;
+        const MeshCacheGroup & group = *(const MeshCacheGroup *)ptr;
+        ptr += sizeof(MeshCacheGroup);
+        if(group.indexSize != sizeof(unsigned short) && group.indexSize != sizeof(unsigned))
+            return false;
+        const size_t paddedName = (group.nameLength + 3) & ~3u;
+        const size_t indexBytes = (((size_t)group.indexSize * group.indexCount) + 3) & ~(size_t)3;
+        if((size_t)(end - ptr) < paddedName + indexBytes)
+            return false;
+        const std::string name(ptr, group.nameLength);
+        ptr += paddedName;
+        std::vector<unsigned> & faces = result.faces[name];
+        if(group.indexSize == sizeof(unsigned short)){
+            const unsigned short * indices = (const unsigned short *)ptr;
+            faces.assign(indices, indices + group.indexCount);
+        } else {
+            const unsigned * indices = (const unsigned *)ptr;
+            faces.assign(indices, indices + group.indexCount);
+        }
+        ptr += indexBytes;
+    }
+
+    if(headerOut)
+        *headerOut = header;
+    model.vertex.swap(result.vertex);
+    model.texCoord.swap(result.texCoord);
+    model.normal.swap(result.normal);
+    model.faces.swap(result.faces);
+    return true;
+}
+
+bool writeModelCache( const std::string & cachePath, const Model & model, uint64_t sourceSize, int64_t sourceTime, uint64_t sourceHash, uint32_t flags ){
+    MeshCacheHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, MESH_CACHE_MAGIC, 4);
+    header.version = MESH_CACHE_VERSION;
+    header.sourceSize = sourceSize;
+    header.sourceTime = sourceTime;
+    header.sourceHash = sourceHash;
+    header.vertexCount = (uint32_t)model.vertex.size();
+    header.texCoordCount = (uint32_t)model.texCoord.size();
+    header.normalCount = (uint32_t)model.normal.size();
+    header.groupCount = (uint32_t)model.faces.size();
+    header.flags = flags;
+    for(int i = 0; i < 3; ++i){
+        header.boundsMin[i] = model.vertex.empty() ? 0.0f : model.vertex[i];
+        header.boundsMax[i] = header.boundsMin[i];
+    }
+    for(size_t i = 0; i < model.vertex.size(); ++i){
+        const int axis = i % 3;
+        header.boundsMin[axis] = std::min(header.boundsMin[axis], model.vertex[i]);
+        header.boundsMax[axis] = std::max(header.boundsMax[axis], model.vertex[i]);
+    }
+
+    // write to a temporary file first so a crashed run never leaves a half written cache behind
+    const std::string tempPath = cachePath + ".tmp";
+    FILE * out = std::fopen(tempPath.c_str(), "wb");
+    if(!out)
+        return false;
+
+    static const char padding[4] = { 0, 0, 0, 0 };
+    const bool shortIndices = model.shortIndices();
+    std::vector<unsigned short> narrow;
+    bool ok = std::fwrite(&header, sizeof(header), 1, out) == 1;
+    if(!model.vertex.empty())
+        ok = ok && std::fwrite(&model.vertex[0], sizeof(float), model.vertex.size(), out) == model.vertex.size();
+    if(!model.texCoord.empty())
+        ok = ok && std::fwrite(&model.texCoord[0], sizeof(float), model.texCoord.size(), out) == model.texCoord.size();
+    if(!model.normal.empty())
+        ok = ok && std::fwrite(&model.normal[0], sizeof(float), model.normal.size(), out) == model.normal.size();
+    for(std::map<std::string, std::vector<unsigned> >::const_iterator g = model.faces.begin(); g != model.faces.end(); ++g){
+        MeshCacheGroup group;
+        group.nameLength = (uint32_t)g->first.size();
+        group.indexCount = (uint32_t)g->second.size();
+        group.indexSize = shortIndices ? sizeof(unsigned short) : sizeof(unsigned);
+        ok = ok && std::fwrite(&group, sizeof(group), 1, out) == 1;
+        ok = ok && std::fwrite(g->first.data(), 1, g->first.size(), out) == g->first.size();
+        ok = ok && std::fwrite(padding, 1, ((group.nameLength + 3) & ~3u) - group.nameLength, out) == ((group.nameLength + 3) & ~3u) - group.nameLength;
+        if(!g->second.empty() && shortIndices){
+            narrow.assign(g->second.begin(), g->second.end());
+            ok = ok && std::fwrite(&narrow[0], sizeof(unsigned short), narrow.size(), out) == narrow.size();
+        } else if(!g->second.empty()){
+            ok = ok && std::fwrite(&g->second[0], sizeof(unsigned), g->second.size(), out) == g->second.size();
+        }
+        const size_t indexBytes = (size_t)group.indexSize * g->second.size();
+        ok = ok && std::fwrite(padding, 1, ((indexBytes + 3) & ~(size_t)3) - indexBytes, out) == ((indexBytes + 3) & ~(size_t)3) - indexBytes;
+    }
+    ok = (std::fclose(out) == 0) && ok;
+    if(!ok){
+        std::remove(tempPath.c_str());
+        return false;
+    }
+    std::remove(cachePath.c_str());
+    return std::rename(tempPath.c_str(), cachePath.c_str()) == 0;
+}
+
+// checks the cache header against the source file, hashing the source only when the timestamp changed
+inline bool cacheMatchesSource( const MeshCacheHeader & header, const std::string & path, uint64_t sourceSize, int64_t sourceTime ){
+    if(header.sourceSize != sourceSize)
+        return false;
+    if(header.sourceTime == sourceTime)
+        return true;
+    MappedFile source;
+    if(!source.open(path))
+        return false;
+    return hashBytes(source.data, source.size) == header.sourceHash;
+}
+
+void optimizeModel( Model & model, Core::VertexCacheStats * before, Core::VertexCacheStats * after ){
+    const size_t vertexCount = model.vertexCount();
+    if(vertexCount == 0)
+        return;
+    std::vector<unsigned> indices;
+    for(std::map<std::string, std::vector<unsigned> >::iterator g = model.faces.begin(); g != model.faces.end(); ++g){
+        std::vector<unsigned> & faces = g->second;
+        if(faces.empty())
+            continue;
+        if(before)
+            before->add(Core::analyzeVertexCache(&faces[0], faces.size(), vertexCount));
+        Core::optimizeVertexCache(&faces[0], faces.size(), vertexCount);
+        Core::optimizeOverdraw(&faces[0], faces.size(), &model.vertex[0], 3, vertexCount);
+        indices.insert(indices.end(), faces.begin(), faces.end());
+    }
+    if(indices.empty())
+        return;
+
+    // one vertex order for all groups, they share the vertices
+    std::vector<unsigned> remap;
+    const size_t usedCount = Core::optimizeVertexFetch(&indices[0], indices.size(), vertexCount, remap);
+    size_t offset = 0;
+    for(std::map<std::string, std::vector<unsigned> >::iterator g = model.faces.begin(); g != model.faces.end(); ++g){
+        std::copy(indices.begin() + offset, indices.begin() + offset + g->second.size(), g->second.begin());
+        offset += g->second.size();
+        if(after && !g->second.empty())
+            after->add(Core::analyzeVertexCache(&g->second[0], g->second.size(), usedCount));
+    }
+
+    std::vector<float> vertex(usedCount * 3), texCoord(model.texCoord.empty() ? 0 : usedCount * 2), normal(model.normal.empty() ? 0 : usedCount * 3);
+    for(size_t v = 0; v < vertexCount; ++v){
+        const unsigned to = remap[v];
+        if(to == ~0u)
+            continue;
+        std::copy(&model.vertex[v * 3], &model.vertex[v * 3] + 3, &vertex[to * 3]);
+        if(!texCoord.empty() && model.texCoord.size() >= (v + 1) * 2)
+            std::copy(&model.texCoord[v * 2], &model.texCoord[v * 2] + 2, &texCoord[to * 2]);
+        if(!normal.empty() && model.normal.size() >= (v + 1) * 3)
+            std::copy(&model.normal[v * 3], &model.normal[v * 3] + 3, &normal[to * 3]);
+    }
+    model.vertex.swap(vertex);
+    model.texCoord.swap(texCoord);
+    model.normal.swap(normal);
+}
+
+// (re)builds the cache of a single OBJ file, returns false when the cache could not be written
+bool buildModelCache( const std::string & path, bool force, bool optimize, Core::VertexCacheStats * before, Core::VertexCacheStats * after ){
+    uint64_t sourceSize = 0;
+    int64_t sourceTime = 0;
+    if(!statSourceFile(path, sourceSize, sourceTime))
+        return false;
+    const std::string cachePath = path + MESH_CACHE_EXTENSION;
+
+    if(!force){
+        MappedFile cache;
+        if(cache.open(cachePath) && validCacheHeader(cache) && cacheMatchesSource(*(const MeshCacheHeader *)cache.data, path, sourceSize, sourceTime)
+            && (!optimize || (((const MeshCacheHeader *)cache.data)->flags & MESH_CACHE_OPTIMIZED)))
+            return true;
+    }
+
+    MappedFile source;
+    if(!source.open(path))
+        return false;
+    const uint64_t sourceHash = hashBytes(source.data, source.size);
+    Model model = loadModelFromMemory(source.data, source.size);
+    if(optimize)
+        optimizeModel(model, before, after);
+    return writeModelCache(cachePath, model, sourceSize, sourceTime, sourceHash, optimize ? MESH_CACHE_OPTIMIZED : 0);
+}
+
+Model loadModelFromFileCached( const std::string & path, bool optimize ){
+    uint64_t sourceSize = 0;
+    int64_t sourceTime = 0;
+    if(!statSourceFile(path, sourceSize, sourceTime))
+        return loadModelFromFile(path);
+    const std::string cachePath = path + MESH_CACHE_EXTENSION;
+
+    Model model;
+    MeshCacheHeader header;
+    if(readModelCache(cachePath, model, &header) && (!optimize || (header.flags & MESH_CACHE_OPTIMIZED))){
+        if(header.sourceSize == sourceSize && header.sourceTime == sourceTime)
+            return model;
+        if(cacheMatchesSource(header, path, sourceSize, sourceTime)){
+            // same content, only the timestamp moved: refresh the header so the next start skips hashing
+            writeModelCache(cachePath, model, sourceSize, sourceTime, header.sourceHash, header.flags);
+            return model;
+        }
+    }
+
+    MappedFile source;
+    if(!source.open(path))
+        return loadModelFromFile(path);
+    const uint64_t sourceHash = hashBytes(source.data, source.size);
+    model = loadModelFromMemory(source.data, source.size);
+    if(optimize)
+        optimizeModel(model);
+    if(!writeModelCache(cachePath, model, sourceSize, sourceTime, sourceHash, optimize ? MESH_CACHE_OPTIMIZED : 0))
+        std::cout << "Mesh cache could not be written: " << cachePath << std::endl;
+    return model;
+}
+
+} // namespace obj
+
+#endif // OBJCACHE_H_
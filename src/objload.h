@@ -25,12 +25,17 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
 #define OBJLOAD_H_
 
 #include <algorithm>
+#include <cfloat>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <fstream>
 #include <iostream>
 #include <sstream>
 #include <string>
 #include <map>
 #include <set>
+#include <thread>
 #include <vector>
 
 namespace obj {
@@ -40,7 +45,12 @@ struct Model {
     std::vector<float> texCoord; //< 2 * N entries
     std::vector<float> normal; //< 3 * N entries
     
-    std::map<std::string, std::vector<unsigned short> > faces; //< assume triangels and uniform indexing
+    // one index list per OBJ group, "default" holds the faces of every group; assume triangels and uniform indexing
+    std::map<std::string, std::vector<unsigned> > faces;
+
+    size_t vertexCount() const { return vertex.size() / 3; }
+    // true when every index fits into an unsigned short and the faces can be uploaded as 16 bit indices
+    bool shortIndices() const { return vertexCount() <= 65536; }
 };
 
 struct ObjModel {
@@ -62,11 +72,14 @@ struct ObjModel {
 };
 
 inline ObjModel parseObjModel( std::istream & in);
+inline ObjModel parseObjModel( const char * begin, const char * end );
+inline ObjModel parseObjModelParallel( const char * begin, const char * end, unsigned threads = 0 );
 inline void tesselateObjModel( ObjModel & obj);
 inline ObjModel tesselateObjModel( const ObjModel & obj );
 inline Model convertToModel( const ObjModel & obj );
 
 inline Model loadModel( std::istream & in );
+inline Model loadModelFromMemory( const char * data, size_t size );
 inline Model loadModelFromString( const std::string & in );
 inline Model loadModelFromFile( const std::string & in );
 
@@ -165,6 +178,418 @@ ObjModel parseObjModel( std::istream & in ){
     return data;
 }
 
+// Scanners used by the in-memory parser. They follow the istream based parser token by token
+// (including how missing texture/normal indices end up as -1 or -2), so both parsers produce
+// identical ObjModels.
+namespace scan {
+
+inline bool isSpace( char c ){
+    return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+}
+
+inline const char * skipSpace( const char * p, const char * end ){
+    while(p != end && isSpace(*p))
+        ++p;
+    return p;
+}
+
+inline bool isDigit( char c ){
+    return c >= '0' && c <= '9';
+}
+
+inline bool parseInt( const char * & p, const char * end, int & value ){
+    p = skipSpace(p, end);
+    const char * s = p;
+    bool negative = false;
+    if(s != end && (*s == '-' || *s == '+')){
+        negative = (*s == '-');
+        ++s;
+    }
+    if(s == end || !isDigit(*s)){
+        p = s;
+        return false;
+    }
+    long long result = 0;
+    while(s != end && isDigit(*s)){
+        result = result * 10 + (*s - '0');
+        ++s;
+    }
+    value = (int)(negative ? -result : result);
+    p = s;
+    return true;
+}
+
+// Reads a decimal float. Values with at most 15 significant digits and a small exponent are
+// computed exactly in double precision and rounded once to float (Clinger's fast path); anything
+// else, and the rare double value sitting exactly between two floats, goes through strtof so the
+// result always matches what operator>> would have produced.
+inline bool parseFloat( const char * & p, const char * end, float & value ){
+    static const double powers[] = {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10,
+        1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+
+    p = skipSpace(p, end);
+    const char * s = p;
+    const char * c = p;
+    bool negative = false;
+    if(c != end && (*c == '-' || *c == '+')){
+        negative = (*c == '-');
+        ++c;
+    }
+
+    unsigned long long mantissa = 0;
+    int digits = 0;
+    int significant = 0;
+    int exponent = 0;
+    for(; c != end && isDigit(*c); ++c, ++digits){
+        if(significant < 19){
+            mantissa = mantissa * 10 + (*c - '0');
+            if(mantissa)
+                ++significant;
+        } else {
+            ++exponent;
+        }
+    }
+    if(c != end && *c == '.'){
+        for(++c; c != end && isDigit(*c); ++c, ++digits){
+            if(significant < 19){
+                mantissa = mantissa * 10 + (*c - '0');
+                if(mantissa)
+                    ++significant;
+                --exponent;
+            }
+        }
+    }
+    if(digits == 0){
+        p = c;
+        return false;
+    }
+    if(c != end && (*c == 'e' || *c == 'E')){
+        const char * e = c + 1;
+        bool negativeExponent = false;
+        if(e != end && (*e == '-' || *e == '+')){
+            negativeExponent = (*e == '-');
+            ++e;
+        }
+        // like operator>>, an exponent marker without digits makes the whole number invalid
+        if(e == end || !isDigit(*e)){
+            p = e;
+            return false;
+        }
+        int exp = 0;
+        for(; e != end && isDigit(*e); ++e)
+            exp = std::min(exp * 10 + (*e - '0'), 100000);
+        exponent += negativeExponent ? -exp : exp;
+        c = e;
+    }
+    p = c;
+
+    if(significant <= 15 && exponent >= -22 && exponent <= 22){
+        double result = (double)mantissa;
+        result = (exponent < 0) ? result / powers[-exponent] : result * powers[exponent];
+        unsigned long long bits;
+        std::memcpy(&bits, &result, sizeof(bits));
+        // low 29 bits of the double mantissa are dropped when rounding to float, a value of exactly
+        // one half there would be rounded twice
+        if((bits & ((1ULL << 29) - 1)) != (1ULL << 28)){
+            value = (float)(negative ? -result : result);
+            return true;
+        }
+    }
+
+    char buffer[64];
+    std::string longToken;
+    const char * token = buffer;
+    const size_t length = (size_t)(c - s);
+    if(length < sizeof(buffer)){
+        std::memcpy(buffer, s, length);
+        buffer[length] = 0;
+    } else {
+        longToken.assign(s, c);
+        token = longToken.c_str();
+    }
+    const float result = std::strtof(token, 0);
+    // out of range values fail the same way they do in operator>>
+    if(result > FLT_MAX || result < -FLT_MAX)
+        return false;
+    value = result;
+    return true;
+}
+
+inline bool parseFaceVertex( const char * & p, const char * end, ObjModel::FaceVertex & f ){
+    f = ObjModel::FaceVertex();
+    if(!parseInt(p, end, f.v))
+        return false;
+    if(p != end && *p == '/'){
+        ++p;
+        if(!parseInt(p, end, f.t))
+            f.t = 0;
+        if(p != end && *p == '/'){
+            ++p;
+            if(!parseInt(p, end, f.n))
+                f.n = 0;
+        }
+    }
+    --f.v;
+    --f.t;
+    --f.n;
+    return true;
+}
+
+inline bool tokenEquals( const char * begin, const char * end, const char * str ){
+    const size_t length = std::strlen(str);
+    return (size_t)(end - begin) == length && std::memcmp(begin, str, length) == 0;
+}
+
+} // namespace scan
+
+// Faces of a contiguous piece of an OBJ file. Faces are stored once together with the group set
+// that was active for them; group set 0 stands for the groups active before the chunk starts, which
+// is only known once the preceding chunks are parsed.
+struct ObjChunk {
+    ObjChunk() : groupSets(1), finalGroupSet(0) {}
+
+    std::vector<float> vertex;
+    std::vector<float> texCoord;
+    std::vector<float> normal;
+
+    std::vector<ObjModel::FaceVertex> faceVertices;
+    std::vector<unsigned> faceStart; //< first entry of every face in faceVertices
+    std::vector<unsigned> faceGroupSet; //< group set of every face
+    std::vector<std::vector<std::string> > groupSets;
+    unsigned finalGroupSet; //< group set active at the end of the chunk
+};
+
+inline void parseObjChunk( const char * begin, const char * end, ObjChunk & chunk ){
+    std::set<std::string> groups;
+
+    const char * line = begin;
+    while(line < end){
+        const char * lineEnd = (const char *)std::memchr(line, '\n', end - line);
+        if(!lineEnd)
+            lineEnd = end;
+
+        const char * p = scan::skipSpace(line, lineEnd);
+        const char * op = p;
+        while(p != lineEnd && !scan::isSpace(*p))
+            ++p;
+        const char * opEnd = p;
+        line = lineEnd + 1;
+        if(op == opEnd)
+            continue;
+
+        float value;
+        if(scan::tokenEquals(op, opEnd, "v")){
+            for(int i = 0; i < 3 && scan::parseFloat(p, lineEnd, value); ++i)
+                chunk.vertex.push_back(value);
+        }
+        else if(scan::tokenEquals(op, opEnd, "vt")){
+            for(int i = 0; i < 3 && scan::parseFloat(p, lineEnd, value); ++i)
+                chunk.texCoord.push_back(value);
+        }
+        else if(scan::tokenEquals(op, opEnd, "vn")){
+            for(int i = 0; i < 3 && scan::parseFloat(p, lineEnd, value); ++i)
+                chunk.normal.push_back(value);
+        }
+        else if(scan::tokenEquals(op, opEnd, "g")){
+            groups.clear();
+            for(p = scan::skipSpace(p, lineEnd); p != lineEnd; p = scan::skipSpace(p, lineEnd)){
+                const char * name = p;
+                while(p != lineEnd && !scan::isSpace(*p))
+                    ++p;
+                groups.insert(std::string(name, p));
+            }
+            groups.insert("default");
+            chunk.groupSets.push_back(std::vector<std::string>(groups.begin(), groups.end()));
+            chunk.finalGroupSet = chunk.groupSets.size() - 1;
+        }
+        else if(scan::tokenEquals(op, opEnd, "f")){
+            chunk.faceStart.push_back(chunk.faceVertices.size());
+            chunk.faceGroupSet.push_back(chunk.finalGroupSet);
+            ObjModel::FaceVertex f;
+            while(scan::parseFaceVertex(p, lineEnd, f))
+                chunk.faceVertices.push_back(f);
+        }
+    }
+}
+
+// appends a parsed chunk to the model, activeGroups holds the groups active before the chunk and is
+// updated to the groups active after it
+inline void appendObjChunk( ObjModel & data, const ObjChunk & chunk, std::vector<std::string> & activeGroups ){
+    data.vertex.insert(data.vertex.end(), chunk.vertex.begin(), chunk.vertex.end());
+    data.texCoord.insert(data.texCoord.end(), chunk.texCoord.begin(), chunk.texCoord.end());
+    data.normal.insert(data.normal.end(), chunk.normal.begin(), chunk.normal.end());
+
+    // face lists are only created for group sets that actually have faces, like the istream parser does
+    std::vector<std::vector<ObjModel::FaceList *> > targets(chunk.groupSets.size());
+    for(size_t face = 0; face < chunk.faceStart.size(); ++face){
+        const unsigned set = chunk.faceGroupSet[face];
+        std::vector<ObjModel::FaceList *> & lists = targets[set];
+        if(lists.empty()){
+            const std::vector<std::string> & names = set ? chunk.groupSets[set] : activeGroups;
+            for(std::vector<std::string>::const_iterator g = names.begin(); g != names.end(); ++g)
+                lists.push_back(&data.faces[*g]);
+        }
+        const unsigned first = chunk.faceStart[face];
+        const unsigned last = (face + 1 < chunk.faceStart.size()) ? chunk.faceStart[face + 1] : chunk.faceVertices.size();
+        for(std::vector<ObjModel::FaceList *>::const_iterator l = lists.begin(); l != lists.end(); ++l){
+            ObjModel::FaceList & fl = **l;
+            fl.second.push_back(fl.first.size());
+            fl.first.insert(fl.first.end(), chunk.faceVertices.begin() + first, chunk.faceVertices.begin() + last);
+        }
+    }
+    if(chunk.finalGroupSet)
+        activeGroups = chunk.groupSets[chunk.finalGroupSet];
+}
+
+inline void finishObjModel( ObjModel & data ){
+    for(std::map<std::string, ObjModel::FaceList>::iterator g = data.faces.begin(); g != data.faces.end(); ++g){
+        ObjModel::FaceList & fl = g->second;
+        fl.second.push_back(fl.first.size());
+    }
+}
+
+ObjModel parseObjModel( const char * begin, const char * end ){
+    ObjChunk chunk;
+    parseObjChunk(begin, end, chunk);
+
+    ObjModel data;
+    std::vector<std::string> activeGroups(1, "default");
+    appendObjChunk(data, chunk, activeGroups);
+    finishObjModel(data);
+    return data;
+}
+
+// runs job(0) .. job(count - 1), job(0) on the calling thread and the others on their own threads
+template <typename Job>
+inline void runParallel( unsigned count, const Job & job ){
+    std::vector<std::thread> workers;
+    for(unsigned i = 1; i < count; ++i)
+        workers.push_back(std::thread(job, i));
+    job(0);
+    for(size_t i = 0; i < workers.size(); ++i)
+        workers[i].join();
+}
+
+// Splits the buffer into line aligned byte ranges, parses them on worker threads and merges the
+// results in file order. Face indices in OBJ files are absolute, so only the face list offsets and
+// the active groups at the chunk borders need fixing up: a counting pass computes where every chunk's
+// faces go in each group and a second pass copies them there, both on the worker threads.
+// Small inputs are parsed on the calling thread.
+ObjModel parseObjModelParallel( const char * begin, const char * end, unsigned threads ){
+    static const size_t MIN_CHUNK_SIZE = 1 << 20;
+    const size_t size = end - begin;
+    if(threads == 0)
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    threads = (unsigned)std::min<size_t>(threads, std::max<size_t>(1, size / MIN_CHUNK_SIZE));
+    if(threads <= 1)
+        return parseObjModel(begin, end);
+
+    std::vector<const char *> borders(1, begin);
+    for(unsigned i = 1; i < threads; ++i){
+        const char * split = std::max(borders.back(), begin + size / threads * i);
+        const char * lineEnd = (const char *)std::memchr(split, '\n', end - split);
+        borders.push_back(lineEnd ? lineEnd + 1 : end);
+    }
+    borders.push_back(end);
+
+    std::vector<ObjChunk> chunks(threads);
+    runParallel(threads, [&](unsigned i){ parseObjChunk(borders[i], borders[i + 1], chunks[i]); });
+
+    // resolve the group sets of every chunk to global group ids, "default" always exists
+    std::map<std::string, unsigned> groupIds;
+    std::vector<std::string> groupNames;
+    std::vector<std::vector<std::vector<unsigned> > > chunkSets(threads);
+    std::vector<std::string> activeGroups(1, "default");
+    for(unsigned i = 0; i < threads; ++i){
+        const ObjChunk & chunk = chunks[i];
+        chunkSets[i].resize(chunk.groupSets.size());
+        for(size_t set = 0; set < chunk.groupSets.size(); ++set){
+            const std::vector<std::string> & names = set ? chunk.groupSets[set] : activeGroups;
+            for(std::vector<std::string>::const_iterator g = names.begin(); g != names.end(); ++g){
+                std::map<std::string, unsigned>::iterator id = groupIds.find(*g);
+                if(id == groupIds.end()){
+                    id = groupIds.insert(std::make_pair(*g, (unsigned)groupNames.size())).first;
+                    groupNames.push_back(*g);
+                }
+                chunkSets[i][set].push_back(id->second);
+            }
+        }
+        if(chunk.finalGroupSet)
+            activeGroups = chunk.groupSets[chunk.finalGroupSet];
+    }
+    const size_t groupCount = groupNames.size();
+
+    // first pass: faces and face vertices every chunk contributes to every group
+    std::vector<std::vector<unsigned> > faceCounts(threads, std::vector<unsigned>(groupCount, 0));
+    std::vector<std::vector<unsigned> > vertexCounts(threads, std::vector<unsigned>(groupCount, 0));
+    runParallel(threads, [&](unsigned i){
+        const ObjChunk & chunk = chunks[i];
+        for(size_t face = 0; face < chunk.faceStart.size(); ++face){
+            const unsigned last = (face + 1 < chunk.faceStart.size()) ? chunk.faceStart[face + 1] : chunk.faceVertices.size();
+            const std::vector<unsigned> & groups = chunkSets[i][chunk.faceGroupSet[face]];
+            for(std::vector<unsigned>::const_iterator g = groups.begin(); g != groups.end(); ++g){
+                faceCounts[i][*g] += 1;
+                vertexCounts[i][*g] += last - chunk.faceStart[face];
+            }
+        }
+    });
+
+    // offsets of every chunk inside the merged streams
+    ObjModel data;
+    std::vector<size_t> vertexOffset(threads + 1, 0), texCoordOffset(threads + 1, 0), normalOffset(threads + 1, 0);
+    std::vector<std::vector<unsigned> > faceOffsets(threads, std::vector<unsigned>(groupCount, 0));
+    std::vector<std::vector<unsigned> > faceVertexOffsets(threads, std::vector<unsigned>(groupCount, 0));
+    std::vector<ObjModel::FaceList *> lists(groupCount, 0);
+    for(unsigned i = 0; i < threads; ++i){
+        vertexOffset[i + 1] = vertexOffset[i] + chunks[i].vertex.size();
+        texCoordOffset[i + 1] = texCoordOffset[i] + chunks[i].texCoord.size();
+        normalOffset[i + 1] = normalOffset[i] + chunks[i].normal.size();
+    }
+    for(size_t g = 0; g < groupCount; ++g){
+        unsigned faces = 0, vertices = 0;
+        for(unsigned i = 0; i < threads; ++i){
+            faceOffsets[i][g] = faces;
+            faceVertexOffsets[i][g] = vertices;
+            faces += faceCounts[i][g];
+            vertices += vertexCounts[i][g];
+        }
+        if(faces == 0)
+            continue;
+        lists[g] = &data.faces[groupNames[g]];
+        lists[g]->first.resize(vertices);
+        lists[g]->second.resize(faces + 1);
+        lists[g]->second[faces] = vertices;
+    }
+    data.vertex.resize(vertexOffset[threads]);
+    data.texCoord.resize(texCoordOffset[threads]);
+    data.normal.resize(normalOffset[threads]);
+
+    // second pass: every chunk copies its data to the precomputed positions
+    runParallel(threads, [&](unsigned i){
+        ObjChunk & chunk = chunks[i];
+        std::copy(chunk.vertex.begin(), chunk.vertex.end(), data.vertex.begin() + vertexOffset[i]);
+        std::copy(chunk.texCoord.begin(), chunk.texCoord.end(), data.texCoord.begin() + texCoordOffset[i]);
+        std::copy(chunk.normal.begin(), chunk.normal.end(), data.normal.begin() + normalOffset[i]);
+        std::vector<unsigned> faceOffset = faceOffsets[i];
+        std::vector<unsigned> faceVertexOffset = faceVertexOffsets[i];
+        for(size_t face = 0; face < chunk.faceStart.size(); ++face){
+            const unsigned first = chunk.faceStart[face];
+            const unsigned last = (face + 1 < chunk.faceStart.size()) ? chunk.faceStart[face + 1] : chunk.faceVertices.size();
+            const std::vector<unsigned> & groups = chunkSets[i][chunk.faceGroupSet[face]];
+            for(std::vector<unsigned>::const_iterator g = groups.begin(); g != groups.end(); ++g){
+                ObjModel::FaceList & fl = *lists[*g];
+                fl.second[faceOffset[*g]++] = faceVertexOffset[*g];
+                std::copy(chunk.faceVertices.begin() + first, chunk.faceVertices.begin() + last, fl.first.begin() + faceVertexOffset[*g]);
+                faceVertexOffset[*g] += last - first;
+            }
+        }
+        chunk = ObjChunk();
+    });
+    return data;
+}
+
 inline void tesselateObjModel( std::vector<ObjModel::FaceVertex> & input, std::vector<unsigned> & input_start){
     std::vector<ObjModel::FaceVertex> output;
     std::vector<unsigned> output_start;
@@ -198,15 +623,77 @@ void tesselateObjModel( ObjModel & obj){
     }
 }
 
+// open addressing hash map from FaceVertex to its index in the converted Model
+class FaceVertexIndex {
+public:
+    explicit FaceVertexIndex( size_t expected ){
+        size_t capacity = 16;
+        while(capacity < expected * 2)
+            capacity *= 2;
+        keys.resize(capacity);
+        values.assign(capacity, (unsigned)EMPTY);
+        mask = capacity - 1;
+    }
+
+    // returns the index of f, inserting it with nextIndex when it is not in the map yet
+    unsigned insert( const ObjModel::FaceVertex & f, unsigned nextIndex, bool & inserted ){
+        size_t slot = hash(f) & mask;
+        while(values[slot] != EMPTY){
+            if(keys[slot] == f){
+                inserted = false;
+                return values[slot];
+            }
+            slot = (slot + 1) & mask;
+        }
+        keys[slot] = f;
+        values[slot] = nextIndex;
+        inserted = true;
+        return nextIndex;
+    }
+
+    unsigned find( const ObjModel::FaceVertex & f ) const {
+        size_t slot = hash(f) & mask;
+        while(values[slot] != EMPTY){
+            if(keys[slot] == f)
+                return values[slot];
+            slot = (slot + 1) & mask;
+        }
+        return EMPTY;
+    }
+
+private:
+    enum { EMPTY = 0xffffffffu };
+
+    static size_t hash( const ObjModel::FaceVertex & f ){
+        unsigned long long h = (unsigned)f.v * 0x9E3779B97F4A7C15ULL;
+        h ^= ((unsigned)f.t + 0x632BE59BD9B4E019ULL) * 0xC2B2AE3D27D4EB4FULL;
+        h ^= ((unsigned)f.n + 0x85EBCA77C2B2AE63ULL) * 0x165667B19E3779F9ULL;
+        return (size_t)(h ^ (h >> 29));
+    }
+
+    std::vector<ObjModel::FaceVertex> keys;
+    std::vector<unsigned> values;
+    size_t mask;
+};
+
 Model convertToModel( const ObjModel & obj ) {
-    // insert all face vertices into a vector and make unique
-    std::vector<ObjModel::FaceVertex> unique(obj.faces.find("default")->second.first);
-    std::sort(unique.begin(), unique.end());
-    unique.erase( std::unique(unique.begin(), unique.end()), unique.end());
+    // every face is part of the "default" group, so its face vertices define the unique vertex set.
+    // Vertices are numbered in order of first use while walking the faces once.
+    const std::vector<ObjModel::FaceVertex> & all = obj.faces.find("default")->second.first;
+    FaceVertexIndex lookup(all.size());
 
     // build a new model with repeated vertices/texcoords/normals to have single indexing
     Model model;
-    for(std::vector<ObjModel::FaceVertex>::const_iterator f = unique.begin(); f != unique.end(); ++f){
+    std::vector<unsigned> & defaultFaces = model.faces["default"];
+    defaultFaces.reserve(all.size());
+    unsigned count = 0;
+    for(std::vector<ObjModel::FaceVertex>::const_iterator f = all.begin(); f != all.end(); ++f){
+        bool inserted;
+        const unsigned index = lookup.insert(*f, count, inserted);
+        defaultFaces.push_back(index);
+        if(!inserted)
+            continue;
+        ++count;
         model.vertex.insert(model.vertex.end(), obj.vertex.begin() + 3*f->v, obj.vertex.begin() + 3*f->v + 3);
         if(!obj.texCoord.empty()){
             const int index = (f->t > -1) ? f->t : f->v;
@@ -217,16 +704,15 @@ Model convertToModel( const ObjModel & obj ) {
             model.normal.insert(model.normal.end(), obj.normal.begin() + 3*index, obj.normal.begin() + 3*index + 3);
         }
     }
-    // look up unique index and transform face descriptions
+    // look up unique index and transform face descriptions of the other groups
     for(std::map<std::string, ObjModel::FaceList>::const_iterator g = obj.faces.begin(); g != obj.faces.end(); ++g){
-        const std::string & name = g->first;
+        if(g->first == "default")
+            continue;
         const ObjModel::FaceList & fl = g->second;
-        std::vector<unsigned short> & v = model.faces[g->first];
+        std::vector<unsigned> & v = model.faces[g->first];
         v.reserve(fl.first.size());
-        for(std::vector<ObjModel::FaceVertex>::const_iterator f = fl.first.begin(); f != fl.first.end(); ++f){
-            const unsigned short index = std::distance(unique.begin(), std::lower_bound(unique.begin(), unique.end(), *f));
-            v.push_back(index);
-        }
+        for(std::vector<ObjModel::FaceVertex>::const_iterator f = fl.first.begin(); f != fl.first.end(); ++f)
+            v.push_back(lookup.find(*f));
     }
     return model;
 }
@@ -243,14 +729,31 @@ Model loadModel( std::istream & in ){
     return convertToModel(model);
 }
 
+Model loadModelFromMemory( const char * data, size_t size ){
+    ObjModel model = parseObjModelParallel(data, data + size);
+    tesselateObjModel(model);
+    return convertToModel(model);
+}
+
 Model loadModelFromString( const std::string & str ){
-    std::istringstream in(str);
-    return loadModel(in);
+    return loadModelFromMemory(str.data(), str.size());
 }
 
 Model loadModelFromFile( const std::string & str) {
-    std::ifstream in(str.c_str());
-    return loadModel(in);
+    // read the whole file at once and parse it in memory, no per line stream objects
+    std::vector<char> buffer;
+    FILE * file = std::fopen(str.c_str(), "rb");
+    if(file){
+        std::fseek(file, 0, SEEK_END);
+        const long size = std::ftell(file);
+        std::fseek(file, 0, SEEK_SET);
+        if(size > 0){
+            buffer.resize((size_t)size);
+            buffer.resize(std::fread(&buffer[0], 1, buffer.size(), file));
+        }
+        std::fclose(file);
+    }
+    return loadModelFromMemory(buffer.empty() ? 0 : &buffer[0], buffer.size());
 }
 
 inline std::ostream & operator<<( std::ostream & out, const ObjModel::FaceVertex & f){
@@ -276,7 +779,7 @@ std::ostream & operator<<( std::ostream & out, const Model & m ){
     }
     if(!m.faces.empty()){
         out << "faces\t";
-        for(std::map<std::string, std::vector<unsigned short> >::const_iterator g = m.faces.begin(); g != m.faces.end(); ++g){
+        for(std::map<std::string, std::vector<unsigned> >::const_iterator g = m.faces.begin(); g != m.faces.end(); ++g){
             out << g->first << " ";
         }
         out << "\n";
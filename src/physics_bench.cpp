@@ -0,0 +1,125 @@
+// Measures how the PhysX step time scales with the worker threads (see PhysicsConfig).
+//
+// usage: physics_bench [maxBoxes] [steps]
+//   maxBoxes - largest scene, 100000 by default; the scenes have 1k, 10k, 100k ... boxes
+//   steps    - simulated steps per run, 120 by default (two seconds at 60 Hz)
+//
+// Drops the boxes from a lattice onto a ground plane, so the runs include the free fall, the
+// impacts and the piles settling, and prints the average and worst step time for 1, 2, 4, ...
+// up to all hardware threads, once with PxDefaultCpuDispatcher and once with the work-stealing
+// Core::JobSystem behind a JobDispatcher.
+// After the PxDefaultCpuDispatcher runs it also times a QueryBatch of raycasts and sphere
+// sweeps into the settled scene, on the calling thread and on a job system with as many threads.
+
+#include "Physics.h"
+#include "Scene_Queries.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <thread>
+#include <vector>
+
+static void addBoxes(Physics& physics, int boxCount)
+{
+	PxMaterial* material = physics.physics->createMaterial(0.5f, 0.5f, 0.3f);
+	PxRigidStatic* ground = PxCreatePlane(*physics.physics, PxPlane(0, 1, 0, 0), *material);
+	physics.scene->addActor(*ground);
+
+	// a square lattice 20 boxes high with gaps, so that the boxes collide only when they land
+	int layers = std::min(20, boxCount);
+	int side = (int)std::ceil(std::sqrt(boxCount / (double)layers));
+	float spacing = 2.5f;
+	PxShape* shape = physics.physics->createShape(PxBoxGeometry(0.5f, 0.5f, 0.5f), *material);
+	for (int i = 0; i < boxCount; i++) {
+		int layer = i / (side * side), cell = i % (side * side);
+		PxVec3 position((cell % side - side * 0.5f) * spacing, 1.0f + layer * spacing, (cell / side - side * 0.5f) * spacing);
+		PxRigidDynamic* box = physics.physics->createRigidDynamic(PxTransform(position));
+		box->attachShape(*shape);
+		PxRigidBodyExt::updateMassAndInertia(*box, 1.0f);
+		physics.scene->addActor(*box);
+	}
+	shape->release();
+}
+
+// rays and sweeps straight down onto the area the boxes cover, returns the milliseconds of execute()
+static double timeQueries(Physics& physics, QueryBatch& batch, int boxCount, Core::JobSystem* jobs)
+{
+	float extent = std::sqrt(boxCount / 20.0f) * 2.5f * 0.5f + 1.0f;
+	std::mt19937 random(1);
+	std::uniform_real_distribution<float> position(-extent, extent);
+	batch.clear();
+	for (int i = 0; i < batch.capacity(); i++) {
+		PxVec3 origin(position(random), 100.0f, position(random));
+		if (i % 2)
+			batch.sweepSphere(origin, PxVec3(0.0f, -1.0f, 0.0f), 0.25f, 200.0f);
+		else
+			batch.raycast(origin, PxVec3(0.0f, -1.0f, 0.0f), 200.0f);
+	}
+
+	auto start = std::chrono::steady_clock::now();
+	batch.execute(*physics.scene, jobs);
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char** argv)
+{
+	int maxBoxes = argc > 1 ? atoi(argv[1]) : 100000;
+	int steps = argc > 2 ? atoi(argv[2]) : 120;
+	int hardwareThreads = std::max(1, (int)std::thread::hardware_concurrency());
+
+	std::vector<int> threadCounts;
+	for (int threads = 1; threads < hardwareThreads; threads *= 2)
+		threadCounts.push_back(threads);
+	threadCounts.push_back(hardwareThreads);
+
+	QueryBatch queries(4096);
+	for (int boxCount = 1000; boxCount <= maxBoxes; boxCount *= 10) {
+		double singleThreadMs[2] = {};
+		for (int threads : threadCounts) {
+			for (int useJobSystem = 0; useJobSystem < 2; useJobSystem++) {
+				PhysicsConfig config;
+				config.threadCount = threads;
+				config.useJobSystem = useJobSystem != 0;
+				// the boxes spread over a few hundred meters at most
+				config.worldBounds = PxBounds3(PxVec3(-500.0f), PxVec3(500.0f));
+				Physics physics(config);
+				addBoxes(physics, boxCount);
+
+				double totalMs = 0.0, worstMs = 0.0;
+				for (int step = 0; step < steps; step++) {
+					auto start = std::chrono::steady_clock::now();
+					physics.step(1.0f / 60.0f);
+					double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+					totalMs += ms;
+					worstMs = std::max(worstMs, ms);
+				}
+				double averageMs = totalMs / steps;
+				if (threads == 1)
+					singleThreadMs[useJobSystem] = averageMs;
+
+				char line[256];
+				snprintf(line, sizeof(line), "%7d boxes  %2d threads  %-8s  step %8.3f ms  worst %8.3f ms  speedup %5.2fx",
+					boxCount, threads, useJobSystem ? "jobs" : "default", averageMs, worstMs, singleThreadMs[useJobSystem] / averageMs);
+				std::cout << line << std::endl;
+
+				if (!useJobSystem) {
+					Core::JobSystem jobs(threads);
+					double singleMs = timeQueries(physics, queries, boxCount, nullptr);
+					double jobsMs = timeQueries(physics, queries, boxCount, &jobs);
+					int hits = 0;
+					for (int i = 0; i < queries.size(); i++)
+						hits += queries.result(i).hit();
+					snprintf(line, sizeof(line), "%7d boxes  %2d threads  queries   %d in %8.3f ms on one thread, %8.3f ms on jobs (%.1f M/s), %d hits",
+						boxCount, threads, queries.size(), singleMs, jobsMs, queries.size() / jobsMs / 1000.0, hits);
+					std::cout << line << std::endl;
+				}
+			}
+		}
+	}
+	return 0;
+}
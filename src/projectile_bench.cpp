@@ -0,0 +1,187 @@
+// Measures how many small fast projectiles tunnel through a thin wall, and what keeping them from
+// it costs (see Projectiles.h).
+//
+// usage: projectile_bench [projectiles] [steps]
+//   projectiles - spheres per tunneling run and largest pool of the throughput runs, 4096 by default
+//   steps       - simulated steps per run, 120 by default (two seconds at 60 Hz)
+//
+// Tunneling: fires a grid of projectiles at once at a static wall 10 cm thick, at speeds from
+// 10 to 400 m/s, and counts the ones that ended up behind it. Each speed runs with discrete
+// collision detection, with adaptive substeps, with CCD and with both, and prints the tunneled
+// share, the average step time and the average substeps.
+// Throughput: keeps pools of 1k, 2k, 4k ... projectiles busy firing at a wall of boxes with CCD
+// and adaptive substeps, recycling the expired ones, and prints the average step time and the
+// time spent in fire() and update().
+
+#include "Physics.h"
+#include "Projectiles.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <vector>
+
+const float STEP_TIME = 1.0f / 60.0f;
+const float WALL_THICKNESS = 0.1f;
+
+struct Mode {
+	const char* name;
+	bool ccd;
+	bool substeps;
+};
+
+static PxRigidStatic* addWall(Physics& physics, PxMaterial& material, float halfHeight)
+{
+	PxRigidStatic* wall = PxCreateStatic(*physics.physics, PxTransform(PxVec3(0.0f, halfHeight, 0.0f)),
+		PxBoxGeometry(WALL_THICKNESS * 0.5f, halfHeight, halfHeight), material);
+	physics.scene->addActor(*wall);
+	return wall;
+}
+
+static double elapsedMs(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+static void runTunneling(const Mode& mode, float speed, int count, int steps)
+{
+	PhysicsConfig config;
+	// straight lines, so that only the wall decides where a projectile ends up
+	config.gravity = 0.0f;
+	config.enableCcd = mode.ccd;
+	Physics physics(config);
+	PxMaterial* material = physics.physics->createMaterial(0.5f, 0.5f, 0.5f);
+
+	ProjectileConfig projectileConfig;
+	projectileConfig.capacity = count;
+	projectileConfig.ccd = mode.ccd;
+	projectileConfig.adaptiveSubsteps = mode.substeps;
+	projectileConfig.maxSubsteps = 16;
+	// none expires during the run
+	projectileConfig.lifetime = steps * STEP_TIME * 2.0f;
+
+	// a square grid 5 m in front of the wall, far enough apart not to hit each other
+	int side = (int)std::ceil(std::sqrt((double)count));
+	float spacing = projectileConfig.radius * 4.0f;
+	float halfHeight = side * spacing * 0.5f + 1.0f;
+	addWall(physics, *material, halfHeight);
+	{
+		ProjectilePool pool(physics, *material, projectileConfig);
+		for (int i = 0; i < count; i++) {
+			PxVec3 position(-5.0f, 1.0f + (i / side) * spacing, (i % side - side * 0.5f) * spacing);
+			pool.fire(position, PxVec3(speed, 0.0f, 0.0f));
+		}
+
+		double totalMs = 0.0;
+		long long substeps = 0;
+		for (int step = 0; step < steps; step++) {
+			auto start = std::chrono::steady_clock::now();
+			int stepSubsteps = pool.substeps(STEP_TIME);
+			physics.step(STEP_TIME, stepSubsteps);
+			pool.update(STEP_TIME);
+			totalMs += elapsedMs(start);
+			substeps += stepSubsteps;
+		}
+
+		int tunneled = 0;
+		for (int i = 0; i < pool.capacity(); i++)
+			tunneled += pool.body(i)->getGlobalPose().p.x > WALL_THICKNESS * 0.5f;
+
+		char line[256];
+		snprintf(line, sizeof(line), "%6.0f m/s  %-14s  tunneled %6.2f %% (%5d of %5d)  step %8.3f ms  substeps %5.2f",
+			speed, mode.name, 100.0 * tunneled / count, tunneled, count, totalMs / steps, substeps / (double)steps);
+		std::cout << line << std::endl;
+	}
+}
+
+static void runThroughput(int capacity, int steps)
+{
+	PhysicsConfig config;
+	config.enableCcd = true;
+	Physics physics(config);
+	PxMaterial* material = physics.physics->createMaterial(0.5f, 0.5f, 0.3f);
+	PxRigidStatic* ground = PxCreatePlane(*physics.physics, PxPlane(0, 1, 0, 0), *material);
+	physics.scene->addActor(*ground);
+
+	// a wall of 10 x 10 boxes across the line of fire
+	PxShape* boxShape = physics.physics->createShape(PxBoxGeometry(0.5f, 0.5f, 0.5f), *material);
+	for (int i = 0; i < 100; i++) {
+		PxRigidDynamic* box = physics.physics->createRigidDynamic(PxTransform(PxVec3(0.0f, 0.5f + i / 10, (i % 10 - 5.0f) * 1.01f)));
+		box->attachShape(*boxShape);
+		PxRigidBodyExt::updateMassAndInertia(*box, 200.0f);
+		physics.scene->addActor(*box);
+	}
+	boxShape->release();
+
+	ProjectileConfig projectileConfig;
+	projectileConfig.capacity = capacity;
+	projectileConfig.lifetime = 2.0f;
+	projectileConfig.adaptiveSubsteps = true;
+	projectileConfig.travelPerSubstep = 5.0f;
+	projectileConfig.maxSubsteps = 4;
+	{
+		ProjectilePool pool(physics, *material, projectileConfig);
+		// enough per step to keep the whole pool flying
+		int perStep = std::max(1, (int)std::ceil(capacity * STEP_TIME / projectileConfig.lifetime));
+		std::mt19937 random(1);
+		std::uniform_real_distribution<float> spread(-4.0f, 4.0f);
+
+		double stepMs = 0.0, poolMs = 0.0, worstMs = 0.0;
+		long long substeps = 0, fired = 0, recycled = 0;
+		int peakLive = 0;
+		for (int step = 0; step < steps; step++) {
+			auto start = std::chrono::steady_clock::now();
+			for (int i = 0; i < perStep; i++)
+				pool.fire(PxVec3(-20.0f, 5.0f + spread(random) * 0.5f, spread(random)), PxVec3(150.0f, 0.0f, 0.0f));
+			fired += perStep;
+			poolMs += elapsedMs(start);
+
+			start = std::chrono::steady_clock::now();
+			int stepSubsteps = pool.substeps(STEP_TIME);
+			physics.step(STEP_TIME, stepSubsteps);
+			double ms = elapsedMs(start);
+			stepMs += ms;
+			worstMs = std::max(worstMs, ms);
+			substeps += stepSubsteps;
+
+			start = std::chrono::steady_clock::now();
+			pool.update(STEP_TIME);
+			poolMs += elapsedMs(start);
+			recycled += pool.recycled().size();
+			peakLive = std::max(peakLive, pool.liveCount());
+		}
+
+		char line[256];
+		snprintf(line, sizeof(line), "%6d pool  %5d live at most  %7lld fired  %7lld recycled  step %8.3f ms  worst %8.3f ms  substeps %4.2f  pool %7.4f ms",
+			capacity, peakLive, fired, recycled, stepMs / steps, worstMs, substeps / (double)steps, poolMs / steps);
+		std::cout << line << std::endl;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	int projectiles = argc > 1 ? atoi(argv[1]) : 4096;
+	int steps = argc > 2 ? atoi(argv[2]) : 120;
+
+	const Mode modes[] = {
+		{ "discrete", false, false },
+		{ "substeps", false, true },
+		{ "ccd", true, false },
+		{ "ccd+substeps", true, true },
+	};
+	const float speeds[] = { 10.0f, 25.0f, 50.0f, 100.0f, 200.0f, 400.0f };
+
+	std::cout << "tunneling through a " << WALL_THICKNESS * 100.0f << " cm wall, " << projectiles << " projectiles" << std::endl;
+	for (float speed : speeds)
+		for (const Mode& mode : modes)
+			runTunneling(mode, speed, projectiles, steps);
+
+	std::cout << "throughput, ccd and adaptive substeps" << std::endl;
+	for (int capacity = 1024; capacity <= projectiles; capacity *= 2)
+		runThroughput(capacity, steps);
+	return 0;
+}
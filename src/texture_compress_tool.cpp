@@ -0,0 +1,282 @@
+// Converts the images in a directory to block compressed DDS files with a precomputed mip chain,
+// written next to each image as "<image>.dds", which Core::LoadTexture then uploads directly.
+//
+// usage: texture_compress_tool [directory] [--force] [--format bc1|bc3|bc5]
+//   directory - folder with PNG/JPG/TGA/BMP images, "textures" by default
+//   --force   - convert images even when their DDS file is newer
+//   --format  - use one format for every image; by default images named like normal maps
+//               ("normal", "_n.", "_nrm.") and two-channel images get BC5, images with
+//               transparent pixels BC3, the rest BC1
+//
+// Two-channel images keep their channels in R and G, as the uncompressed upload (GL_RG) does.
+// BC5 stores only R and G: for normal maps that is X and Y, and whatever samples one has to
+// rebuild Z as sqrt(1 - x^2 - y^2).
+//
+// Prints per texture the format, the PSNR of the compressed level 0 against the source (over the
+// channels the format keeps) and the GPU memory of the uncompressed and the compressed mip chain.
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+#include "Texture_Compression.h"
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <dirent.h>
+#endif
+
+static std::string lowercase(std::string text)
+{
+	for (auto& c : text)
+		c = (char)tolower((unsigned char)c);
+	return text;
+}
+
+static bool hasImageExtension(const std::string& name)
+{
+	std::string lower = lowercase(name);
+	size_t dot = lower.rfind('.');
+	if (dot == std::string::npos)
+		return false;
+	std::string ext = lower.substr(dot);
+	return ext == ".png" || ext == ".jpg" || ext == ".jpeg" || ext == ".tga" || ext == ".bmp";
+}
+
+static std::vector<std::string> listImageFiles(const std::string& directory)
+{
+	std::vector<std::string> result;
+#ifdef _WIN32
+	WIN32_FIND_DATAA findData;
+	HANDLE find = FindFirstFileA((directory + "\\*").c_str(), &findData);
+	if (find == INVALID_HANDLE_VALUE)
+		return result;
+	do {
+		if (!(findData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) && hasImageExtension(findData.cFileName))
+			result.push_back(directory + "/" + findData.cFileName);
+	} while (FindNextFileA(find, &findData));
+	FindClose(find);
+#else
+	DIR* dir = opendir(directory.c_str());
+	if (!dir)
+		return result;
+	while (dirent* entry = readdir(dir)) {
+		if (hasImageExtension(entry->d_name))
+			result.push_back(directory + "/" + entry->d_name);
+	}
+	closedir(dir);
+#endif
+	std::sort(result.begin(), result.end());
+	return result;
+}
+
+// false when the file does not exist
+static bool fileInfo(const std::string& path, long long& size, long long& time)
+{
+#ifdef _WIN32
+	struct _stat64 st;
+	if (_stat64(path.c_str(), &st) != 0)
+		return false;
+#else
+	struct stat st;
+	if (stat(path.c_str(), &st) != 0)
+		return false;
+#endif
+	size = st.st_size;
+	time = st.st_mtime;
+	return true;
+}
+
+static bool hasNormalMapName(const std::string& path)
+{
+	std::string name = lowercase(path.substr(path.find_last_of('/') + 1));
+	return name.find("normal") != std::string::npos || name.find("_n.") != std::string::npos || name.find("_nrm.") != std::string::npos;
+}
+
+static Core::BlockFormat chooseFormat(const std::string& path, int components, const unsigned char* rgba, int width, int height)
+{
+	if (components == 2 || hasNormalMapName(path))
+		return Core::BlockFormat::BC5;
+	for (size_t i = 0; i < (size_t)width * height; i++)
+		if (rgba[i * 4 + 3] < 255)
+			return Core::BlockFormat::BC3;
+	return Core::BlockFormat::BC1;
+}
+
+// Next mip level by averaging 2x2 pixels (the last row or column is repeated for odd sizes).
+// Normal maps are renormalized, so that every level holds unit vectors.
+static void downsample(const std::vector<unsigned char>& source, int width, int height, bool normalMap, std::vector<unsigned char>& result)
+{
+	int newWidth = std::max(1, width / 2), newHeight = std::max(1, height / 2);
+	result.resize((size_t)newWidth * newHeight * 4);
+	for (int y = 0; y < newHeight; y++) {
+		for (int x = 0; x < newWidth; x++) {
+			int x0 = std::min(x * 2, width - 1), x1 = std::min(x * 2 + 1, width - 1);
+			int y0 = std::min(y * 2, height - 1), y1 = std::min(y * 2 + 1, height - 1);
+			float sum[4];
+			for (int c = 0; c < 4; c++) {
+				sum[c] = (source[((size_t)y0 * width + x0) * 4 + c] + source[((size_t)y0 * width + x1) * 4 + c]
+					+ source[((size_t)y1 * width + x0) * 4 + c] + source[((size_t)y1 * width + x1) * 4 + c]) / 4.0f;
+			}
+			if (normalMap) {
+				float n[3] = { sum[0] / 127.5f - 1.0f, sum[1] / 127.5f - 1.0f, sum[2] / 127.5f - 1.0f };
+				float length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+				if (length > 0.0f) {
+					for (int c = 0; c < 3; c++)
+						sum[c] = (n[c] / length + 1.0f) * 127.5f;
+				}
+			}
+			for (int c = 0; c < 4; c++)
+				result[((size_t)y * newWidth + x) * 4 + c] = (unsigned char)std::min(255.0f, sum[c] + 0.5f);
+		}
+	}
+}
+
+// over the channels the format stores: RGB for BC1, RGBA for BC3, RG for BC5
+static double psnr(const std::vector<unsigned char>& source, const std::vector<unsigned char>& decoded, Core::BlockFormat format)
+{
+	int channels = format == Core::BlockFormat::BC1 ? 3 : format == Core::BlockFormat::BC3 ? 4 : 2;
+	double squaredError = 0.0;
+	size_t count = 0;
+	for (size_t i = 0; i < source.size(); i += 4) {
+		for (int c = 0; c < channels; c++) {
+			double d = double(source[i + c]) - double(decoded[i + c]);
+			squaredError += d * d;
+		}
+		count += channels;
+	}
+	if (squaredError == 0.0)
+		return INFINITY;
+	return 10.0 * std::log10(255.0 * 255.0 / (squaredError / count));
+}
+
+static const char* formatName(Core::BlockFormat format)
+{
+	return format == Core::BlockFormat::BC1 ? "BC1" : format == Core::BlockFormat::BC3 ? "BC3" : "BC5";
+}
+
+int main(int argc, char** argv)
+{
+	std::string directory = "textures";
+	bool force = false;
+	bool fixedFormat = false;
+	Core::BlockFormat format = Core::BlockFormat::BC1;
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if (arg == "--force") {
+			force = true;
+		}
+		else if (arg == "--format" && i + 1 < argc) {
+			std::string name = lowercase(argv[++i]);
+			if (name != "bc1" && name != "bc3" && name != "bc5") {
+				std::cout << "Unknown format " << argv[i] << ", expected bc1, bc3 or bc5" << std::endl;
+				return 1;
+			}
+			fixedFormat = true;
+			format = name == "bc1" ? Core::BlockFormat::BC1 : name == "bc3" ? Core::BlockFormat::BC3 : Core::BlockFormat::BC5;
+		}
+		else {
+			directory = arg;
+		}
+	}
+
+	std::vector<std::string> files = listImageFiles(directory);
+	if (files.empty()) {
+		std::cout << "No images found in " << directory << std::endl;
+		return 1;
+	}
+
+	// LoadTexture flips the images, so the files hold the bottom row first like the uploads did
+	stbi_set_flip_vertically_on_load(true);
+	int failed = 0;
+	double totalUncompressed = 0.0, totalCompressed = 0.0;
+	for (const auto& path : files) {
+		std::string ddsPath = path + ".dds";
+		long long sourceSize, sourceTime, ddsSize, ddsTime;
+		if (!fileInfo(path, sourceSize, sourceTime))
+			continue;
+		if (!force && fileInfo(ddsPath, ddsSize, ddsTime) && ddsTime >= sourceTime) {
+			std::cout << "fresh   " << path << std::endl;
+			continue;
+		}
+
+		auto start = std::chrono::steady_clock::now();
+		int width, height, components;
+		unsigned char* pixels = stbi_load(path.c_str(), &width, &height, &components, 4);
+		if (!pixels) {
+			std::cout << "FAILED  " << path << "  " << stbi_failure_reason() << std::endl;
+			failed++;
+			continue;
+		}
+		std::vector<unsigned char> level(pixels, pixels + (size_t)width * height * 4);
+		stbi_image_free(pixels);
+		// stb_image expands grey + alpha to grey, grey, grey, alpha; move alpha to G like GL_RG
+		if (components == 2) {
+			for (size_t i = 0; i < (size_t)width * height; i++) {
+				level[i * 4 + 1] = level[i * 4 + 3];
+				level[i * 4 + 2] = 0;
+				level[i * 4 + 3] = 255;
+			}
+		}
+
+		Core::CompressedImage image;
+		image.format = fixedFormat ? format : chooseFormat(path, components, level.data(), width, height);
+		bool normalMap = image.format == Core::BlockFormat::BC5 && components > 2;
+		double quality = 0.0;
+		int levelWidth = width, levelHeight = height;
+		while (true) {
+			Core::CompressedLevel compressed;
+			compressed.width = levelWidth;
+			compressed.height = levelHeight;
+			Core::compressImage(level.data(), levelWidth, levelHeight, image.format, compressed.data);
+			if (image.levels.empty()) {
+				std::vector<unsigned char> decoded;
+				Core::decompressImage(compressed.data.data(), levelWidth, levelHeight, image.format, decoded);
+				quality = psnr(level, decoded, image.format);
+			}
+			image.levels.push_back(std::move(compressed));
+			if (levelWidth == 1 && levelHeight == 1)
+				break;
+			std::vector<unsigned char> next;
+			downsample(level, levelWidth, levelHeight, normalMap, next);
+			level.swap(next);
+			levelWidth = std::max(1, levelWidth / 2);
+			levelHeight = std::max(1, levelHeight / 2);
+		}
+
+		if (!Core::writeDds(ddsPath, image)) {
+			std::cout << "FAILED  " << path << "  cannot write " << ddsPath << std::endl;
+			failed++;
+			continue;
+		}
+
+		// what LoadTexture allocated before: the decoded components with glGenerateMipmap
+		double uncompressed = (double)width * height * components * 4 / 3;
+		double compressed = 0.0;
+		for (const auto& mip : image.levels)
+			compressed += mip.data.size();
+		totalUncompressed += uncompressed;
+		totalCompressed += compressed;
+		double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		char line[512];
+		snprintf(line, sizeof(line), "ok      %s  %dx%d %s  %d mips  PSNR %.2f dB  file %.1f KB  GPU %.1f KB -> %.1f KB (%.1fx)  %.0f ms",
+			path.c_str(), width, height, formatName(image.format), (int)image.levels.size(), quality,
+			sourceSize / 1024.0, uncompressed / 1024.0, compressed / 1024.0, uncompressed / compressed, ms);
+		std::cout << line << std::endl;
+	}
+	if (totalCompressed > 0.0) {
+		char line[256];
+		snprintf(line, sizeof(line), "total GPU memory %.1f MB -> %.1f MB (%.1fx)", totalUncompressed / (1024 * 1024), totalCompressed / (1024 * 1024), totalUncompressed / totalCompressed);
+		std::cout << line << std::endl;
+	}
+	return failed == 0 ? 0 : 1;
+}
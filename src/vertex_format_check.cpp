@@ -0,0 +1,117 @@
+// Checks the quantized vertex format (see Vertex_Format.h) against the meshes it compresses.
+//
+// usage: vertex_format_check [model ...]
+//   model - files loaded through Assimp the way the city is, models/city_small.fbx and
+//           models/flying_car.fbx by default
+//
+// Packs every mesh with VertexFormat::Quantized, decodes each vertex with decodeQuantizedVertex
+// and compares the attributes with the source mesh. A synthetic sphere with tangents, mirrored
+// uvs and uvs up to 2 is checked first, so the encoding is tested without the models too.
+// Exits with 1 when a model does not load or an error exceeds its bound:
+//   position        - 1e-3 of the quantization range (half floats, at most 2^-12 per axis)
+//   normal, tangent - 0.05 degrees (octahedral snorm16, about 0.01 degrees)
+//   uv              - 1 texel of a 1024 x 1024 texture; half floats stay within half a texel
+//                     for |uv| < 2, tiled uvs far outside [0, 1] fail
+//   bitangent sign  - none wrong
+
+#include "Vertex_Format.h"
+
+#include <assimp/Importer.hpp>
+#include <assimp/postprocess.h>
+#include <assimp/scene.h>
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <vector>
+
+static const float MAX_POSITION_ERROR = 1e-3f;
+static const float MAX_DIRECTION_ERROR = 0.05f;
+// uv errors are reported in texels of a texture that size
+static const float TEXTURE_SIZE = 1024.0f;
+static const float MAX_TEXEL_ERROR = 1.0f;
+
+// a UV sphere off the origin; the bitangents of one half are flipped, like a mirrored uv layout
+static void buildSphere(aiMesh& mesh, int rings, int segments)
+{
+	const float pi = 3.14159265f;
+	const glm::vec3 center(10.0f, 2.0f, -3.0f);
+	const float radius = 5.0f;
+
+	mesh.mName = aiString("synthetic sphere");
+	mesh.mNumVertices = (rings + 1) * (segments + 1);
+	mesh.mVertices = new aiVector3D[mesh.mNumVertices];
+	mesh.mNormals = new aiVector3D[mesh.mNumVertices];
+	mesh.mTangents = new aiVector3D[mesh.mNumVertices];
+	mesh.mBitangents = new aiVector3D[mesh.mNumVertices];
+	mesh.mTextureCoords[0] = new aiVector3D[mesh.mNumVertices];
+	mesh.mNumUVComponents[0] = 2;
+
+	unsigned int i = 0;
+	for (int ring = 0; ring <= rings; ring++) {
+		float theta = pi * ring / rings;
+		for (int segment = 0; segment <= segments; segment++, i++) {
+			float phi = 2.0f * pi * segment / segments;
+			glm::vec3 normal(sinf(theta) * cosf(phi), cosf(theta), sinf(theta) * sinf(phi));
+			glm::vec3 tangent(-sinf(phi), 0.0f, cosf(phi));
+			glm::vec3 bitangent = glm::cross(normal, tangent) * (segment < segments / 2 ? 1.0f : -1.0f);
+			glm::vec3 position = center + normal * radius;
+
+			mesh.mVertices[i] = aiVector3D(position.x, position.y, position.z);
+			mesh.mNormals[i] = aiVector3D(normal.x, normal.y, normal.z);
+			mesh.mTangents[i] = aiVector3D(tangent.x, tangent.y, tangent.z);
+			mesh.mBitangents[i] = aiVector3D(bitangent.x, bitangent.y, bitangent.z);
+			mesh.mTextureCoords[0][i] = aiVector3D(2.0f * segment / segments, 1.0f * ring / rings, 0.0f);
+		}
+	}
+}
+
+// prints the errors of one mesh, false when one exceeds its bound
+static bool checkMesh(aiMesh* mesh)
+{
+	Core::PackedVertices packed;
+	Core::packVertices(mesh, Core::VertexFormat::Quantized, packed);
+	Core::QuantizationError error = Core::measureQuantizationError(mesh, packed);
+	float texelError = error.texCoord * TEXTURE_SIZE;
+
+	bool passed = error.position <= MAX_POSITION_ERROR && error.normal <= MAX_DIRECTION_ERROR
+		&& error.tangent <= MAX_DIRECTION_ERROR && texelError <= MAX_TEXEL_ERROR && error.bitangentSignErrors == 0;
+	char line[256];
+	snprintf(line, sizeof(line), "%-32s %7u vertices  position %.2e  normal %.4f deg  tangent %.4f deg  uv %.3f texels  bitangent signs %d  %s",
+		mesh->mName.C_Str(), mesh->mNumVertices, error.position, error.normal, error.tangent, texelError,
+		error.bitangentSignErrors, passed ? "ok" : "FAILED");
+	std::cout << line << std::endl;
+	return passed;
+}
+
+int main(int argc, char** argv)
+{
+	std::vector<std::string> models;
+	for (int i = 1; i < argc; i++)
+		models.push_back(argv[i]);
+	if (models.empty())
+		models = { "models/city_small.fbx", "models/flying_car.fbx" };
+
+	bool failed = false;
+	{
+		aiMesh sphere;
+		buildSphere(sphere, 64, 128);
+		failed = !checkMesh(&sphere) || failed;
+	}
+
+	for (const std::string& model : models) {
+		Assimp::Importer importer;
+		const aiScene* scene = importer.ReadFile(model, aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_CalcTangentSpace);
+		if (!scene) {
+			std::cout << model << ": " << importer.GetErrorString() << std::endl;
+			failed = true;
+			continue;
+		}
+		std::cout << model << std::endl;
+		for (unsigned int i = 0; i < scene->mNumMeshes; i++)
+			failed = !checkMesh(scene->mMeshes[i]) || failed;
+	}
+
+	std::cout << (failed ? "FAILED" : "ok") << std::endl;
+	return failed ? 1 : 0;
+}